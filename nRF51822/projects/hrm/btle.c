@@ -18,10 +18,17 @@
 #include "ble_radio_notification.h"
 #include "ble_flash.h"
 #include "ble_bondmngr.h"
-#include "ble_conn_params.h"
 
 #include "btle_gap.h"
 #include "btle_advertising.h"
+#include "btle_clock.h"
+#include "btle_beacon.h"
+#include "btle_rssi.h"
+#include "btle_tx_power.h"
+#include "btle_timeline.h"
+#include "btle_sys_attr.h"
+#include "btle_conn_params.h"
+#include "btle_handle_map.h"
 #include "custom_helper.h"
 
 //--------------------------------------------------------------------+
@@ -101,6 +108,38 @@ enum {
   BTLE_SERVICE_CUSTOM_MAX = sizeof(btle_service_custom_driver) / sizeof(btle_service_custom_driver_t)
 };
 
+#if CFG_BLE_IBEACON
+/* Frames rotated by the beacon mode, the same region is advertised with
+ * two minor values here (modify to your own need) */
+btle_beacon_frame_t const btle_beacon_frames[] =
+{
+    {
+        .type           = BTLE_BEACON_FRAME_IBEACON,
+        .uuid           = (uint8_t const *) CFG_BLE_IBEACON_UUID,
+        .major          = CFG_BLE_IBEACON_MAJOR,
+        .minor          = CFG_BLE_IBEACON_MINOR,
+        .measured_power = CFG_BLE_IBEACON_MEASURED_POWER,
+        .duration_ms    = CFG_BLE_IBEACON_FRAME_MS
+    },
+    {
+        .type           = BTLE_BEACON_FRAME_IBEACON,
+        .uuid           = (uint8_t const *) CFG_BLE_IBEACON_UUID,
+        .major          = CFG_BLE_IBEACON_MAJOR,
+        .minor          = CFG_BLE_IBEACON_MINOR + 1,
+        .measured_power = CFG_BLE_IBEACON_MEASURED_POWER,
+        .duration_ms    = CFG_BLE_IBEACON_FRAME_MS
+    },
+    {
+        .type           = BTLE_BEACON_FRAME_NAME,
+        .duration_ms    = CFG_BLE_IBEACON_FRAME_MS / 2
+    },
+};
+
+enum {
+  BTLE_BEACON_FRAME_COUNT = sizeof(btle_beacon_frames) / sizeof(btle_beacon_frame_t)
+};
+#endif
+
 //--------------------------------------------------------------------+
 // INTERNAL OBJECT & FUNCTION DECLARATION
 //--------------------------------------------------------------------+
@@ -109,6 +148,7 @@ void assert_nrf_callback(uint16_t line_num, const uint8_t * p_file_name);
 void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t * p_file_name);
 
 static error_t bond_manager_init(void);
+static void    bond_evt_handler(ble_bondmngr_evt_t * p_evt);
 
 static void btle_handler(ble_evt_t * p_ble_evt);
 static void btle_soc_event_handler(uint32_t sys_evt);
@@ -126,6 +166,9 @@ error_t btle_init(void)
   ASSERT_STATUS( softdevice_ble_evt_handler_set(btle_handler) );
   ASSERT_STATUS( softdevice_sys_evt_handler_set(btle_soc_event_handler) ); // TODO look into detail later
 
+  /* ms clock of advertising, the timeline and the TX power statistics */
+  ASSERT_STATUS( btle_clock_init() );
+
   bond_manager_init();
   btle_gap_init();
 
@@ -152,8 +195,31 @@ error_t btle_init(void)
     }
   }
 
+#if CFG_BLE_TIMELINE
+  /* Reconnection milestones, advertising start is the first one */
+  ASSERT_STATUS( btle_timeline_init() );
+#endif
+
+#if CFG_BLE_RSSI
+  /* Link quality monitor (and its service) */
+  ASSERT_STATUS( btle_rssi_init() );
+#endif
+
+#if CFG_BLE_TX_POWER_CTRL
+  ASSERT_STATUS( btle_tx_power_init() );
+#endif
+
+#if CFG_BLE_IBEACON
+  /* Non-connectable, the services are there but never advertised */
+  ASSERT_STATUS( btle_beacon_init(btle_beacon_frames, BTLE_BEACON_FRAME_COUNT) );
+  ASSERT_STATUS( btle_beacon_start() );
+#elif CFG_HEART_RATE_BROADCAST
+  /* Non-connectable as well, the measurements are advertised instead of notified */
+  ASSERT_STATUS( heart_rate_broadcast_start() );
+#else
   btle_advertising_init(btle_service_driver, BTLE_SERVICE_MAX, btle_service_custom_driver, BTLE_SERVICE_CUSTOM_MAX);
   btle_advertising_start();
+#endif
 
   return ERROR_NONE;
 }
@@ -175,8 +241,25 @@ static void btle_soc_event_handler(uint32_t sys_evt)
 static void btle_handler(ble_evt_t * p_ble_evt)
 {
   //------------- library service handler -------------//
+#if CFG_BLE_TIMELINE
+  btle_timeline_handler(p_ble_evt);
+#endif
+#if CFG_BLE_SYS_ATTR_FAST
+  btle_sys_attr_handler(p_ble_evt);
+#endif
+#if CFG_BLE_RSSI
+  btle_rssi_handler(p_ble_evt);
+#endif
+#if CFG_BLE_TX_POWER_CTRL
+  btle_tx_power_handler(p_ble_evt);
+#endif
+  btle_advertising_handler(p_ble_evt);
+  /* before the bond manager, which reports bonded centrals on connect */
+  btle_conn_params_handler(p_ble_evt);
   ble_bondmngr_on_ble_evt(p_ble_evt);
-  ble_conn_params_on_ble_evt(p_ble_evt);
+
+  /* Writes, confirmations & authorize requests go straight to the owning characteristic */
+  (void) btle_handle_map_dispatch(p_ble_evt);
 
   /*------------- Standard Service Handler -------------*/
   for(uint16_t i=0; i<BTLE_SERVICE_MAX; i++)
@@ -202,14 +285,13 @@ static void btle_handler(ble_evt_t * p_ble_evt)
   {
     case BLE_GAP_EVT_CONNECTED:
       m_conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
-      ASSERT_STATUS_RET_VOID( app_button_enable() );
     break;
 
     case BLE_GAP_EVT_DISCONNECTED:
       // Since we are not in a connection and have not started advertising, store bonds
       ASSERT_STATUS_RET_VOID ( ble_bondmngr_bonded_centrals_store() );
       m_conn_handle = BLE_CONN_HANDLE_INVALID;
-      btle_advertising_start(); // TODO use a power-efficient advertising scheme (fast, slow, sleep)
+      btle_advertising_start(); // restart from the fast phase
     break;
 
     case BLE_GAP_EVT_SEC_PARAMS_REQUEST:
@@ -228,13 +310,6 @@ static void btle_handler(ble_evt_t * p_ble_evt)
     }
     break;
 
-    case BLE_GAP_EVT_TIMEOUT:
-      if (p_ble_evt->evt.gap_evt.params.timeout.src == BLE_GAP_TIMEOUT_SRC_ADVERTISEMENT)
-      {
-        btle_advertising_start(); // TODO use a power-efficient advertising scheme (fast, slow, sleep)
-      }
-    break;
-
     case BLE_GATTC_EVT_TIMEOUT:
     case BLE_GATTS_EVT_TIMEOUT:
       // Disconnect on GATT Server and Client timeout events.
@@ -263,7 +338,7 @@ static error_t bond_manager_init(void)
       .flash_page_num_bond     = CFG_BLE_BOND_FLASH_PAGE_BOND                     ,
       .flash_page_num_sys_attr = CFG_BLE_BOND_FLASH_PAGE_SYS_ATTR                 ,
       .bonds_delete            = boardButtonCheck(CFG_BLE_BOND_DELETE_BUTTON_NUM) ,
-      .evt_handler             = NULL                                             ,
+      .evt_handler             = bond_evt_handler                                 ,
       .error_handler           = service_error_callback
   };
 
@@ -272,6 +347,18 @@ static error_t bond_manager_init(void)
   return ERROR_NONE;
 }
 
+/**************************************************************************/
+/*!
+    @brief      Passes the bond manager events on to the modules that
+                keep per-central state
+*/
+/**************************************************************************/
+static void bond_evt_handler(ble_bondmngr_evt_t * p_evt)
+{
+  btle_advertising_bond_handler(p_evt);
+  btle_conn_params_bond_handler(p_evt);
+}
+
 /**************************************************************************/
 /*!
     @brief
@@ -42,14 +42,151 @@
 
 #include "ble_advdata.h"
 #include "btle.h"
+#include "btle_advertising.h"
+#include "btle_clock.h"
+#include "btle_timeline.h"
 
 /* ---------------------------------------------------------------------- */
 /* MACRO CONSTANT TYPEDEF                                                 */
 /* ---------------------------------------------------------------------- */
+enum {
+  ADV_UUID_MAX            = 20,
+  ADV_FIELD_HEADER_LENGTH = 2, /* header size for each field in adv data */
+  ADV_FLAGS_LENGTH        = ADV_FIELD_HEADER_LENGTH + 1,
+  ADV_SHORT_NAME_MIN      = 3, /* a shortened name below this is not worth the bytes */
+  ADV_UUID_PER_PACKET     = (BLE_GAP_ADV_MAX_SIZE - ADV_FIELD_HEADER_LENGTH) / sizeof(uint16_t),
+  ADV_MANUF_PAYLOAD_MAX   = BLE_GAP_ADV_MAX_SIZE - ADV_FLAGS_LENGTH - ADV_FIELD_HEADER_LENGTH - sizeof(uint16_t),
+
+  /* manufacturer data always goes in the advertising packet, passive scanners never see the scan response */
+  ADV_MANUF_LENGTH        = (CFG_GAP_ADV_MANUF_DATA_LEN > 0) ? (ADV_FIELD_HEADER_LENGTH + sizeof(uint16_t) + CFG_GAP_ADV_MANUF_DATA_LEN) : 0
+};
+
+/* Relative value of each field when comparing two layouts */
+enum {
+  ADV_WEIGHT_UUID       = 16, /* per UUID, centrals filter on these */
+  ADV_WEIGHT_NAME       = 8,  /* scaled by the fraction of the name shown */
+  ADV_WEIGHT_APPEARANCE = 2,
+  ADV_WEIGHT_TX_POWER   = 2
+};
+
+/* Fields that can be moved between the advertising packet and the scan
+ * response. The flags always go in the advertising packet and the name
+ * is used to fill whatever space is left, so neither are listed here. */
+enum {
+  ADV_SLOT_APPEARANCE = 0,
+  ADV_SLOT_TX_POWER,
+  ADV_SLOT_UUID16,
+  ADV_SLOT_UUID128,
+  ADV_SLOT_COUNT
+};
+
+enum {
+  ADV_PLACE_NONE = 0,
+  ADV_PLACE_ADV,
+  ADV_PLACE_SCAN_RSP,
+  ADV_PLACE_COUNT
+};
+
+/* Fast & slow advertising phases, idle has no advertising parameters */
+typedef struct {
+  uint16_t interval_ms;
+  uint16_t timeout_s;
+} adv_phase_config_t;
+
+#if CFG_GAP_ADV_EXPERIMENT
+/* Every interval is tried with every channel mask, candidate = interval index * mask count + mask index */
+static uint16_t const adv_exp_interval_ms[] = { CFG_GAP_ADV_EXPERIMENT_INTERVALS_MS };
+#if CFG_GAP_ADV_EXPERIMENT_CH_MASK
+static uint8_t  const adv_exp_ch_mask[]     = { CFG_GAP_ADV_EXPERIMENT_CH_MASKS };
+#else
+static uint8_t  const adv_exp_ch_mask[]     = { 0 }; /* all three channels, S110 v6 can not mask them */
+#endif
+
+enum {
+  ADV_EXP_MASK_COUNT = sizeof(adv_exp_ch_mask) / sizeof(uint8_t),
+  ADV_EXP_CANDIDATES = (sizeof(adv_exp_interval_ms) / sizeof(uint16_t)) * ADV_EXP_MASK_COUNT,
+  ADV_EXP_NONE       = UINT32_MAX
+};
+#endif
+
+typedef struct {
+  uint8_t place[ADV_SLOT_COUNT]; /* ADV_PLACE_xxx for each slot              */
+  uint8_t uuid_cnt[2];           /* 16-bit / 128-bit UUIDs actually included */
+  uint8_t uuid_spill[2];         /* UUIDs that overflowed to the other packet */
+  uint8_t name_place;
+  uint8_t name_len;              /* name characters actually included        */
+  uint8_t used[ADV_PLACE_COUNT]; /* bytes used in each packet                */
+} adv_layout_t;
 
 /* ---------------------------------------------------------------------- */
 /* INTERNAL OBJECT & FUNCTION DECLARATION                                 */
 /* ---------------------------------------------------------------------- */
+static btle_advertising_layout_t m_layout;
+
+/* Kept for the lifetime of the module so that the advertising data can be
+ * set again when a live value changes */
+static ble_advdata_t      m_advdata[ADV_PLACE_COUNT];
+static ble_uuid_t         m_list_uuids[ADV_PLACE_COUNT][2][ADV_UUID_PER_PACKET]; /* complete & more available */
+static bool               m_has_scan_rsp;
+
+static uint8_t  const     m_flags          = BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE;
+static int8_t   const     m_tx_power_level = CFG_BLE_TX_POWER_LEVEL;
+
+static uint8_t            m_manuf_payload[ADV_MANUF_PAYLOAD_MAX]; /* currently advertised           */
+static uint8_t            m_manuf_pending[ADV_MANUF_PAYLOAD_MAX]; /* latest value from the app      */
+static bool               m_manuf_holdoff = false;                /* min update interval not over   */
+static app_timer_id_t     m_manuf_timer_id;
+static ble_advdata_manuf_data_t m_manuf_data =
+{
+  .company_identifier = CFG_GAP_ADV_MANUF_COMPANY_ID,
+  .data               = { .size = CFG_GAP_ADV_MANUF_DATA_LEN, .p_data = m_manuf_payload }
+};
+
+static adv_phase_config_t const adv_phase_config[BTLE_ADV_PHASE_IDLE] =
+{
+  [BTLE_ADV_PHASE_DIRECTED] = { .interval_ms = 0, .timeout_s = 0 }, /* both fixed by the spec, times out after 1.28 s */
+  [BTLE_ADV_PHASE_FAST] = { .interval_ms = CFG_GAP_ADV_FAST_INTERVAL_MS, .timeout_s = CFG_GAP_ADV_FAST_TIMEOUT_S },
+  [BTLE_ADV_PHASE_SLOW] = { .interval_ms = CFG_GAP_ADV_SLOW_INTERVAL_MS, .timeout_s = CFG_GAP_ADV_SLOW_TIMEOUT_S }
+};
+
+static btle_adv_phase_t   m_phase        = BTLE_ADV_PHASE_IDLE;
+static bool               m_is_connected = false;
+static btle_adv_stats_t   m_stats[BTLE_ADV_PHASE_COUNT];
+
+static ble_gap_addr_t     m_peer_addr;        /* last bonded central, target of directed advertising */
+static bool               m_has_peer     = false;
+static bool               m_is_reconnect = false;
+static btle_adv_latency_t m_reconnect_latency[2]; /* [0] undirected, [1] directed */
+
+static bool               m_is_open_pairing = false; /* whitelist lifted until the next connection */
+static bool               m_is_whitelisted  = false; /* current phase filters on the whitelist    */
+
+static uint32_t           m_start_ms;         /* btle_clock_ms() when the schedule (re)started */
+static uint32_t           m_elapsed_ms;       /* since the schedule was (re)started            */
+static uint32_t           m_phase_start_ms;   /* m_elapsed_ms when the current phase started   */
+
+#if CFG_GAP_ADV_EXPERIMENT
+static btle_adv_experiment_stats_t m_exp_stats[ADV_EXP_CANDIDATES];
+static uint8_t            m_exp_candidate;
+static uint8_t            m_exp_trial;
+static uint32_t           m_exp_scan_req_ms = ADV_EXP_NONE; /* since the trial started */
+
+static void     adv_exp_trial_end ( uint32_t ttc_ms );
+#endif
+
+static error_t  adv_phase_start   ( btle_adv_phase_t phase );
+static void     adv_phase_end     ( void );
+static void     adv_clock_update  ( void );
+static void     adv_latency_add   ( btle_adv_latency_t * p_latency, uint32_t ms );
+static error_t  adv_data_set      ( void );
+static error_t  adv_manuf_data_push    ( void );
+static void     adv_manuf_timer_handler( void * p_context );
+
+static void     adv_layout_find   ( adv_layout_t * p_best, uint8_t const uuid_total[2], uint8_t name_total );
+static uint32_t adv_layout_score  ( adv_layout_t const * p_layout, uint8_t name_total, bool adv_only );
+static void     adv_layout_report ( adv_layout_t const * p_layout, uint8_t const uuid_total[2], uint8_t name_total );
+static void     adv_uuid_append   ( ble_advdata_t * p_advdata, ble_uuid_t list_uuids[2][ADV_UUID_PER_PACKET],
+                                    bool is_complete, ble_uuid_t const uuids[], uint8_t count );
 
 /* ---------------------------------------------------------------------- */
 /* IMPLEMENTATION											                                    */
@@ -59,8 +196,11 @@
 /*!
     @brief  Initialises and sets the advertising data in the SoftDevice
 
-    @note   Advertising data's length is restricted to 31. Standard Service
-            is preferred than custom service UUIDs.
+    @note   Advertising data's length is restricted to 31 bytes for both
+            the advertising packet and the scan response. The fields are
+            spread over the two packets by adv_layout_find() so that as
+            much as possible is advertised, see btle_advertising_layout()
+            for what ended up where.
 
     @returns
 */
@@ -68,106 +208,793 @@
 error_t btle_advertising_init(btle_service_driver_t const std_service[], uint16_t const std_count,
                               btle_service_custom_driver_t const custom_service[], uint16_t const custom_count)
 {
-  enum {
-    ADV_UUID_MAX = 20,
-    ADV_FIELD_HEADER_LENGTH = 2 /* header size for each field in adv data */
-  };
-
-  /*------------- Flag, Appearance, Tx power field -------------*/
-  uint8_t const flags         = BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE;
-  int8_t const tx_power_level = CFG_BLE_TX_POWER_LEVEL;
-
-  int8_t  byte_left = BLE_GAP_ADV_MAX_SIZE;
-
-  byte_left -= (ADV_FIELD_HEADER_LENGTH + 1); // flags
-  byte_left -= (ADV_FIELD_HEADER_LENGTH + 1); // tx power
-  byte_left -= (CFG_GAP_APPEARANCE != BLE_APPEARANCE_UNKNOWN) ? (ADV_FIELD_HEADER_LENGTH + 2) : 0; // appearance
-
-  /*------------- UUID list -------------*/
-  ble_uuid_t adv_uuids[ADV_UUID_MAX];
   ASSERT( ADV_UUID_MAX >= std_count + custom_count, ERROR_NO_MEM); // the total service count exceed 20, need to increase ADV_COUNT_MAX
 
-  uint16_t uuid_count = 0;
+  /*------------- Sort the UUIDs by size -------------*/
+  ble_uuid_t uuids[2][ADV_UUID_MAX];
+  uint8_t    uuid_total[2] = { 0, 0 };
 
-  /* Standard Services are added first (higher priority), modify to your own need if required */
-  if (std_count > 0)
+  /* Standard Services are listed first (higher priority), modify to your own need if required */
+  for (uint16_t i=0; i < std_count; i++)
   {
-    byte_left -= ADV_FIELD_HEADER_LENGTH;
-    for (uint16_t i=0; (i < std_count) && (byte_left > 0) ; i++)
+    if (std_service[i].init != NULL)
     {
-      if (std_service[i].init != NULL)
-      {
-        adv_uuids[uuid_count].uuid = i+0x1800;
-        adv_uuids[uuid_count].type = BLE_UUID_TYPE_BLE;
-        ++uuid_count;
-        byte_left -= 2; // 16-bit uuid
-      }
+      uuids[0][uuid_total[0]].uuid = i+0x1800;
+      uuids[0][uuid_total[0]].type = BLE_UUID_TYPE_BLE;
+      ++uuid_total[0];
     }
   }
 
-  /* Custom Services are added later (lower priority), modify to your own need if required */
-  if (custom_count > 0)
+  /* Custom Services are listed later (lower priority), modify to your own need if required */
+  for (uint16_t i=0; i < custom_count; i++)
   {
-    byte_left -= ADV_FIELD_HEADER_LENGTH;
-    for (uint16_t i=0; (i<custom_count) && (byte_left > 0); i++)
+    if (custom_service[i].service_uuid.type >= BLE_UUID_TYPE_VENDOR_BEGIN)
     {
-      if (custom_service[i].service_uuid.type >= BLE_UUID_TYPE_VENDOR_BEGIN)
-      {
-        adv_uuids[uuid_count] = custom_service[i].service_uuid;
-        ++uuid_count;
-        byte_left -= 16; // 128-bit uuid
-      }
+      uuids[1][uuid_total[1]] = custom_service[i].service_uuid;
+      ++uuid_total[1];
     }
   }
 
-  /*------------- Advertising Data -------------*/
-  ble_advdata_t advdata =
-  {
-      .flags.size              = 1                                            ,
-      .flags.p_data            = (uint8_t*) &flags                            ,
-      .include_appearance      = CFG_GAP_APPEARANCE != BLE_APPEARANCE_UNKNOWN ,
-      .p_tx_power_level        = (int8_t*) &tx_power_level                    ,
+  /*------------- Spread the fields over advertising & scan response -------------*/
+  adv_layout_t layout;
+  uint8_t const name_total = strlen(CFG_GAP_LOCAL_NAME);
 
-      .uuids_complete.uuid_cnt = uuid_count                                   ,
-      .uuids_complete.p_uuids  = adv_uuids
-  };
+  adv_layout_find(&layout, uuid_total, name_total);
+  adv_layout_report(&layout, uuid_total, name_total);
 
-  /* left data is used for name if possible */
-  if ( byte_left > ADV_FIELD_HEADER_LENGTH)
+  /*------------- Advertising Data & Scan Response -------------*/
+  memclr_(m_advdata, sizeof(m_advdata));
+
+  m_advdata[ADV_PLACE_ADV].flags.size   = 1;
+  m_advdata[ADV_PLACE_ADV].flags.p_data = (uint8_t*) &m_flags;
+
+  m_advdata[ layout.place[ADV_SLOT_APPEARANCE] ].include_appearance = true;
+  m_advdata[ layout.place[ADV_SLOT_TX_POWER]   ].p_tx_power_level   = (int8_t*) &m_tx_power_level;
+
+  if ( CFG_GAP_ADV_MANUF_DATA_LEN > 0 )
+  {
+    m_advdata[ADV_PLACE_ADV].p_manuf_specific_data = &m_manuf_data;
+    ASSERT_STATUS( app_timer_create(&m_manuf_timer_id, APP_TIMER_MODE_SINGLE_SHOT, adv_manuf_timer_handler) );
+  }
+
+  /* both UUID sizes can share a list */
+  for(uint8_t idx=0; idx<2; idx++)
   {
-    byte_left -= ADV_FIELD_HEADER_LENGTH;
+    uint8_t const place = layout.place[ADV_SLOT_UUID16+idx];
+    if ( place == ADV_PLACE_NONE ) continue;
+
+    /* A list split over both packets, or cut short, must use the 'more available' AD types */
+    bool const is_complete = (layout.uuid_cnt[idx] == uuid_total[idx]);
+    adv_uuid_append(&m_advdata[place], m_list_uuids[place], is_complete, uuids[idx], layout.uuid_cnt[idx]);
+
+    if ( layout.uuid_spill[idx] )
+    {
+      uint8_t const other = (place == ADV_PLACE_ADV) ? ADV_PLACE_SCAN_RSP : ADV_PLACE_ADV;
+      adv_uuid_append(&m_advdata[other], m_list_uuids[other], false, &uuids[idx][layout.uuid_cnt[idx]], layout.uuid_spill[idx]);
+    }
+  }
 
-    advdata.name_type      = (byte_left < strlen(CFG_GAP_LOCAL_NAME)) ? BLE_ADVDATA_SHORT_NAME : BLE_ADVDATA_FULL_NAME;
-    advdata.short_name_len = (advdata.name_type == BLE_ADVDATA_SHORT_NAME) ? byte_left : 0;
+  m_advdata[layout.name_place].name_type      = (layout.name_len < name_total) ? BLE_ADVDATA_SHORT_NAME : BLE_ADVDATA_FULL_NAME;
+  m_advdata[layout.name_place].short_name_len = (layout.name_len < name_total) ? layout.name_len : 0;
 
-    byte_left -= min8_of(byte_left, strlen(CFG_GAP_LOCAL_NAME));
+  m_has_scan_rsp = (layout.used[ADV_PLACE_SCAN_RSP] > 0);
+  ASSERT_STATUS( adv_data_set() );
+
+#if CFG_GAP_ADV_EXPERIMENT
+  for(uint8_t i=0; i<ADV_EXP_CANDIDATES; i++)
+  {
+    m_exp_stats[i].interval_ms = adv_exp_interval_ms[i / ADV_EXP_MASK_COUNT];
+    m_exp_stats[i].ch_mask     = adv_exp_ch_mask[i % ADV_EXP_MASK_COUNT];
   }
 
-  ASSERT_STATUS( ble_advdata_set(&advdata, NULL) );
+  #if CFG_GAP_ADV_EXPERIMENT_SCAN_REQ
+  /* BLE_GAP_EVT_SCAN_REQ_REPORT, needs S110 v7.0 or later */
+  ble_opt_t opt;
+  memclr_(&opt, sizeof(ble_opt_t));
+  opt.gap_opt.scan_req_report.enable = 1;
+  ASSERT_STATUS( sd_ble_opt_set(BLE_GAP_OPT_SCAN_REQ_REPORT, &opt) );
+  #endif
+#endif
 
   return ERROR_NONE;
 }
 
 /**************************************************************************/
 /*!
-    @brief      Starts the advertising process
+    @brief      Updates the live values in the manufacturer specific data
+                of the advertising packet, without interrupting
+                advertising. Unchanged values are not pushed to the
+                SoftDevice, and changes are held back so that the data is
+                set at most once per CFG_GAP_ADV_MANUF_UPDATE_MIN_MS (the
+                latest value wins).
+
+    @param[in]  p_data  New payload, the company identifier is added
+    @param[in]  len     Must be CFG_GAP_ADV_MANUF_DATA_LEN
+
+    @returns
+*/
+/**************************************************************************/
+error_t btle_advertising_manuf_data_update(uint8_t const * p_data, uint8_t len)
+{
+  ASSERT( CFG_GAP_ADV_MANUF_DATA_LEN > 0, ERROR_INVALID_STATE );
+  ASSERT( len == CFG_GAP_ADV_MANUF_DATA_LEN, ERROR_INVALID_LENGTH );
+
+  memcpy(m_manuf_pending, p_data, len);
+
+  /* pushed by adv_manuf_timer_handler() once the interval is over */
+  if ( m_manuf_holdoff ) return ERROR_NONE;
+
+  return adv_manuf_data_push();
+}
+
+/**************************************************************************/
+/*!
+    @brief      Gets where each field ended up after btle_advertising_init()
+
+    @returns    A pointer to the layout report, with BTLE_ADV_FIELD_xxx
+                bitmasks for the advertising packet, the scan response and
+                the fields that had to be shortened or left out
+*/
+/**************************************************************************/
+btle_advertising_layout_t const * btle_advertising_layout(void)
+{
+  return &m_layout;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Starts the advertising process from the directed phase if
+                a bonded central is known, otherwise from the fast phase.
+                The SoftDevice's advertising timeout moves it on to the
+                next phase, down to idle (see btle_advertising_handler)
 
     @returns
 */
 /**************************************************************************/
 error_t btle_advertising_start(void)
 {
+  btle_timeline_mark(BTLE_TIMELINE_ADV_START);
+
+  m_start_ms   = btle_clock_ms();
+  m_elapsed_ms = 0;
+
+  /* experiment trials always start undirected, a directed hit would say nothing about the interval */
+  return adv_phase_start( (CFG_GAP_ADV_DIRECTED && !CFG_GAP_ADV_EXPERIMENT && m_has_peer && !m_is_open_pairing) ?
+                          BTLE_ADV_PHASE_DIRECTED : BTLE_ADV_PHASE_FAST );
+}
+
+/**************************************************************************/
+/*!
+    @brief      Restarts advertising if the schedule has gone idle, e.g.
+                on a button press
+
+    @returns    ERROR_NONE if advertising was restarted, or is already
+                running/connected (nothing to do)
+*/
+/**************************************************************************/
+error_t btle_advertising_wakeup(void)
+{
+  if ( m_is_connected || m_phase != BTLE_ADV_PHASE_IDLE ) return ERROR_NONE;
+
+  return btle_advertising_start();
+}
+
+/**************************************************************************/
+/*!
+    @brief      Lifts the bond whitelist so that a new central can pair,
+                until the next connection. Advertising is restarted from
+                the fast phase (skipping directed advertising) if it is
+                running or idle.
+
+    @returns
+*/
+/**************************************************************************/
+error_t btle_advertising_open_pairing(void)
+{
+  m_is_open_pairing = true;
+
+  /* takes effect when advertising restarts after the disconnect */
+  if ( m_is_connected ) return ERROR_NONE;
+
+  if ( m_phase != BTLE_ADV_PHASE_IDLE )
+  {
+    adv_phase_end();
+    (void) sd_ble_gap_adv_stop();
+  }
+
+  m_is_reconnect = false;
+
+  return btle_advertising_start();
+}
+
+/**************************************************************************/
+/*!
+    @brief      Checks if advertising currently ignores centrals that are
+                not bonded
+
+    @returns    true if the current phase uses the bond whitelist
+*/
+/**************************************************************************/
+bool btle_advertising_is_whitelisted(void)
+{
+  return (m_phase != BTLE_ADV_PHASE_IDLE) && m_is_whitelisted;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Moves the advertising schedule along, must be called with
+                every event from the SoftDevice
+
+    @param[in]  p_ble_evt
+*/
+/**************************************************************************/
+void btle_advertising_handler(ble_evt_t * p_ble_evt)
+{
+  switch ( p_ble_evt->header.evt_id )
+  {
+    case BLE_GAP_EVT_CONNECTED:
+      m_is_connected    = true;
+      m_is_open_pairing = false;
+
+      if ( m_phase != BTLE_ADV_PHASE_IDLE )
+      {
+        adv_phase_end();
+
+        /* time to connect counts from the start of the schedule, not the phase */
+        adv_latency_add(&m_stats[m_phase].ttc, m_elapsed_ms);
+
+#if CFG_GAP_ADV_EXPERIMENT
+        if ( m_phase == BTLE_ADV_PHASE_FAST ) adv_exp_trial_end(m_elapsed_ms - m_phase_start_ms);
+#endif
+
+        /* the schedule is restarted right after a disconnect, so this is the reconnect latency */
+        if ( m_is_reconnect )
+        {
+          adv_latency_add(&m_reconnect_latency[ (m_phase == BTLE_ADV_PHASE_DIRECTED) ? 1 : 0 ], m_elapsed_ms);
+          m_is_reconnect = false;
+        }
+
+        /* advertising stops on connection, no idle count */
+        m_phase = BTLE_ADV_PHASE_IDLE;
+      }
+    break;
+
+    case BLE_GAP_EVT_DISCONNECTED:
+      m_is_connected = false;
+      m_is_reconnect = true;
+    break;
+
+    case BLE_GAP_EVT_TIMEOUT:
+      if ( p_ble_evt->evt.gap_evt.params.timeout.src == BLE_GAP_TIMEOUT_SRC_ADVERTISEMENT && m_phase != BTLE_ADV_PHASE_IDLE )
+      {
+        adv_phase_end();
+
+#if CFG_GAP_ADV_EXPERIMENT
+        /* a miss, the next trial starts right away instead of the slow phase */
+        if ( m_phase == BTLE_ADV_PHASE_FAST )
+        {
+          adv_exp_trial_end(ADV_EXP_NONE);
+          ASSERT_STATUS_RET_VOID( adv_phase_start(BTLE_ADV_PHASE_FAST) );
+          break;
+        }
+#endif
+
+        ASSERT_STATUS_RET_VOID( adv_phase_start(m_phase+1) );
+      }
+    break;
+
+#if CFG_GAP_ADV_EXPERIMENT && CFG_GAP_ADV_EXPERIMENT_SCAN_REQ
+    case BLE_GAP_EVT_SCAN_REQ_REPORT:
+      if ( m_phase == BTLE_ADV_PHASE_FAST && m_exp_scan_req_ms == ADV_EXP_NONE )
+      {
+        adv_clock_update();
+        m_exp_scan_req_ms = m_elapsed_ms - m_phase_start_ms;
+      }
+    break;
+#endif
+
+    default: break;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief      Gets the time-to-connect statistics of an advertising phase
+
+    @param[in]  phase   BTLE_ADV_PHASE_xxx (for idle, only 'started' is
+                        counted)
+
+    @returns    Statistics accumulated since reset
+*/
+/**************************************************************************/
+btle_adv_stats_t const * btle_advertising_stats(btle_adv_phase_t phase)
+{
+  return &m_stats[ min8_of(phase, BTLE_ADV_PHASE_IDLE) ];
+}
+
+/**************************************************************************/
+/*!
+    @brief      Gets the disconnect to reconnect latency
+
+    @param[in]  directed  true for reconnections made by directed
+                          advertising, false for the undirected phases
+
+    @returns    Statistics accumulated since reset
+*/
+/**************************************************************************/
+btle_adv_latency_t const * btle_advertising_reconnect_latency(bool directed)
+{
+  return &m_reconnect_latency[directed ? 1 : 0];
+}
+
+/**************************************************************************/
+/*!
+    @brief      Gets the statistics of an advertising experiment candidate
+
+    @param[in]  candidate   0 to (number of intervals * number of channel
+                            masks - 1), in the order of the log lines
+
+    @returns    Statistics accumulated since reset, NULL if the candidate
+                does not exist or CFG_GAP_ADV_EXPERIMENT is disabled
+*/
+/**************************************************************************/
+btle_adv_experiment_stats_t const * btle_advertising_experiment_stats(uint8_t candidate)
+{
+#if CFG_GAP_ADV_EXPERIMENT
+  return (candidate < ADV_EXP_CANDIDATES) ? &m_exp_stats[candidate] : NULL;
+#else
+  (void) candidate;
+  return NULL;
+#endif
+}
+
+/**************************************************************************/
+/*!
+    @brief      Keeps track of the last bonded central, must be set as the
+                bond manager's event handler (or called from it)
+
+    @param[in]  p_evt
+*/
+/**************************************************************************/
+void btle_advertising_bond_handler(ble_bondmngr_evt_t * p_evt)
+{
+  switch ( p_evt->evt_type )
+  {
+    case BLE_BONDMNGR_EVT_NEW_BOND:
+    case BLE_BONDMNGR_EVT_CONN_TO_BONDED_CENTRAL:
+      /* A resolvable private address will have changed by the time we
+       * reconnect, only directed advertise to public & static addresses */
+      m_has_peer = ( NRF_SUCCESS == ble_bondmngr_central_addr_get(p_evt->central_handle, &m_peer_addr) ) &&
+                   ( m_peer_addr.addr_type != BLE_GAP_ADDR_TYPE_RANDOM_PRIVATE_RESOLVABLE );
+    break;
+
+    default: break;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief      Enters an advertising phase
+*/
+/**************************************************************************/
+static error_t adv_phase_start(btle_adv_phase_t phase)
+{
+  m_phase = phase;
+  m_stats[phase].started++;
+
+  if ( phase == BTLE_ADV_PHASE_IDLE )
+  {
+    /* Nothing left to time, wait for btle_advertising_wakeup() */
+    m_is_reconnect = false; /* a wakeup is not a reconnect attempt anymore */
+    return ERROR_NONE;
+  }
+
+  adv_clock_update();
+  m_phase_start_ms = m_elapsed_ms;
+
+  bool const is_directed = (phase == BTLE_ADV_PHASE_DIRECTED);
+  uint16_t interval_ms   = adv_phase_config[phase].interval_ms;
+
+#if CFG_GAP_ADV_EXPERIMENT
+  /* the fast phase is the trial, its timeout is the trial's timeout */
+  if ( phase == BTLE_ADV_PHASE_FAST )
+  {
+    interval_ms       = m_exp_stats[m_exp_candidate].interval_ms;
+    m_exp_scan_req_ms = ADV_EXP_NONE;
+  }
+#endif
+
+  /*------------- Whitelist of bonded centrals -------------*/
+  ble_gap_addr_t * p_whitelist_addr[BLE_GAP_WHITELIST_ADDR_MAX_COUNT];
+  ble_gap_irk_t  * p_whitelist_irk [BLE_GAP_WHITELIST_IRK_MAX_COUNT];
+
+  ble_gap_whitelist_t whitelist =
+  {
+      .pp_addrs   = p_whitelist_addr                ,
+      .addr_count = BLE_GAP_WHITELIST_ADDR_MAX_COUNT ,
+      .pp_irks    = p_whitelist_irk                 ,
+      .irk_count  = BLE_GAP_WHITELIST_IRK_MAX_COUNT
+  };
+
+  m_is_whitelisted = false;
+  if ( CFG_GAP_ADV_WHITELIST && !is_directed && !m_is_open_pairing )
+  {
+    /* switches on by itself once there are bonds */
+    ASSERT_STATUS( ble_bondmngr_whitelist_get(&whitelist) );
+    m_is_whitelisted = (whitelist.addr_count > 0) || (whitelist.irk_count > 0);
+  }
+
   ble_gap_adv_params_t adv_para =
   {
-      .type        = BLE_GAP_ADV_TYPE_ADV_IND      ,
-      .p_peer_addr = NULL                          , // Undirected advertisement
-      .fp          = BLE_GAP_ADV_FP_ANY            ,
-      .p_whitelist = NULL                          ,
-      .interval    = (CFG_GAP_ADV_INTERVAL_MS*8)/5 , // advertising interval (in units of 0.625 ms)
-      .timeout     = CFG_GAP_ADV_TIMEOUT_S
+      .type        = is_directed ? BLE_GAP_ADV_TYPE_ADV_DIRECT_IND : BLE_GAP_ADV_TYPE_ADV_IND,
+      .p_peer_addr = is_directed ? &m_peer_addr : NULL            ,
+      .fp          = m_is_whitelisted ? BLE_GAP_ADV_FP_FILTER_BOTH : BLE_GAP_ADV_FP_ANY,
+      .p_whitelist = m_is_whitelisted ? &whitelist : NULL         ,
+      .interval    = (interval_ms*8)/5                            , // advertising interval (in units of 0.625 ms)
+      .timeout     = adv_phase_config[phase].timeout_s
   };
 
+#if CFG_GAP_ADV_EXPERIMENT && CFG_GAP_ADV_EXPERIMENT_CH_MASK
+  /* ble_gap_adv_ch_mask_t, needs S110 v7.0 or later */
+  if ( phase == BTLE_ADV_PHASE_FAST )
+  {
+    uint8_t const ch_mask = m_exp_stats[m_exp_candidate].ch_mask;
+    adv_para.channel_mask.ch_37_off = BIT_TEST(ch_mask, 0) ? 1 : 0;
+    adv_para.channel_mask.ch_38_off = BIT_TEST(ch_mask, 1) ? 1 : 0;
+    adv_para.channel_mask.ch_39_off = BIT_TEST(ch_mask, 2) ? 1 : 0;
+  }
+#endif
+
   ASSERT_STATUS( sd_ble_gap_adv_start(&adv_para) );
 
 	return ERROR_NONE;
 }
+
+/**************************************************************************/
+/*!
+    @brief      Adds the time spent in the current phase to its statistics
+*/
+/**************************************************************************/
+static void adv_phase_end(void)
+{
+  adv_clock_update();
+  m_stats[m_phase].advertising_ms += m_elapsed_ms - m_phase_start_ms;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Brings m_elapsed_ms up to date with btle_clock_ms()
+*/
+/**************************************************************************/
+static void adv_clock_update(void)
+{
+  m_elapsed_ms = btle_clock_ms() - m_start_ms;
+}
+
+#if CFG_GAP_ADV_EXPERIMENT
+/**************************************************************************/
+/*!
+    @brief      Records the outcome of a trial, logs it for
+                tools/adv_experiment.py and moves on to the next candidate
+                every CFG_GAP_ADV_EXPERIMENT_TRIALS trials
+
+    @param[in]  ttc_ms  Time to connect, ADV_EXP_NONE for a miss
+*/
+/**************************************************************************/
+static void adv_exp_trial_end(uint32_t ttc_ms)
+{
+  btle_adv_experiment_stats_t * p_stats = &m_exp_stats[m_exp_candidate];
+
+  if ( m_exp_scan_req_ms != ADV_EXP_NONE ) adv_latency_add(&p_stats->scan_req, m_exp_scan_req_ms);
+
+  if ( ttc_ms != ADV_EXP_NONE ) adv_latency_add(&p_stats->ttc, ttc_ms);
+  else                          p_stats->misses++;
+
+  /* -1 = did not happen (or not reported by the stack) */
+  printf("advx: candidate %u interval %u ms ch_mask 0x%X scan_req %d ms connect %d ms" CFG_PRINTF_NEWLINE,
+         m_exp_candidate, p_stats->interval_ms, p_stats->ch_mask,
+         (m_exp_scan_req_ms == ADV_EXP_NONE) ? -1 : (int) m_exp_scan_req_ms,
+         (ttc_ms == ADV_EXP_NONE) ? -1 : (int) ttc_ms);
+
+  if ( ++m_exp_trial >= CFG_GAP_ADV_EXPERIMENT_TRIALS )
+  {
+    m_exp_trial     = 0;
+    m_exp_candidate = (m_exp_candidate + 1) % ADV_EXP_CANDIDATES;
+  }
+}
+#endif
+
+/**************************************************************************/
+/*!
+    @brief      Sets the advertising data & scan response in the SoftDevice.
+                This is allowed while advertising, the next advertising
+                event uses the new data.
+*/
+/**************************************************************************/
+static error_t adv_data_set(void)
+{
+  /* Anything placed in ADV_PLACE_NONE is simply not passed down */
+  ASSERT_STATUS( ble_advdata_set(&m_advdata[ADV_PLACE_ADV], m_has_scan_rsp ? &m_advdata[ADV_PLACE_SCAN_RSP] : NULL) );
+
+  return ERROR_NONE;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Advertises the pending manufacturer data if it changed and
+                starts the minimum update interval
+*/
+/**************************************************************************/
+static error_t adv_manuf_data_push(void)
+{
+  if ( 0 == memcmp(m_manuf_payload, m_manuf_pending, CFG_GAP_ADV_MANUF_DATA_LEN) ) return ERROR_NONE;
+
+  memcpy(m_manuf_payload, m_manuf_pending, CFG_GAP_ADV_MANUF_DATA_LEN);
+  ASSERT_STATUS( adv_data_set() );
+
+  m_manuf_holdoff = true;
+  ASSERT_STATUS( app_timer_start(m_manuf_timer_id, APP_TIMER_TICKS(CFG_GAP_ADV_MANUF_UPDATE_MIN_MS, CFG_TIMER_PRESCALER), NULL) );
+
+  return ERROR_NONE;
+}
+
+static void adv_manuf_timer_handler(void * p_context)
+{
+  (void) p_context;
+
+  m_manuf_holdoff = false;
+  ASSERT_STATUS_RET_VOID( adv_manuf_data_push() );
+}
+
+static void adv_latency_add(btle_adv_latency_t * p_latency, uint32_t ms)
+{
+  if ( p_latency->count == 0 || ms < p_latency->min_ms ) p_latency->min_ms = ms;
+  if ( ms > p_latency->max_ms ) p_latency->max_ms = ms;
+
+  p_latency->total_ms += ms;
+  p_latency->count++;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Tries every placement of the movable fields (advertising
+                packet, scan response or left out) and keeps the layout
+                that advertises the most. With four slots that is only
+                3^4 = 81 candidates, which is cheap enough to run once at
+                init.
+
+    @param[out] p_best      The winning layout
+    @param[in]  uuid_total  Number of 16-bit and 128-bit service UUIDs
+    @param[in]  name_total  Length of the full device name
+*/
+/**************************************************************************/
+static void adv_layout_find(adv_layout_t * p_best, uint8_t const uuid_total[2], uint8_t name_total)
+{
+  static uint8_t const slot_size[ADV_SLOT_COUNT] =
+  {
+    [ADV_SLOT_APPEARANCE] = ADV_FIELD_HEADER_LENGTH + sizeof(uint16_t),
+    [ADV_SLOT_TX_POWER  ] = ADV_FIELD_HEADER_LENGTH + sizeof(int8_t),
+    [ADV_SLOT_UUID16    ] = sizeof(uint16_t),      /* per uuid, header added below */
+    [ADV_SLOT_UUID128   ] = sizeof(ble_uuid128_t)
+  };
+
+  uint32_t best_score[2] = { 0, 0 };
+  memclr_(p_best, sizeof(adv_layout_t));
+  p_best->used[ADV_PLACE_ADV] = ADV_FLAGS_LENGTH + ADV_MANUF_LENGTH;
+
+  uint8_t combo_count = 1;
+  for(uint8_t i=0; i<ADV_SLOT_COUNT; i++) combo_count *= ADV_PLACE_COUNT;
+
+  for(uint8_t combo=0; combo < combo_count; combo++)
+  {
+    adv_layout_t layout;
+    memclr_(&layout, sizeof(adv_layout_t));
+    layout.used[ADV_PLACE_ADV] = ADV_FLAGS_LENGTH + ADV_MANUF_LENGTH; /* flags & manufacturer data must be in the advertising packet */
+
+    bool is_valid = true;
+    uint8_t code  = combo;
+
+    for(uint8_t slot=0; slot < ADV_SLOT_COUNT && is_valid; slot++)
+    {
+      uint8_t const place = code % ADV_PLACE_COUNT;
+      code /= ADV_PLACE_COUNT;
+
+      layout.place[slot] = place;
+      if ( place == ADV_PLACE_NONE ) continue;
+
+      uint8_t const room = BLE_GAP_ADV_MAX_SIZE - layout.used[place];
+
+      if ( slot == ADV_SLOT_UUID16 || slot == ADV_SLOT_UUID128 )
+      {
+        uint8_t const idx = slot - ADV_SLOT_UUID16;
+        uint8_t const fit = (room > ADV_FIELD_HEADER_LENGTH) ? (room - ADV_FIELD_HEADER_LENGTH) / slot_size[slot] : 0;
+
+        layout.uuid_cnt[idx] = min8_of(uuid_total[idx], fit);
+
+        /* An empty list is pointless, the 'none' placement covers it */
+        is_valid = (layout.uuid_cnt[idx] > 0);
+        layout.used[place] += ADV_FIELD_HEADER_LENGTH + layout.uuid_cnt[idx]*slot_size[slot];
+      }
+      else if ( slot == ADV_SLOT_APPEARANCE && CFG_GAP_APPEARANCE == BLE_APPEARANCE_UNKNOWN )
+      {
+        is_valid = false;
+      }
+      else
+      {
+        is_valid = (slot_size[slot] <= room);
+        layout.used[place] += slot_size[slot];
+      }
+    }
+
+    if ( !is_valid ) continue;
+
+    /* UUIDs that did not fit overflow into the other packet if there is room */
+    for(uint8_t idx=0; idx<2; idx++)
+    {
+      uint8_t const slot  = ADV_SLOT_UUID16 + idx;
+      uint8_t const place = layout.place[slot];
+      if ( place == ADV_PLACE_NONE ) continue;
+
+      uint8_t const other = (place == ADV_PLACE_ADV) ? ADV_PLACE_SCAN_RSP : ADV_PLACE_ADV;
+      uint8_t const room  = BLE_GAP_ADV_MAX_SIZE - layout.used[other];
+      uint8_t const fit   = (room > ADV_FIELD_HEADER_LENGTH) ? (room - ADV_FIELD_HEADER_LENGTH) / slot_size[slot] : 0;
+
+      layout.uuid_spill[idx] = min8_of(uuid_total[idx] - layout.uuid_cnt[idx], fit);
+      if ( layout.uuid_spill[idx] ) layout.used[other] += ADV_FIELD_HEADER_LENGTH + layout.uuid_spill[idx]*slot_size[slot];
+    }
+
+    /* The name fills whichever packet shows more of it */
+    for(uint8_t place = ADV_PLACE_ADV; place < ADV_PLACE_COUNT; place++)
+    {
+      uint8_t const room = BLE_GAP_ADV_MAX_SIZE - layout.used[place];
+      uint8_t const len  = (room > ADV_FIELD_HEADER_LENGTH) ? min8_of(name_total, room - ADV_FIELD_HEADER_LENGTH) : 0;
+
+      if ( len > layout.name_len && len >= min8_of(name_total, ADV_SHORT_NAME_MIN) )
+      {
+        layout.name_place = place;
+        layout.name_len   = len;
+      }
+    }
+    layout.used[layout.name_place] += (layout.name_len > 0) ? (ADV_FIELD_HEADER_LENGTH + layout.name_len) : 0;
+
+    /* Most content wins, then the most content visible without a scan
+     * request, then the shortest advertising packet (less air time) */
+    uint32_t const score[2] =
+    {
+      adv_layout_score(&layout, name_total, false),
+      adv_layout_score(&layout, name_total, true)
+    };
+
+    if ( (score[0] >  best_score[0]) ||
+         (score[0] == best_score[0] && score[1] >  best_score[1]) ||
+         (score[0] == best_score[0] && score[1] == best_score[1] && layout.used[ADV_PLACE_ADV] < p_best->used[ADV_PLACE_ADV]) )
+    {
+      best_score[0] = score[0];
+      best_score[1] = score[1];
+      *p_best = layout;
+    }
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief      Scores how much a layout advertises
+
+    @param[in]  p_layout    The candidate layout
+    @param[in]  name_total  Length of the full device name
+    @param[in]  adv_only    Only count what is in the advertising packet
+*/
+/**************************************************************************/
+static uint32_t adv_layout_score(adv_layout_t const * p_layout, uint8_t name_total, bool adv_only)
+{
+  uint32_t score = 0;
+
+  #define ADV_COUNTS(place)   ( (place) != ADV_PLACE_NONE && (!adv_only || (place) == ADV_PLACE_ADV) )
+
+  if ( ADV_COUNTS(p_layout->place[ADV_SLOT_APPEARANCE]) ) score += ADV_WEIGHT_APPEARANCE;
+  if ( ADV_COUNTS(p_layout->place[ADV_SLOT_TX_POWER])   ) score += ADV_WEIGHT_TX_POWER;
+
+  for(uint8_t idx=0; idx<2; idx++)
+  {
+    uint8_t const place = p_layout->place[ADV_SLOT_UUID16+idx];
+
+    if ( ADV_COUNTS(place) ) score += ADV_WEIGHT_UUID * p_layout->uuid_cnt[idx];
+    if ( place != ADV_PLACE_NONE && !adv_only ) score += ADV_WEIGHT_UUID * p_layout->uuid_spill[idx];
+    if ( place == ADV_PLACE_SCAN_RSP && adv_only ) score += ADV_WEIGHT_UUID * p_layout->uuid_spill[idx];
+  }
+
+  if ( p_layout->name_len > 0 && ADV_COUNTS(p_layout->name_place) )
+  {
+    score += (ADV_WEIGHT_NAME * p_layout->name_len) / name_total;
+  }
+
+  #undef ADV_COUNTS
+
+  return score;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Records where each field ended up, and prints a warning
+                when something had to be shortened or left out
+*/
+/**************************************************************************/
+static void adv_layout_report(adv_layout_t const * p_layout, uint8_t const uuid_total[2], uint8_t name_total)
+{
+  static uint8_t const slot_field[ADV_SLOT_COUNT] =
+  {
+    [ADV_SLOT_APPEARANCE] = BTLE_ADV_FIELD_APPEARANCE,
+    [ADV_SLOT_TX_POWER  ] = BTLE_ADV_FIELD_TX_POWER,
+    [ADV_SLOT_UUID16    ] = BTLE_ADV_FIELD_UUID16,
+    [ADV_SLOT_UUID128   ] = BTLE_ADV_FIELD_UUID128
+  };
+
+  memclr_(&m_layout, sizeof(btle_advertising_layout_t));
+
+  for(uint8_t slot=0; slot<ADV_SLOT_COUNT; slot++)
+  {
+    uint8_t const field = slot_field[slot];
+    bool const is_wanted = (slot == ADV_SLOT_APPEARANCE) ? (CFG_GAP_APPEARANCE != BLE_APPEARANCE_UNKNOWN) :
+                           (slot == ADV_SLOT_UUID16 || slot == ADV_SLOT_UUID128) ? (uuid_total[slot-ADV_SLOT_UUID16] > 0) : true;
+
+    switch ( p_layout->place[slot] )
+    {
+      case ADV_PLACE_ADV     : m_layout.adv      |= field; break;
+      case ADV_PLACE_SCAN_RSP: m_layout.scan_rsp |= field; break;
+      default                : if (is_wanted) m_layout.omitted |= field; break;
+    }
+  }
+
+  for(uint8_t idx=0; idx<2; idx++)
+  {
+    uint8_t const place   = p_layout->place[ADV_SLOT_UUID16+idx];
+    uint8_t const missing = uuid_total[idx] - ((place != ADV_PLACE_NONE) ? (p_layout->uuid_cnt[idx] + p_layout->uuid_spill[idx]) : 0);
+
+    if ( p_layout->uuid_spill[idx] )
+    {
+      m_layout.adv      |= slot_field[ADV_SLOT_UUID16+idx];
+      m_layout.scan_rsp |= slot_field[ADV_SLOT_UUID16+idx];
+    }
+    if ( missing && place != ADV_PLACE_NONE ) m_layout.truncated |= slot_field[ADV_SLOT_UUID16+idx];
+    m_layout.uuid_omitted += missing;
+  }
+
+  if      ( p_layout->name_len == 0 )                  m_layout.omitted      |= BTLE_ADV_FIELD_NAME;
+  else if ( p_layout->name_place == ADV_PLACE_ADV )    m_layout.adv          |= BTLE_ADV_FIELD_NAME;
+  else                                                 m_layout.scan_rsp     |= BTLE_ADV_FIELD_NAME;
+
+  if ( p_layout->name_len > 0 && p_layout->name_len < name_total ) m_layout.truncated |= BTLE_ADV_FIELD_NAME;
+
+  m_layout.adv_length      = p_layout->used[ADV_PLACE_ADV];
+  m_layout.scan_rsp_length = p_layout->used[ADV_PLACE_SCAN_RSP];
+
+#if CFG_DEBUG
+  if ( m_layout.omitted || m_layout.truncated )
+  {
+    printf("advertising: omitted 0x%02X, truncated 0x%02X, %d UUID(s) left out" CFG_PRINTF_NEWLINE,
+           m_layout.omitted, m_layout.truncated, m_layout.uuid_omitted);
+  }
+#endif
+}
+
+/**************************************************************************/
+/*!
+    @brief      Appends UUIDs to the complete or 'more available' list of
+                an advertising packet
+
+    @param[in]  p_advdata   Advertising packet to add to
+    @param[in]  list_uuids  Storage for the packet's two lists
+    @param[in]  is_complete Selects the complete list
+    @param[in]  uuids       UUIDs to add
+    @param[in]  count       Number of UUIDs to add
+*/
+/**************************************************************************/
+static void adv_uuid_append(ble_advdata_t * p_advdata, ble_uuid_t list_uuids[2][ADV_UUID_PER_PACKET],
+                            bool is_complete, ble_uuid_t const uuids[], uint8_t count)
+{
+  ble_advdata_uuid_list_t * const p_list = is_complete ? &p_advdata->uuids_complete : &p_advdata->uuids_more_available;
+
+  p_list->p_uuids = list_uuids[is_complete ? 0 : 1];
+  memcpy(&p_list->p_uuids[p_list->uuid_cnt], uuids, count*sizeof(ble_uuid_t));
+  p_list->uuid_cnt += count;
+}
@@ -0,0 +1,79 @@
+/**************************************************************************/
+/*!
+    @file     btle_beacon.h
+    @author   hathach (tinyusb.org)
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2014, K. Townsend (microBuilder.eu)
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+
+/** \ingroup TBD
+ *  \defgroup TBD
+ *  \brief TBD
+ *
+ *  @{
+ */
+
+#ifndef _BTLE_BEACON_H_
+#define _BTLE_BEACON_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include "common/common.h"
+
+typedef enum {
+  BTLE_BEACON_FRAME_IBEACON = 0, ///< Apple iBeacon: proximity UUID, major, minor & measured power
+  BTLE_BEACON_FRAME_NAME         ///< Local name & TX power, for generic scanners
+} btle_beacon_frame_type_t;
+
+/** One frame of the beacon rotation */
+typedef struct {
+  uint8_t         type;           ///< BTLE_BEACON_FRAME_xxx
+  uint8_t const * uuid;           ///< iBeacon proximity UUID, 16 bytes in the order they are sent
+  uint16_t        major;
+  uint16_t        minor;
+  int8_t          measured_power; ///< RSSI at 1 metre in dBm
+  uint16_t        duration_ms;    ///< time on air before rotating to the next frame
+} btle_beacon_frame_t;
+
+error_t  btle_beacon_init(btle_beacon_frame_t const frames[], uint8_t count);
+error_t  btle_beacon_start(void);
+error_t  btle_beacon_stop(void);
+uint16_t btle_beacon_interval_ms(void);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _BTLE_BEACON_H_ */
+
+/** @} */
@@ -0,0 +1,115 @@
+/**************************************************************************/
+/*!
+    @file     btle_clock.c
+    @author   hathach (tinyusb.org)
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2014, K. Townsend (microBuilder.eu)
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+
+/* ---------------------------------------------------------------------- */
+/* INCLUDE				                                                        */
+/* ---------------------------------------------------------------------- */
+#include "common/common.h"
+#include "boards/board.h"
+
+#include "btle_clock.h"
+
+/* ---------------------------------------------------------------------- */
+/* MACRO CONSTANT TYPEDEF                                                 */
+/* ---------------------------------------------------------------------- */
+#define CLOCK_CHECKPOINT_MS   (256*1000) /* half of the RTC wrap-around at prescaler 0 */
+
+/* ---------------------------------------------------------------------- */
+/* INTERNAL OBJECT & FUNCTION DECLARATION                                 */
+/* ---------------------------------------------------------------------- */
+static app_timer_id_t m_checkpoint_timer_id;
+static uint32_t       m_tick;       /* RTC ticks at the last update                  */
+static uint32_t       m_now_ms;     /* since btle_clock_init()                       */
+static uint32_t       m_remainder;  /* below 1 ms, in 1/APP_TIMER_CLOCK_FREQ ms      */
+
+static void clock_checkpoint_handler ( void * p_context );
+
+/* ---------------------------------------------------------------------- */
+/* IMPLEMENTATION											                                    */
+/* ---------------------------------------------------------------------- */
+
+/**************************************************************************/
+/*!
+    @brief      Starts the millisecond clock shared by advertising, the
+                timeline and the TX power statistics. The RTC behind
+                app_timer is only 24 bits wide, a checkpoint timer reads
+                it at least twice per wrap-around.
+
+    @returns
+*/
+/**************************************************************************/
+error_t btle_clock_init(void)
+{
+  (void) app_timer_cnt_get(&m_tick);
+
+  ASSERT_STATUS( app_timer_create(&m_checkpoint_timer_id, APP_TIMER_MODE_REPEATED, clock_checkpoint_handler) );
+  ASSERT_STATUS( app_timer_start(m_checkpoint_timer_id, APP_TIMER_TICKS(CLOCK_CHECKPOINT_MS, CFG_TIMER_PRESCALER), NULL) );
+
+  return ERROR_NONE;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Gets the time since btle_clock_init(). Durations are the
+                difference of two readings, which stays right across the
+                32-bit wrap-around (49 days). Must be called from the
+                priority of the BLE events and timers only.
+
+    @returns    ms since btle_clock_init()
+*/
+/**************************************************************************/
+uint32_t btle_clock_ms(void)
+{
+  uint32_t tick, diff;
+
+  (void) app_timer_cnt_get(&tick);
+  (void) app_timer_cnt_diff_compute(tick, m_tick, &diff);
+  m_tick = tick;
+
+  /* keep what is left below 1 ms, or every reading would lose up to a ms */
+  uint64_t const scaled = ((uint64_t) diff) * 1000 * (CFG_TIMER_PRESCALER+1) + m_remainder;
+
+  m_now_ms   += (uint32_t) (scaled / APP_TIMER_CLOCK_FREQ);
+  m_remainder = (uint32_t) (scaled % APP_TIMER_CLOCK_FREQ);
+
+  return m_now_ms;
+}
+
+static void clock_checkpoint_handler(void * p_context)
+{
+  (void) p_context;
+  (void) btle_clock_ms();
+}
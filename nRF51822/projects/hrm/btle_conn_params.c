@@ -0,0 +1,295 @@
+/**************************************************************************/
+/*!
+    @file     btle_conn_params.c
+    @author   hathach (tinyusb.org)
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2014, K. Townsend (microBuilder.eu)
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+
+/* ---------------------------------------------------------------------- */
+/* INCLUDE				                                                        */
+/* ---------------------------------------------------------------------- */
+#include "common/common.h"
+#include "boards/board.h"
+
+#include "btle.h"
+#include "btle_conn_params.h"
+#include "ble_bondmngr_cfg.h"
+
+/* ---------------------------------------------------------------------- */
+/* MACRO CONSTANT TYPEDEF                                                 */
+/* ---------------------------------------------------------------------- */
+#define MSEC_TO_1_25MSEC(ms)    ( ((ms)*4) / 5 )
+#define CONN_PARAMS_SET_NONE    0xFF
+
+/* ---------------------------------------------------------------------- */
+/* INTERNAL OBJECT & FUNCTION DECLARATION                                 */
+/* ---------------------------------------------------------------------- */
+/* Acceptable parameters, most wanted first */
+static ble_gap_conn_params_t const conn_params_sets[BTLE_CONN_PARAMS_SET_COUNT] =
+{
+  {
+      .min_conn_interval = MSEC_TO_1_25MSEC(CFG_GAP_CONNECTION_MIN_INTERVAL_MS)           , // in 1.25ms unit
+      .max_conn_interval = MSEC_TO_1_25MSEC(CFG_GAP_CONNECTION_MAX_INTERVAL_MS)           , // in 1.25ms unit
+      .slave_latency     = CFG_GAP_CONNECTION_SLAVE_LATENCY                               ,
+      .conn_sup_timeout  = CFG_GAP_CONNECTION_SUPERVISION_TIMEOUT_MS / 10                   // in 10ms unit
+  },
+  {
+      .min_conn_interval = MSEC_TO_1_25MSEC(CFG_GAP_CONNECTION_FALLBACK1_MIN_INTERVAL_MS) , // in 1.25ms unit
+      .max_conn_interval = MSEC_TO_1_25MSEC(CFG_GAP_CONNECTION_FALLBACK1_MAX_INTERVAL_MS) , // in 1.25ms unit
+      .slave_latency     = CFG_GAP_CONNECTION_FALLBACK1_SLAVE_LATENCY                     ,
+      .conn_sup_timeout  = CFG_GAP_CONNECTION_SUPERVISION_TIMEOUT_MS / 10                   // in 10ms unit
+  },
+  {
+      .min_conn_interval = MSEC_TO_1_25MSEC(CFG_GAP_CONNECTION_FALLBACK2_MIN_INTERVAL_MS) , // in 1.25ms unit
+      .max_conn_interval = MSEC_TO_1_25MSEC(CFG_GAP_CONNECTION_FALLBACK2_MAX_INTERVAL_MS) , // in 1.25ms unit
+      .slave_latency     = CFG_GAP_CONNECTION_FALLBACK2_SLAVE_LATENCY                     ,
+      .conn_sup_timeout  = CFG_GAP_CONNECTION_SUPERVISION_TIMEOUT_MS / 10                   // in 10ms unit
+  }
+};
+
+static app_timer_id_t           m_timer_id;
+static uint16_t                 m_conn_handle = BLE_CONN_HANDLE_INVALID;
+static ble_gap_conn_params_t    m_current;        /* parameters in use on the link       */
+static uint8_t                  m_set;            /* set being negotiated                */
+static uint8_t                  m_attempts;       /* requests made for m_set             */
+static bool                     m_is_settled;
+static int8_t                   m_central_handle; /* bond manager handle, -1 = not bonded */
+static btle_conn_params_stats_t m_stats;
+
+/* Set each bonded central settled on last time (RAM only, the bond manager has no room for it) */
+static uint8_t                  m_central_set[BLE_BONDMNGR_MAX_BONDED_CENTRALS];
+
+static void conn_params_timer_handler ( void * p_context );
+static bool conn_params_is_within     ( ble_gap_conn_params_t const * p_params, uint8_t set );
+static void conn_params_settle        ( void );
+
+/* ---------------------------------------------------------------------- */
+/* IMPLEMENTATION											                                    */
+/* ---------------------------------------------------------------------- */
+
+/**************************************************************************/
+/*!
+    @brief      Initialises the connection parameter negotiation, which
+                replaces ble_conn_params: a central that refuses our
+                parameters is offered the fallback sets in turn, and is
+                never disconnected for it.
+
+    @returns
+*/
+/**************************************************************************/
+error_t btle_conn_params_init(void)
+{
+  memset(m_central_set, CONN_PARAMS_SET_NONE, sizeof(m_central_set));
+
+  ASSERT_STATUS( app_timer_create(&m_timer_id, APP_TIMER_MODE_SINGLE_SHOT, conn_params_timer_handler) );
+
+  return ERROR_NONE;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Callback handler for GAP events
+*/
+/**************************************************************************/
+void btle_conn_params_handler(ble_evt_t * p_ble_evt)
+{
+  switch (p_ble_evt->header.evt_id)
+  {
+    case BLE_GAP_EVT_CONNECTED:
+      m_conn_handle    = p_ble_evt->evt.gap_evt.conn_handle;
+      m_current        = p_ble_evt->evt.gap_evt.params.connected.conn_params;
+      m_set            = 0;
+      m_attempts       = 0;
+      m_is_settled     = false;
+      m_central_handle = -1;
+
+      /* leave the central time for service discovery (and for the bond manager to recognise it) */
+      ASSERT_STATUS_RET_VOID( app_timer_start(m_timer_id, APP_TIMER_TICKS(CFG_GAP_CONNECTION_UPDATE_FIRST_DELAY_MS, CFG_TIMER_PRESCALER), NULL) );
+    break;
+
+    case BLE_GAP_EVT_DISCONNECTED:
+      (void) app_timer_stop(m_timer_id);
+      m_conn_handle = BLE_CONN_HANDLE_INVALID;
+    break;
+
+    case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+      m_current = p_ble_evt->evt.gap_evt.params.conn_param_update.conn_params;
+
+      /* anything else is judged when the timer runs out */
+      if ( !m_is_settled && conn_params_is_within(&m_current, m_set) ) conn_params_settle();
+    break;
+
+    default: break;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief      Callback handler for the bond manager events, a bonded
+                central starts from the set it settled on last time
+*/
+/**************************************************************************/
+void btle_conn_params_bond_handler(ble_bondmngr_evt_t * p_evt)
+{
+  switch ( p_evt->evt_type )
+  {
+    case BLE_BONDMNGR_EVT_NEW_BOND:
+    case BLE_BONDMNGR_EVT_CONN_TO_BONDED_CENTRAL:
+      if ( p_evt->central_handle < 0 || p_evt->central_handle >= BLE_BONDMNGR_MAX_BONDED_CENTRALS ) break;
+
+      m_central_handle = p_evt->central_handle;
+
+      if ( m_is_settled )
+      {
+        /* settled before the bond was known */
+        m_central_set[m_central_handle] = m_set;
+      }
+      else if ( m_attempts == 0 && m_central_set[m_central_handle] != CONN_PARAMS_SET_NONE )
+      {
+        m_set = m_central_set[m_central_handle];
+      }
+    break;
+
+    default: break;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief      Checks if the negotiation is over for this connection,
+                other modules should not request parameters before
+*/
+/**************************************************************************/
+bool btle_conn_params_is_settled(void)
+{
+  return m_is_settled;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Gets the negotiation counters since reset
+*/
+/**************************************************************************/
+btle_conn_params_stats_t const * btle_conn_params_stats(void)
+{
+  return &m_stats;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Runs after the first delay, then after every request. A
+                request the central did not follow by then counts as
+                rejected (S110 has no event for a refusal). After
+                CFG_GAP_CONNECTION_UPDATE_ATTEMPTS the next set is offered,
+                after the last one the link is kept as it is.
+*/
+/**************************************************************************/
+static void conn_params_timer_handler(void * p_context)
+{
+  (void) p_context;
+
+  if ( m_is_settled || m_conn_handle == BLE_CONN_HANDLE_INVALID ) return;
+
+  if ( conn_params_is_within(&m_current, m_set) )
+  {
+    conn_params_settle();
+    return;
+  }
+
+  if ( m_attempts > 0 ) m_stats.rejected++;
+
+  if ( m_attempts >= CFG_GAP_CONNECTION_UPDATE_ATTEMPTS )
+  {
+    m_set++;
+    m_attempts = 0;
+
+    if ( m_set == BTLE_CONN_PARAMS_SET_COUNT )
+    {
+      m_set        = BTLE_CONN_PARAMS_SET_COUNT-1;
+      m_is_settled = true;
+      m_stats.given_up++;
+      return;
+    }
+
+    /* a wider set may already be met */
+    if ( conn_params_is_within(&m_current, m_set) )
+    {
+      conn_params_settle();
+      return;
+    }
+  }
+
+  uint32_t const err = sd_ble_gap_conn_param_update(m_conn_handle, &conn_params_sets[m_set]);
+
+  if ( err == NRF_SUCCESS )
+  {
+    m_attempts++;
+    m_stats.requested++;
+  }
+  else if ( err != NRF_ERROR_BUSY )
+  {
+    ASSERT_STATUS_RET_VOID( err );
+  }
+  /* busy: a procedure is already running, try again at the next timeout */
+
+  ASSERT_STATUS_RET_VOID( app_timer_start(m_timer_id, APP_TIMER_TICKS(CFG_GAP_CONNECTION_UPDATE_NEXT_DELAY_MS, CFG_TIMER_PRESCALER), NULL) );
+}
+
+/**************************************************************************/
+/*!
+    @brief      Checks if the link parameters are acceptable for a set
+*/
+/**************************************************************************/
+static bool conn_params_is_within(ble_gap_conn_params_t const * p_params, uint8_t set)
+{
+  ble_gap_conn_params_t const * p_set = &conn_params_sets[set];
+
+  return ( p_params->max_conn_interval >= p_set->min_conn_interval ) &&
+         ( p_params->max_conn_interval <= p_set->max_conn_interval ) &&
+         ( p_params->slave_latency     <= p_set->slave_latency     );
+}
+
+/**************************************************************************/
+/*!
+    @brief      Ends the negotiation with the current set, remembered for
+                the next connection of a bonded central
+*/
+/**************************************************************************/
+static void conn_params_settle(void)
+{
+  (void) app_timer_stop(m_timer_id);
+
+  m_is_settled = true;
+  m_stats.settled[m_set]++;
+
+  if ( m_central_handle >= 0 ) m_central_set[m_central_handle] = m_set;
+}
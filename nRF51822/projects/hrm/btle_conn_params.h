@@ -0,0 +1,78 @@
+/**************************************************************************/
+/*!
+    @file     btle_conn_params.h
+    @author   hathach (tinyusb.org)
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2014, K. Townsend (microBuilder.eu)
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+
+/** \ingroup TBD
+ *  \defgroup TBD
+ *  \brief TBD
+ *
+ *  @{
+ */
+
+#ifndef _BTLE_CONN_PARAMS_H_
+#define _BTLE_CONN_PARAMS_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include "common/common.h"
+#include "ble.h"
+#include "ble_bondmngr.h"
+
+enum {
+  BTLE_CONN_PARAMS_SET_COUNT = 3  ///< CFG_GAP_CONNECTION_xxx, then the two CFG_GAP_CONNECTION_FALLBACKn_xxx
+};
+
+typedef struct {
+  uint16_t requested;                               ///< update requests sent to the central
+  uint16_t rejected;                                ///< requests the central ignored or answered with other parameters
+  uint16_t settled[BTLE_CONN_PARAMS_SET_COUNT];     ///< connections that ended up within each set
+  uint16_t given_up;                                ///< connections kept with whatever the central chose
+} btle_conn_params_stats_t;
+
+error_t btle_conn_params_init         ( void );
+void    btle_conn_params_handler      ( ble_evt_t * p_ble_evt );
+void    btle_conn_params_bond_handler ( ble_bondmngr_evt_t * p_evt );
+bool    btle_conn_params_is_settled   ( void );
+btle_conn_params_stats_t const * btle_conn_params_stats ( void );
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _BTLE_CONN_PARAMS_H_ */
+
+/** @} */
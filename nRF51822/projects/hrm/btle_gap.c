@@ -41,7 +41,7 @@
 #include "boards/board.h"
 
 #include "ble_gap.h"
-#include "ble_conn_params.h"
+#include "btle_conn_params.h"
 
 /* ---------------------------------------------------------------------- */
 /* MACRO CONSTANT TYPEDEF                                                 */
@@ -51,7 +51,6 @@
 /* INTERNAL OBJECT & FUNCTION DECLARATION                                 */
 /* ---------------------------------------------------------------------- */
 static inline uint32_t msec_to_1_25msec(uint32_t interval_ms) ATTR_ALWAYS_INLINE ATTR_CONST;
-static void error_callback(uint32_t nrf_error);
 
 /* ---------------------------------------------------------------------- */
 /* IMPLEMENTATION											                                    */
@@ -82,26 +81,8 @@ error_t btle_gap_init(void)
   ASSERT_STATUS( sd_ble_gap_ppcp_set(&gap_conn_params) );
   ASSERT_STATUS( sd_ble_gap_tx_power_set(CFG_BLE_TX_POWER_LEVEL) );
 
-  /*------------- Connection Parameter -------------*/
-  enum {
-    FIRST_UPDATE_DELAY = APP_TIMER_TICKS(5000, CFG_TIMER_PRESCALER),
-    NEXT_UPDATE_DELAY  = APP_TIMER_TICKS(5000, CFG_TIMER_PRESCALER),
-    MAX_UPDATE_COUNT   = 3
-  };
-
-  ble_conn_params_init_t cp_init =
-  {
-      .p_conn_params                  = NULL                    ,
-      .first_conn_params_update_delay = FIRST_UPDATE_DELAY      ,
-      .next_conn_params_update_delay  = NEXT_UPDATE_DELAY       ,
-      .max_conn_params_update_count   = MAX_UPDATE_COUNT        ,
-      .start_on_notify_cccd_handle    = BLE_GATT_HANDLE_INVALID ,
-      .disconnect_on_fail             = true                    ,
-      .evt_handler                    = NULL                    ,
-      .error_handler                  = error_callback
-  };
-
-  ASSERT_STATUS ( ble_conn_params_init(&cp_init) );
+  /* Negotiated after connecting, with fallback sets instead of a disconnect */
+  ASSERT_STATUS( btle_conn_params_init() );
 
   return ERROR_NONE;
 }
@@ -120,8 +101,3 @@ static inline uint32_t msec_to_1_25msec(uint32_t interval_ms)
 {
   return (interval_ms * 4) / 5 ;
 }
-
-static void error_callback(uint32_t nrf_error)
-{
-  ASSERT_STATUS_RET_VOID( nrf_error );
-}
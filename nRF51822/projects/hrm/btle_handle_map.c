@@ -0,0 +1,176 @@
+/**************************************************************************/
+/*!
+    @file     btle_handle_map.c
+    @author   hathach (tinyusb.org)
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2014, K. Townsend (microBuilder.eu)
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+
+/* ---------------------------------------------------------------------- */
+/* INCLUDE				                                                        */
+/* ---------------------------------------------------------------------- */
+#include "common/common.h"
+
+#include "btle.h"
+#include "btle_handle_map.h"
+
+/* ---------------------------------------------------------------------- */
+/* MACRO CONSTANT TYPEDEF                                                 */
+/* ---------------------------------------------------------------------- */
+#define HANDLE_MAP_NONE   0 /* slots hold the characteristic index + 1 */
+
+typedef struct {
+  btle_handle_map_cb_t callback;
+  void *               p_context;
+} handle_map_char_t;
+
+/* ---------------------------------------------------------------------- */
+/* INTERNAL OBJECT & FUNCTION DECLARATION                                 */
+/* ---------------------------------------------------------------------- */
+/* The SoftDevice hands out handles in increasing order as attributes are
+ * added, so the registered characteristics form one contiguous range that
+ * can be indexed directly from the first one */
+static uint16_t          m_first_handle = BLE_GATT_HANDLE_INVALID;
+static uint8_t           m_slot[CFG_BLE_HANDLE_MAP_SIZE];
+static handle_map_char_t m_chars[CFG_BLE_HANDLE_MAP_CHARS];
+static uint8_t           m_char_count = 0;
+
+static error_t handle_map_set ( uint16_t handle, uint8_t slot );
+
+/* ---------------------------------------------------------------------- */
+/* IMPLEMENTATION											                                    */
+/* ---------------------------------------------------------------------- */
+
+/**************************************************************************/
+/*!
+    @brief      Registers the callback of a characteristic, right after it
+                was added to the SoftDevice. Every handle it was given
+                (value, user description, CCCD, SCCD) maps to the callback.
+
+    @param[in]  p_handles   Handles returned by sd_ble_gatts_characteristic_add()
+    @param[in]  callback    Called by btle_handle_map_dispatch()
+    @param[in]  p_context   Passed back to the callback
+
+    @returns
+    @retval     ERROR_NONE              Everything executed normally
+    @retval     ERROR_NO_MEM            CFG_BLE_HANDLE_MAP_CHARS or
+                                        CFG_BLE_HANDLE_MAP_SIZE is too small
+    @retval     ERROR_INVALIDPARAMETER  Characteristics were not registered
+                                        in the order they were added
+*/
+/**************************************************************************/
+error_t btle_handle_map_add(ble_gatts_char_handles_t const * p_handles, btle_handle_map_cb_t callback, void * p_context)
+{
+  ASSERT( callback != NULL, ERROR_INVALIDPARAMETER );
+  ASSERT( m_char_count < CFG_BLE_HANDLE_MAP_CHARS, ERROR_NO_MEM );
+
+  /* the range starts at the first characteristic's value */
+  if ( m_first_handle == BLE_GATT_HANDLE_INVALID ) m_first_handle = p_handles->value_handle;
+
+  uint8_t const slot = m_char_count + 1;
+
+  ASSERT_STATUS( handle_map_set(p_handles->value_handle    , slot) );
+  ASSERT_STATUS( handle_map_set(p_handles->user_desc_handle, slot) );
+  ASSERT_STATUS( handle_map_set(p_handles->cccd_handle     , slot) );
+  ASSERT_STATUS( handle_map_set(p_handles->sccd_handle     , slot) );
+
+  m_chars[m_char_count].callback  = callback;
+  m_chars[m_char_count].p_context = p_context;
+  m_char_count++;
+
+  return ERROR_NONE;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Passes a GATTS write, HVC or read/write authorize request
+                event straight to the callback of the characteristic that
+                owns the handle, must be called with every event from the
+                SoftDevice
+
+    @param[in]  p_ble_evt
+
+    @returns    true if a callback took the event
+*/
+/**************************************************************************/
+bool btle_handle_map_dispatch(ble_evt_t * p_ble_evt)
+{
+  ble_gatts_evt_t const * p_gatts_evt = &p_ble_evt->evt.gatts_evt;
+  uint16_t handle;
+
+  switch ( p_ble_evt->header.evt_id )
+  {
+    case BLE_GATTS_EVT_WRITE:
+      handle = p_gatts_evt->params.write.handle;
+    break;
+
+    case BLE_GATTS_EVT_HVC:
+      handle = p_gatts_evt->params.hvc.handle;
+    break;
+
+    case BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST:
+      handle = ( p_gatts_evt->params.authorize_request.type == BLE_GATTS_AUTHORIZE_TYPE_READ ) ?
+                 p_gatts_evt->params.authorize_request.request.read.handle :
+                 p_gatts_evt->params.authorize_request.request.write.handle;
+    break;
+
+    default: return false;
+  }
+
+  /* unsigned, handles below the range wrap around to a large index */
+  uint16_t const index = handle - m_first_handle;
+  if ( m_first_handle == BLE_GATT_HANDLE_INVALID || index >= CFG_BLE_HANDLE_MAP_SIZE ) return false;
+
+  uint8_t const slot = m_slot[index];
+  if ( slot == HANDLE_MAP_NONE ) return false;
+
+  m_chars[slot-1].callback(p_ble_evt, handle, m_chars[slot-1].p_context);
+
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Points a handle's entry at a characteristic, unused handles
+                (BLE_GATT_HANDLE_INVALID) are skipped
+*/
+/**************************************************************************/
+static error_t handle_map_set(uint16_t handle, uint8_t slot)
+{
+  if ( handle == BLE_GATT_HANDLE_INVALID ) return ERROR_NONE;
+
+  ASSERT( handle >= m_first_handle, ERROR_INVALIDPARAMETER );
+  ASSERT( handle - m_first_handle < CFG_BLE_HANDLE_MAP_SIZE, ERROR_NO_MEM );
+
+  m_slot[handle - m_first_handle] = slot;
+
+  return ERROR_NONE;
+}
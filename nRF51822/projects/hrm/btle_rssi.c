@@ -0,0 +1,345 @@
+/**************************************************************************/
+/*!
+    @file     btle_rssi.c
+    @author   hathach (tinyusb.org)
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2014, K. Townsend (microBuilder.eu)
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+
+/* ---------------------------------------------------------------------- */
+/* INCLUDE				                                                        */
+/* ---------------------------------------------------------------------- */
+#include "common/common.h"
+#include "boards/board.h"
+
+#include "btle.h"
+#include "btle_rssi.h"
+#include "btle_tx_power.h"
+#include "custom_helper.h"
+#include "btle_handle_map.h"
+#include "ble_srv_common.h"
+
+/* ---------------------------------------------------------------------- */
+/* MACRO CONSTANT TYPEDEF                                                 */
+/* ---------------------------------------------------------------------- */
+/* The filter state is kept in Q8 (1/256 dBm), alpha = 1/2^CFG_BLE_RSSI_EWMA_SHIFT */
+#define RSSI_Q8(dbm)        ( ((int32_t) (dbm)) * 256 )
+#define RSSI_EWMA_DIV       ( 1 << CFG_BLE_RSSI_EWMA_SHIFT )
+
+/* ---------------------------------------------------------------------- */
+/* INTERNAL OBJECT & FUNCTION DECLARATION                                 */
+/* ---------------------------------------------------------------------- */
+static uint16_t          m_conn_handle = BLE_CONN_HANDLE_INVALID;
+static int32_t           m_mean_q8;
+static uint32_t          m_variance_q8;
+static btle_rssi_stats_t m_stats;
+
+#if CFG_BLE_RSSI_SERVICE
+static uint16_t                 m_service_handle;
+static ble_gatts_char_handles_t m_stats_handles;
+static ble_gatts_char_handles_t m_peer_handles;
+static uint8_t                  m_stats_value[BLE_RSSI_STATS_LENGTH]; /* read by the SoftDevice in place */
+static ble_uuid128_t const      m_uuid_base = CUSTOM_UUID128_LE(BLE_RSSI_UUID_BASE);
+static uint32_t                 m_notify_tick;
+static bool                     m_has_notified;
+
+static void rssi_stats_report ( void );
+static void rssi_peer_write   ( ble_evt_t * p_ble_evt, uint16_t handle, void * p_context );
+
+#if CFG_BLE_TX_POWER_CTRL
+static ble_gatts_char_handles_t m_tx_power_handles;
+
+static uint16_t rssi_tx_power_read ( uint8_t * p_value, uint16_t max_length );
+#endif
+#endif
+
+static void rssi_sample ( int8_t rssi );
+
+/* ---------------------------------------------------------------------- */
+/* IMPLEMENTATION											                                    */
+/* ---------------------------------------------------------------------- */
+
+/**************************************************************************/
+/*!
+    @brief      Initialises the link quality monitor, and adds the link
+                quality service when CFG_BLE_RSSI_SERVICE is set. The
+                service is not part of the service list on purpose, it
+                would take advertising space from the real services.
+
+    @returns
+    @retval     ERROR_NONE        Everything executed normally.
+*/
+/**************************************************************************/
+error_t btle_rssi_init(void)
+{
+  memclr_(&m_stats, sizeof(btle_rssi_stats_t));
+
+#if CFG_BLE_RSSI_SERVICE
+  uint8_t const uuid_type = custom_add_uuid128(&m_uuid_base);
+  ASSERT( uuid_type >= BLE_UUID_TYPE_VENDOR_BEGIN, ERROR_INVALIDPARAMETER );
+
+  ble_uuid_t ble_uuid =
+  {
+     .type = uuid_type,
+     .uuid = BLE_RSSI_UUID_PRIMARY_SERVICE
+  };
+  ASSERT_STATUS( sd_ble_gatts_service_add(BLE_GATTS_SRVC_TYPE_PRIMARY, &ble_uuid, &m_service_handle) );
+
+  /* Updated on every RSSI sample, in application RAM so that updates are not copied into the stack */
+  ble_uuid.uuid = BLE_RSSI_UUID_STATS;
+  ASSERT_STATUS( custom_add_user_characteristic(m_service_handle,
+                                                &ble_uuid, (ble_gatt_char_props_t) { .read = 1, .notify = 1 },
+                                                m_stats_value, BLE_RSSI_STATS_LENGTH, BLE_RSSI_STATS_LENGTH,
+                                                &m_stats_handles) );
+
+  /* Centrals that can read their own RSSI write it back here (e.g. for TX power control) */
+  ble_uuid.uuid = BLE_RSSI_UUID_PEER;
+  ASSERT_STATUS( custom_add_in_characteristic(m_service_handle,
+                                              &ble_uuid, (ble_gatt_char_props_t) { .write = 1 },
+                                              NULL, 1, 1,
+                                              &m_peer_handles) );
+  ASSERT_STATUS( btle_handle_map_add(&m_peer_handles, rssi_peer_write, NULL) );
+
+  #if CFG_BLE_TX_POWER_CTRL
+  /* Keeps growing while connected, so it is only worked out when read. The
+   * level steps at most once per period, a step drops the served value */
+  ble_uuid.uuid = BLE_RSSI_UUID_TX_POWER;
+  ASSERT_STATUS( custom_add_lazy_characteristic(m_service_handle,
+                                                &ble_uuid, (ble_gatt_char_props_t) { .read = 1 },
+                                                BLE_RSSI_TX_POWER_LENGTH, rssi_tx_power_read, CFG_BLE_TX_POWER_CTRL_PERIOD_MS,
+                                                &m_tx_power_handles) );
+  #endif
+#endif
+
+  return ERROR_NONE;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Callback handler for GAP events. RSSI reporting is started
+                on every connection, the statistics restart with it.
+*/
+/**************************************************************************/
+void btle_rssi_handler(ble_evt_t * p_ble_evt)
+{
+  switch (p_ble_evt->header.evt_id)
+  {
+    case BLE_GAP_EVT_CONNECTED:
+      m_conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+      memclr_(&m_stats, sizeof(btle_rssi_stats_t));
+#if CFG_BLE_RSSI_SERVICE
+      m_has_notified = false;
+#endif
+
+      ASSERT_STATUS_RET_VOID( sd_ble_gap_rssi_start(m_conn_handle) );
+    break;
+
+    case BLE_GAP_EVT_DISCONNECTED:
+      /* the SoftDevice stops reporting by itself, the last statistics are kept */
+      m_conn_handle = BLE_CONN_HANDLE_INVALID;
+    break;
+
+    case BLE_GAP_EVT_RSSI_CHANGED:
+      rssi_sample( p_ble_evt->evt.gap_evt.params.rssi_changed.rssi );
+#if CFG_BLE_RSSI_SERVICE
+      rssi_stats_report();
+#endif
+    break;
+
+    default: break;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief      Checks if there is at least one sample since the last
+                connection was made
+*/
+/**************************************************************************/
+bool btle_rssi_is_valid(void)
+{
+  return m_stats.samples > 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Gets the RSSI statistics of the current (or last) connection
+*/
+/**************************************************************************/
+btle_rssi_stats_t const * btle_rssi_stats(void)
+{
+  return &m_stats;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Adds a sample to the exponentially weighted average and
+                variance (West's incremental form), and to min/max.
+
+                  diff      = x - mean
+                  mean     += alpha * diff
+                  variance  = (1 - alpha) * (variance + diff * alpha * diff)
+*/
+/**************************************************************************/
+static void rssi_sample(int8_t rssi)
+{
+  if ( m_stats.samples == 0 )
+  {
+    m_mean_q8     = RSSI_Q8(rssi);
+    m_variance_q8 = 0;
+    m_stats.min   = rssi;
+    m_stats.max   = rssi;
+  }
+  else
+  {
+    int32_t const diff_q8 = RSSI_Q8(rssi) - m_mean_q8;
+    int32_t const incr_q8 = diff_q8 / RSSI_EWMA_DIV;
+
+    m_mean_q8     += incr_q8;
+    m_variance_q8 += (uint32_t) ((diff_q8 * incr_q8) / 256); /* same sign, never negative */
+    m_variance_q8 -= m_variance_q8 / RSSI_EWMA_DIV;
+
+    if ( rssi < m_stats.min ) m_stats.min = rssi;
+    if ( rssi > m_stats.max ) m_stats.max = rssi;
+  }
+
+  m_stats.last        = rssi;
+  m_stats.average     = (int8_t) ((m_mean_q8 + (m_mean_q8 < 0 ? -128 : 128)) / 256);
+  m_stats.variance_q4 = (uint16_t) min32_of(m_variance_q8 / 16, UINT16_MAX);
+  if ( m_stats.samples < UINT16_MAX ) m_stats.samples++;
+}
+
+#if CFG_BLE_RSSI_SERVICE
+/**************************************************************************/
+/*!
+    @brief      Updates the statistics characteristic and notifies it, at
+                most once per CFG_BLE_RSSI_NOTIFY_MIN_MS. The SoftDevice
+                can report a change every connection event, which would
+                otherwise eat all the TX buffers.
+
+                The value lives in m_stats_value (BLE_GATTS_VLOC_USER),
+                so it is written in place. This runs from the BLE event
+                handler, which the SoftDevice does not preempt to serve
+                a read.
+*/
+/**************************************************************************/
+static void rssi_stats_report(void)
+{
+  uint16_t length = BLE_RSSI_STATS_LENGTH;
+
+  m_stats_value[0] = (uint8_t) m_stats.last;
+  m_stats_value[1] = (uint8_t) m_stats.average;
+  m_stats_value[2] = (uint8_t) m_stats.min;
+  m_stats_value[3] = (uint8_t) m_stats.max;
+  (void) uint16_encode(m_stats.variance_q4, &m_stats_value[4]);
+  (void) uint16_encode(m_stats.samples    , &m_stats_value[6]);
+
+  /* The RTC wraps every 512 s (prescaler 0), a long quiet link may wait one more period */
+  uint32_t tick, diff;
+  (void) app_timer_cnt_get(&tick);
+  (void) app_timer_cnt_diff_compute(tick, m_notify_tick, &diff);
+
+  if ( m_has_notified && diff < APP_TIMER_TICKS(CFG_BLE_RSSI_NOTIFY_MIN_MS, CFG_TIMER_PRESCALER) ) return;
+
+  ble_gatts_hvx_params_t hvx_params =
+  {
+      .handle = m_stats_handles.value_handle,
+      .type   = BLE_GATT_HVX_NOTIFICATION,
+      .p_data = NULL, /* the value just written */
+      .p_len  = &length,
+  };
+
+  uint32_t const err = sd_ble_gatts_hvx(m_conn_handle, &hvx_params);
+
+  /* not subscribed (yet) or no buffers left: the value can still be read */
+  if ( (err != NRF_SUCCESS                    ) &&
+       (err != NRF_ERROR_INVALID_STATE        ) &&
+       (err != BLE_ERROR_NO_TX_BUFFERS        ) &&
+       (err != BLE_ERROR_GATTS_SYS_ATTR_MISSING) )
+  {
+    ASSERT_STATUS_RET_VOID( err );
+  }
+
+  m_notify_tick  = tick;
+  m_has_notified = true;
+}
+
+/**************************************************************************/
+/*!
+    @brief      The central wrote its own RSSI to the peer characteristic
+                (called by btle_handle_map_dispatch)
+*/
+/**************************************************************************/
+static void rssi_peer_write(ble_evt_t * p_ble_evt, uint16_t handle, void * p_context)
+{
+  (void) p_context;
+  ble_gatts_evt_write_t const * p_write = &p_ble_evt->evt.gatts_evt.params.write;
+
+  if ( p_ble_evt->header.evt_id == BLE_GATTS_EVT_WRITE && handle == m_peer_handles.value_handle && p_write->len == 1 )
+  {
+    m_stats.peer = (int8_t) p_write->data[0];
+    if ( m_stats.peer_reports < UINT16_MAX ) m_stats.peer_reports++;
+  }
+}
+
+#if CFG_BLE_TX_POWER_CTRL
+/**************************************************************************/
+/*!
+    @brief      Computes the TX power characteristic when a central reads
+                it (see custom_add_lazy_characteristic)
+*/
+/**************************************************************************/
+static uint16_t rssi_tx_power_read(uint8_t * p_value, uint16_t max_length)
+{
+  (void) max_length; /* always BLE_RSSI_TX_POWER_LENGTH */
+
+  btle_tx_power_stats_t const * p_stats = btle_tx_power_stats();
+
+  for(uint8_t i=0; i<BTLE_TX_POWER_LEVEL_COUNT; i++)
+  {
+    (void) uint32_encode(p_stats->level_ms[i], &p_value[4*i]);
+  }
+
+  return BLE_RSSI_TX_POWER_LENGTH;
+}
+
+/**************************************************************************/
+/*!
+    @brief      The TX power stepped to another level, the next read
+                computes the value again (called by btle_tx_power)
+*/
+/**************************************************************************/
+void btle_rssi_tx_power_changed(void)
+{
+  custom_lazy_invalidate(&m_tx_power_handles);
+}
+#endif
+#endif
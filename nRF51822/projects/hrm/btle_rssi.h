@@ -0,0 +1,109 @@
+/**************************************************************************/
+/*!
+    @file     btle_rssi.h
+    @author   hathach (tinyusb.org)
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2014, K. Townsend (microBuilder.eu)
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+
+/** \ingroup TBD
+ *  \defgroup TBD
+ *  \brief TBD
+ *
+ *  @{
+ */
+
+#ifndef _BTLE_RSSI_H_
+#define _BTLE_RSSI_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include "common/common.h"
+#include "ble.h"
+
+/*=========================================================================
+    LINK QUALITY SERVICE
+    -----------------------------------------------------------------------
+    BLE_RSSI_UUID_BASE            The base 128-bit UUID of the service
+    BLE_RSSI_UUID_PRIMARY_SERVICE The UUID fragment for the primary service
+    BLE_RSSI_UUID_STATS           The UUID fragment for the statistics char,
+                                  read & notify, 8 bytes little endian:
+                                  last, average, min, max (int8 in dBm),
+                                  variance (uint16 in 1/16 dBm^2),
+                                  samples (uint16)
+    BLE_RSSI_UUID_PEER            The UUID fragment for the peer RSSI char,
+                                  write only, int8 in dBm: the RSSI of this
+                                  device as seen by the central
+    BLE_RSSI_UUID_TX_POWER        The UUID fragment for the TX power char
+                                  (CFG_BLE_TX_POWER_CTRL only), read only,
+                                  32 bytes: ms connected at each level from
+                                  -40 to +4 dBm (uint32 little endian)
+    -----------------------------------------------------------------------*/
+    #define BLE_RSSI_UUID_BASE              "\xB1\xE5\x00\x00\x2C\x1F\x4A\x55\x9E\x6B\x8D\x0E\x3A\x7C\x51\x12"
+    #define BLE_RSSI_UUID_PRIMARY_SERVICE   (1)
+    #define BLE_RSSI_UUID_STATS             (2)
+    #define BLE_RSSI_UUID_PEER              (3)
+    #define BLE_RSSI_UUID_TX_POWER          (4)
+    #define BLE_RSSI_STATS_LENGTH           (8)
+    #define BLE_RSSI_TX_POWER_LENGTH        (32)
+/*=========================================================================*/
+
+typedef struct {
+  int8_t   last;          ///< latest sample in dBm
+  int8_t   average;       ///< exponentially weighted average in dBm
+  int8_t   min;
+  int8_t   max;
+  uint16_t variance_q4;   ///< exponentially weighted variance in 1/16 dBm^2
+  uint16_t samples;       ///< samples since the connection was made (saturates)
+  int8_t   peer;          ///< latest RSSI reported by the central in dBm
+  uint16_t peer_reports;  ///< reports from the central since the connection was made
+} btle_rssi_stats_t;
+
+error_t btle_rssi_init    ( void );
+void    btle_rssi_handler ( ble_evt_t * p_ble_evt );
+bool    btle_rssi_is_valid( void );
+btle_rssi_stats_t const * btle_rssi_stats ( void );
+
+#if CFG_BLE_RSSI_SERVICE && CFG_BLE_TX_POWER_CTRL
+void    btle_rssi_tx_power_changed ( void );
+#else
+static inline void btle_rssi_tx_power_changed ( void ) { }
+#endif
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _BTLE_RSSI_H_ */
+
+/** @} */
@@ -0,0 +1,215 @@
+/**************************************************************************/
+/*!
+    @file     btle_timeline.c
+    @author   hathach (tinyusb.org)
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2014, K. Townsend (microBuilder.eu)
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+
+/* ---------------------------------------------------------------------- */
+/* INCLUDE				                                                        */
+/* ---------------------------------------------------------------------- */
+#include "common/common.h"
+#include "boards/board.h"
+
+#include "btle.h"
+#include "btle_clock.h"
+#include "btle_timeline.h"
+
+#if CFG_BLE_TIMELINE
+
+/* ---------------------------------------------------------------------- */
+/* MACRO CONSTANT TYPEDEF                                                 */
+/* ---------------------------------------------------------------------- */
+#define TIMELINE_NONE             UINT32_MAX
+
+/* ---------------------------------------------------------------------- */
+/* INTERNAL OBJECT & FUNCTION DECLARATION                                 */
+/* ---------------------------------------------------------------------- */
+static uint32_t              m_mark_ms[BTLE_TIMELINE_COUNT]; /* current round, clock ms     */
+static uint32_t              m_last_ms[BTLE_TIMELINE_COUNT]; /* last round, from ADV_START  */
+static btle_timeline_phase_t m_phase[BTLE_TIMELINE_COUNT];   /* ending at each milestone    */
+
+static void timeline_phase_add ( btle_timeline_phase_t * p_phase, uint32_t ms );
+
+/* ---------------------------------------------------------------------- */
+/* IMPLEMENTATION											                                    */
+/* ---------------------------------------------------------------------- */
+
+/**************************************************************************/
+/*!
+    @brief      Initialises the timeline, must be called before advertising
+                starts
+
+    @returns
+*/
+/**************************************************************************/
+error_t btle_timeline_init(void)
+{
+  for(uint8_t i=0; i<BTLE_TIMELINE_COUNT; i++)
+  {
+    m_mark_ms[i] = TIMELINE_NONE;
+    m_last_ms[i] = TIMELINE_NONE;
+  }
+
+  return ERROR_NONE;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Marks the milestones visible in the SoftDevice events, the
+                services and advertising mark the others themselves
+*/
+/**************************************************************************/
+void btle_timeline_handler(ble_evt_t * p_ble_evt)
+{
+  switch (p_ble_evt->header.evt_id)
+  {
+    case BLE_GAP_EVT_CONNECTED:
+      btle_timeline_mark(BTLE_TIMELINE_CONNECTED);
+    break;
+
+    case BLE_GAP_EVT_SEC_PARAMS_REQUEST:
+    case BLE_GAP_EVT_SEC_INFO_REQUEST:
+      btle_timeline_mark(BTLE_TIMELINE_SECURITY);
+    break;
+
+    case BLE_GAP_EVT_CONN_SEC_UPDATE:
+      btle_timeline_mark(BTLE_TIMELINE_ENCRYPTED);
+    break;
+
+    case BLE_GATTS_EVT_SYS_ATTR_MISSING:
+      /* answered by the bond manager within this same event */
+      btle_timeline_mark(BTLE_TIMELINE_SYS_ATTR);
+    break;
+
+    default: break;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief      Records a milestone, only the first one of each kind counts
+                until advertising restarts. The time since the previous
+                milestone reached goes into the histogram of this one.
+
+    @param[in]  milestone
+*/
+/**************************************************************************/
+void btle_timeline_mark(btle_timeline_milestone_t milestone)
+{
+  uint32_t const now_ms = btle_clock_ms();
+
+  if ( milestone == BTLE_TIMELINE_ADV_START )
+  {
+    /* keep the previous round for btle_timeline_last() */
+    if ( m_mark_ms[BTLE_TIMELINE_ADV_START] != TIMELINE_NONE )
+    {
+      for(uint8_t i=0; i<BTLE_TIMELINE_COUNT; i++)
+      {
+        m_last_ms[i] = (m_mark_ms[i] == TIMELINE_NONE) ? TIMELINE_NONE : (m_mark_ms[i] - m_mark_ms[BTLE_TIMELINE_ADV_START]);
+        m_mark_ms[i] = TIMELINE_NONE;
+      }
+    }
+
+    m_mark_ms[BTLE_TIMELINE_ADV_START] = now_ms;
+    return;
+  }
+
+  if ( m_mark_ms[milestone] != TIMELINE_NONE ) return;
+  m_mark_ms[milestone] = now_ms;
+
+  /* phase from the latest earlier milestone (nothing before = no phase) */
+  for(int8_t i = milestone-1; i >= 0; i--)
+  {
+    if ( m_mark_ms[i] != TIMELINE_NONE )
+    {
+      timeline_phase_add(&m_phase[milestone], now_ms - m_mark_ms[i]);
+      break;
+    }
+  }
+
+#if CFG_DEBUG
+  if ( milestone == BTLE_TIMELINE_FIRST_NOTIFY && m_mark_ms[BTLE_TIMELINE_ADV_START] != TIMELINE_NONE )
+  {
+    printf("timeline:");
+    for(uint8_t i=BTLE_TIMELINE_CONNECTED; i<BTLE_TIMELINE_COUNT; i++)
+    {
+      if ( m_mark_ms[i] != TIMELINE_NONE ) printf(" %u", (unsigned) (m_mark_ms[i] - m_mark_ms[BTLE_TIMELINE_ADV_START]));
+      else                                 printf(" -");
+    }
+    printf(" ms" CFG_PRINTF_NEWLINE);
+  }
+#endif
+}
+
+/**************************************************************************/
+/*!
+    @brief      Gets when a milestone was reached in the last complete
+                round (advertising start to the next advertising start)
+
+    @returns    ms since advertising started, UINT32_MAX if not reached
+*/
+/**************************************************************************/
+uint32_t btle_timeline_last(btle_timeline_milestone_t milestone)
+{
+  return m_last_ms[milestone];
+}
+
+/**************************************************************************/
+/*!
+    @brief      Gets the duration histogram of the phase ending at a
+                milestone, over all connections since reset
+*/
+/**************************************************************************/
+btle_timeline_phase_t const * btle_timeline_phase(btle_timeline_milestone_t milestone)
+{
+  return &m_phase[milestone];
+}
+
+/**************************************************************************/
+/*!
+    @brief      Adds a duration to a phase histogram (log2 bins)
+*/
+/**************************************************************************/
+static void timeline_phase_add(btle_timeline_phase_t * p_phase, uint32_t ms)
+{
+  uint8_t bin = 0;
+  while ( (bin < BTLE_TIMELINE_BIN_COUNT-1) && (ms >= (16UL << bin)) ) bin++;
+
+  if ( p_phase->bins[bin] < UINT16_MAX ) p_phase->bins[bin]++;
+  if ( p_phase->count     < UINT16_MAX ) p_phase->count++;
+
+  p_phase->total_ms += ms;
+  p_phase->max_ms    = max32_of(p_phase->max_ms, ms);
+}
+
+#endif /* CFG_BLE_TIMELINE */
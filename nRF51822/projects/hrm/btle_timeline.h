@@ -0,0 +1,96 @@
+/**************************************************************************/
+/*!
+    @file     btle_timeline.h
+    @author   hathach (tinyusb.org)
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2014, K. Townsend (microBuilder.eu)
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+
+/** \ingroup TBD
+ *  \defgroup TBD
+ *  \brief TBD
+ *
+ *  @{
+ */
+
+#ifndef _BTLE_TIMELINE_H_
+#define _BTLE_TIMELINE_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include "common/common.h"
+#include "ble.h"
+
+/* Milestones from (re)starting advertising to the first notification, in
+ * the order they normally happen. Security is skipped by centrals that do
+ * not pair, so a phase always runs from the previous milestone reached. */
+typedef enum {
+  BTLE_TIMELINE_ADV_START = 0,  ///< advertising (re)started, origin of the timeline
+  BTLE_TIMELINE_CONNECTED,      ///< BLE_GAP_EVT_CONNECTED
+  BTLE_TIMELINE_SECURITY,       ///< pairing (SEC_PARAMS) or bonded encryption (SEC_INFO) requested
+  BTLE_TIMELINE_ENCRYPTED,      ///< BLE_GAP_EVT_CONN_SEC_UPDATE
+  BTLE_TIMELINE_SYS_ATTR,       ///< system attributes (CCCDs) set for the connection
+  BTLE_TIMELINE_CCCD_ENABLED,   ///< the central subscribed to a service
+  BTLE_TIMELINE_FIRST_NOTIFY,   ///< first notification/indication queued
+  BTLE_TIMELINE_COUNT
+} btle_timeline_milestone_t;
+
+enum {
+  BTLE_TIMELINE_BIN_COUNT = 10  ///< bin n counts phases under 16 << n ms, the last one everything above
+};
+
+typedef struct {
+  uint16_t count;
+  uint32_t total_ms;
+  uint32_t max_ms;
+  uint16_t bins[BTLE_TIMELINE_BIN_COUNT];
+} btle_timeline_phase_t;
+
+#if CFG_BLE_TIMELINE
+error_t  btle_timeline_init    ( void );
+void     btle_timeline_handler ( ble_evt_t * p_ble_evt );
+void     btle_timeline_mark    ( btle_timeline_milestone_t milestone );
+uint32_t btle_timeline_last    ( btle_timeline_milestone_t milestone );
+btle_timeline_phase_t const * btle_timeline_phase ( btle_timeline_milestone_t milestone );
+#else
+/* Services & advertising mark their milestones unconditionally */
+static inline void btle_timeline_mark ( btle_timeline_milestone_t milestone ) { (void) milestone; }
+#endif
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _BTLE_TIMELINE_H_ */
+
+/** @} */
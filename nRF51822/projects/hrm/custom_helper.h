@@ -13,12 +13,75 @@
 #include "common/common.h"
 #include "ble.h"
 
+enum {
+  CUSTOM_UUID_BASE_MAX  = 10, ///< distinct 128-bit bases the registry keeps, the SoftDevice may have fewer slots
+  CUSTOM_LAZY_CHAR_MAX  = 4 , ///< characteristics added with custom_add_lazy_characteristic()
+  CUSTOM_LAZY_VALUE_MAX = 32  ///< largest lazy value, computed into a stack buffer
+};
+
+/** Computes the value of a lazy characteristic when a central reads it
+ *
+ *  @param[out] p_value     Buffer for the value, max_length bytes
+ *  @param[in]  max_length  As given to custom_add_lazy_characteristic()
+ *
+ *  @returns    The length of the value
+ */
+typedef uint16_t (*custom_read_handler_t)(uint8_t * p_value, uint16_t max_length);
+
+/** ble_uuid128_t (little endian) from a base UUID string literal written in
+ *  the usual order, e.g. CFG_BLE_UART_UUID_BASE: the bytes are reversed by
+ *  the compiler instead of at run time */
+#define CUSTOM_UUID128_LE(base) \
+  { { (base)[15], (base)[14], (base)[13], (base)[12], (base)[11], (base)[10], (base)[9], (base)[8], \
+      (base)[7] , (base)[6] , (base)[5] , (base)[4] , (base)[3] , (base)[2] , (base)[1], (base)[0] } }
+
+/** A characteristic of a declarative GATT table (see tools/gatt_compile.py) */
+typedef struct {
+  uint16_t              uuid16;       ///< 16-bit UUID, or bytes 2-3 of a 128-bit UUID
+  uint8_t               uuid_base;    ///< 0 = Bluetooth SIG, n = n-th entry of uuid_bases
+  ble_gatt_char_props_t props;
+  uint8_t const *       p_value;      ///< initial value, init_len bytes
+  uint8_t *             p_user_value; ///< application RAM holding the value (BLE_GATTS_VLOC_USER), NULL = stack memory
+  uint16_t              init_len;
+  uint16_t              max_len;      ///< variable length if different from init_len
+  uint16_t              value_offset; ///< value handle minus the table's first handle
+} custom_gatt_char_t;
+
+/** A primary service of a declarative GATT table, its characteristics
+ *  follow the previous service's in the characteristic table */
+typedef struct {
+  uint16_t uuid16;
+  uint8_t  uuid_base;
+  uint8_t  char_count;
+} custom_gatt_service_t;
+
+typedef struct {
+  ble_uuid128_t const *         uuid_bases;  ///< little endian, bytes 12-13 zero
+  uint8_t                       uuid_base_count;
+  custom_gatt_service_t const * services;
+  uint8_t                       service_count;
+  custom_gatt_char_t const *    chars;
+  uint8_t                       char_count;
+} custom_gatt_table_t;
+
 uint8_t custom_add_uuid_base(uint8_t const * const p_uuid_base);
+uint8_t custom_add_uuid128(ble_uuid128_t const * p_base);
+uint8_t custom_uuid_base_count(void);
 error_t custom_decode_uuid(uint8_t const * const p_uuid_base, ble_uuid_t * p_uuid);
 
 error_t custom_add_in_characteristic(uint16_t service_handle, ble_uuid_t* p_uuid, ble_gatt_char_props_t properties,
                                      uint8_t *p_data, uint16_t min_length, uint16_t max_length,
                                      ble_gatts_char_handles_t* p_char_handle);
+error_t custom_add_user_characteristic(uint16_t service_handle, ble_uuid_t* p_uuid, ble_gatt_char_props_t properties,
+                                       uint8_t *p_buffer, uint16_t min_length, uint16_t max_length,
+                                       ble_gatts_char_handles_t* p_char_handle);
+
+error_t custom_add_lazy_characteristic(uint16_t service_handle, ble_uuid_t* p_uuid, ble_gatt_char_props_t properties,
+                                       uint16_t max_length, custom_read_handler_t read_handler, uint32_t ttl_ms,
+                                       ble_gatts_char_handles_t* p_char_handle);
+void    custom_lazy_invalidate(ble_gatts_char_handles_t const * p_char_handle);
+
+error_t custom_add_gatt_table(custom_gatt_table_t const * p_table, uint8_t uuid_types[], uint16_t * p_first_handle);
 
 #ifdef __cplusplus
 }
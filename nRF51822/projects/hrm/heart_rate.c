@@ -7,12 +7,73 @@
 #include "boards/board.h"
 #include "heart_rate.h"
 #include "ble_hrs.h"
+#include "ble_srv_common.h"
+#include "btle.h"
+#include "btle_advertising.h"
+#include "btle_timeline.h"
+
+#if CFG_HEART_RATE_PPG
+#include "heart_rate_ppg.h"
+#endif
+
+#define HEART_RATE_MEAS_INTERVAL_MS          1000                                                      /**< Heart rate measurement interval (ms). */
+#define HEART_RATE_MEAS_INTERVAL             APP_TIMER_TICKS(HEART_RATE_MEAS_INTERVAL_MS, CFG_TIMER_PRESCALER) /**< Heart rate measurement interval (ticks). */
+
+enum {
+  HRM_FLAG_VALUE_16BIT        = BIT(0), /* Heart Rate Measurement flags, as in the characteristic */
+  HRM_FLAG_CONTACT_DETECTED   = BIT(1),
+  HRM_FLAG_CONTACT_SUPPORTED  = BIT(2),
+  HRM_FLAG_RR_INTERVALS       = BIT(4),
+  HRM_ENCODED_MAX             = 3,      /* flags + 16-bit value, no energy expended or RR-intervals */
+  HRM_NOTIFY_MAX              = GATT_MTU_SIZE_DEFAULT - 3, /* a notification, opcode and handle take 3 bytes */
+
+  /* non-connectable advertising may not be faster than 100 ms */
+  BROADCAST_INTERVAL_MIN_MS   = 100,
+  BROADCAST_INTERVAL_MS       = (HEART_RATE_MEAS_INTERVAL_MS / CFG_HEART_RATE_BROADCAST_EVENTS > BROADCAST_INTERVAL_MIN_MS) ?
+                                (HEART_RATE_MEAS_INTERVAL_MS / CFG_HEART_RATE_BROADCAST_EVENTS) : BROADCAST_INTERVAL_MIN_MS,
+
+  FRONTEND_PIN_NONE           = 0xFF
+};
+
+/* The live value goes into the advertising data while waiting for a central */
+#define HEART_RATE_ADV_VALUE  ( CFG_GAP_ADV_MANUF_DATA_LEN == sizeof(uint16_t) && !CFG_BLE_IBEACON )
 
 static app_timer_id_t    m_heart_rate_timer_id;
 static volatile uint16_t m_cur_heart_rate;
 ble_hrs_t                m_hrs;
 
+/* Measurements waiting for the link, oldest first */
+static struct {
+  uint16_t value[CFG_HEART_RATE_QUEUE_SIZE];
+  uint8_t  head;
+  uint8_t  count;
+} m_queue;
+
+/* RR intervals (1/1024 s) waiting for a notification, oldest first. Each
+ * notification takes as many as fit, a full buffer drops the oldest */
+static struct {
+  uint16_t value[CFG_HEART_RATE_RR_QUEUE_SIZE];
+  uint8_t  head;
+  uint8_t  count;
+} m_rr;
+
+static uint32_t           m_last_err;  /* why the queue is not draining */
+static heart_rate_stats_t m_stats;
+
+static bool               m_subscribed = false; /* the central has the HRM notifications enabled */
+static bool               m_sampling   = false; /* the measurement timer (and front end) are running */
+
 static void heart_rate_meas_timeout_handler(void * p_context);
+static void heart_rate_service_cb(ble_hrs_t * p_hrs, ble_hrs_evt_t * p_evt);
+static void heart_rate_queue_add  ( uint16_t heart_rate );
+static void heart_rate_queue_flush( void );
+static void heart_rate_rr_add     ( uint16_t rr_interval );
+static uint8_t  heart_rate_meas_encode ( uint16_t heart_rate, uint8_t * p_encoded );
+static uint32_t heart_rate_meas_send   ( uint16_t heart_rate );
+static error_t heart_rate_broadcast_set( uint16_t heart_rate );
+static void    heart_rate_subscribed_set ( bool subscribed );
+static bool    heart_rate_cccd_notifying ( void );
+static void    heart_rate_sampling_update( void );
 
 /**************************************************************************/
 /*!
@@ -29,9 +90,9 @@ error_t heart_rate_init(void)
 
   ble_hrs_init_t hrs_init =
   {
-    .is_sensor_contact_supported = false,
+    .is_sensor_contact_supported = CFG_HEART_RATE_PPG,
     .p_body_sensor_location      = &body_sensor_location,
-    .evt_handler                 = NULL // heart_rate_service_cb
+    .evt_handler                 = heart_rate_service_cb
   };
 
   /* The security level for the Heart Rate Service can be set here */
@@ -44,6 +105,21 @@ error_t heart_rate_init(void)
 
   ASSERT_STATUS( ble_hrs_init(&m_hrs, &hrs_init) );
 
+#if CFG_HEART_RATE_PPG
+  ASSERT_STATUS( heart_rate_ppg_init() );
+#endif
+
+  if ( CFG_HEART_RATE_FRONTEND_PIN != FRONTEND_PIN_NONE )
+  {
+    nrf_gpio_cfg_output(CFG_HEART_RATE_FRONTEND_PIN);
+    nrf_gpio_pin_clear(CFG_HEART_RATE_FRONTEND_PIN);
+  }
+
+  /* The broadcaster and the advertised live value need measurements
+   * right away, otherwise they wait for a subscription */
+  m_cur_heart_rate = 100;
+  heart_rate_sampling_update();
+
   return ERROR_NONE;
 }
 
@@ -69,14 +145,25 @@ void heart_rate_handler(ble_evt_t * p_ble_evt)
        * values. So that every time a new connection is made, the heart
        * rate starts from the same value. */
       m_cur_heart_rate = 100;
+      m_queue.count    = 0;
 
-      /* Start the timers used to generate HR measurements */
-      #define HEART_RATE_MEAS_INTERVAL             APP_TIMER_TICKS(1000, CFG_TIMER_PRESCALER) /**< Heart rate measurement interval (ticks). */
-      ASSERT_STATUS_RET_VOID ( app_timer_start(m_heart_rate_timer_id, HEART_RATE_MEAS_INTERVAL, NULL) );
+      /* the CCCD of a bonded central may already be restored (CFG_BLE_SYS_ATTR_FAST) */
+      heart_rate_subscribed_set( heart_rate_cccd_notifying() );
     break;
 
     case BLE_GAP_EVT_DISCONNECTED:
+      heart_rate_subscribed_set(false);
+    break;
+
+    /* The CCCD may just have been restored by the bond manager */
+    case BLE_GAP_EVT_CONN_SEC_UPDATE:
+      heart_rate_subscribed_set( heart_rate_cccd_notifying() );
+      heart_rate_queue_flush();
+    break;
 
+    /* A TX buffer was freed */
+    case BLE_EVT_TX_COMPLETE:
+      heart_rate_queue_flush();
     break;
 
     default: break;
@@ -96,27 +183,394 @@ static void heart_rate_meas_timeout_handler(void * p_context)
 {
   (void) p_context;
 
-  error_t err_code;
+#if CFG_HEART_RATE_PPG
+  /* the latest average of the pulse, 0 without a lock */
+  m_cur_heart_rate = heart_rate_ppg_bpm();
+  ble_hrs_sensor_contact_detected_update(&m_hrs, heart_rate_ppg_contact());
 
+  /* collected for the next notifications, see heart_rate_meas_send() */
+  uint16_t rr;
+  while ( heart_rate_ppg_rr_get(&rr) )
+  {
+    if ( m_subscribed ) heart_rate_rr_add(rr);
+  }
+#else
   uint32_t offset; // -1 0 +1
   app_timer_cnt_get(&offset);
 
   m_cur_heart_rate += (offset%3);
   m_cur_heart_rate--;
+#endif
+  m_stats.measured++;
+
+  /* Broadcaster mode, no connection to serve */
+  if ( CFG_HEART_RATE_BROADCAST )
+  {
+    ASSERT_STATUS_RET_VOID( heart_rate_broadcast_set(m_cur_heart_rate) );
+    m_stats.broadcast++;
+    return;
+  }
+
+  /* Advertise the latest value, little endian like the HRM characteristic.
+   * The beacon mode owns the advertising data, the schedule is not running */
+  if ( HEART_RATE_ADV_VALUE )
+  {
+    uint8_t const adv_data[] = { U16_LOW_U8(m_cur_heart_rate), U16_HIGH_U8(m_cur_heart_rate) };
+    (void) btle_advertising_manuf_data_update(adv_data, sizeof(adv_data));
+  }
+
+  /* Nothing to queue for when nobody listens */
+  if ( !m_subscribed ) return;
+
+  heart_rate_queue_add(m_cur_heart_rate);
+  heart_rate_queue_flush();
+
+  /* the new measurement could not go out right away */
+  if ( m_queue.count > 0 )
+  {
+    switch ( m_last_err )
+    {
+      case BLE_ERROR_GATTS_SYS_ATTR_MISSING: m_stats.deferred_sys_attr++;   break;
+      case BLE_ERROR_NO_TX_BUFFERS         : m_stats.deferred_no_buffers++; break;
+      default                              : m_stats.deferred_no_cccd++;    break;
+    }
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief      Gets the measurement delivery counters since reset
+*/
+/**************************************************************************/
+heart_rate_stats_t const * heart_rate_stats(void)
+{
+  return &m_stats;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Starts the broadcaster mode: the measurements go out as
+                Service Data of the Heart Rate Service in non-connectable
+                advertising, for any number of listeners. Replaces the
+                connectable advertising schedule.
+
+                The interval gives each measurement
+                CFG_HEART_RATE_BROADCAST_EVENTS advertising events, the
+                margin for lost packets.
+
+    @returns
+*/
+/**************************************************************************/
+error_t heart_rate_broadcast_start(void)
+{
+  ASSERT_STATUS( heart_rate_broadcast_set(m_cur_heart_rate) );
+
+  ble_gap_adv_params_t adv_para =
+  {
+      .type        = BLE_GAP_ADV_TYPE_ADV_NONCONN_IND ,
+      .p_peer_addr = NULL                             ,
+      .fp          = BLE_GAP_ADV_FP_ANY               ,
+      .p_whitelist = NULL                             ,
+      .interval    = (BROADCAST_INTERVAL_MS*8)/5      , // advertising interval (in units of 0.625 ms)
+      .timeout     = 0                                  // broadcast forever
+  };
+
+  ASSERT_STATUS( sd_ble_gap_adv_start(&adv_para) );
+
+  return ERROR_NONE;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Encodes a measurement the way the Heart Rate Measurement
+                characteristic does, 8-bit value format when it fits
+
+    @returns    Number of bytes written (at most HRM_ENCODED_MAX)
+*/
+/**************************************************************************/
+static uint8_t heart_rate_meas_encode(uint16_t heart_rate, uint8_t * p_encoded)
+{
+  uint8_t len = 1;
+
+  if ( heart_rate > 0xFF )
+  {
+    p_encoded[0]     = HRM_FLAG_VALUE_16BIT;
+    p_encoded[len++] = U16_LOW_U8 (heart_rate);
+    p_encoded[len++] = U16_HIGH_U8(heart_rate);
+  }
+  else
+  {
+    p_encoded[0]     = 0;
+    p_encoded[len++] = (uint8_t) heart_rate;
+  }
+
+  return len;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Notifies a measurement with the sensor contact status and
+                as many of the collected RR intervals as fit in the
+                notification (9 next to an 8-bit value). The intervals
+                leave the buffer once the SoftDevice has taken the
+                packet, a refused notification keeps them for the next.
+
+    @returns    The sd_ble_gatts_hvx() error, NRF_ERROR_INVALID_STATE
+                while not connected
+*/
+/**************************************************************************/
+static uint32_t heart_rate_meas_send(uint16_t heart_rate)
+{
+  if ( m_hrs.conn_handle == BLE_CONN_HANDLE_INVALID ) return NRF_ERROR_INVALID_STATE;
+
+  uint8_t encoded[HRM_NOTIFY_MAX];
+  uint8_t len = heart_rate_meas_encode(heart_rate, encoded);
+
+  if ( m_hrs.is_sensor_contact_supported )
+  {
+    encoded[0] |= HRM_FLAG_CONTACT_SUPPORTED;
+    if ( m_hrs.is_sensor_contact_detected ) encoded[0] |= HRM_FLAG_CONTACT_DETECTED;
+  }
+
+  uint8_t const rr_count = min8_of(m_rr.count, (HRM_NOTIFY_MAX - len) / sizeof(uint16_t));
+  if ( rr_count > 0 ) encoded[0] |= HRM_FLAG_RR_INTERVALS;
+
+  for(uint8_t i=0; i<rr_count; i++)
+  {
+    len += uint16_encode(m_rr.value[ (m_rr.head + i) % CFG_HEART_RATE_RR_QUEUE_SIZE ], &encoded[len]);
+  }
+
+  uint16_t hvx_len = len;
+  ble_gatts_hvx_params_t const hvx_params =
+  {
+    .handle = m_hrs.hrm_handles.value_handle,
+    .type   = BLE_GATT_HVX_NOTIFICATION,
+    .offset = 0,
+    .p_len  = &hvx_len,
+    .p_data = encoded
+  };
+
+  uint32_t const err_code = sd_ble_gatts_hvx(m_hrs.conn_handle, &hvx_params);
+
+  if ( err_code == NRF_SUCCESS )
+  {
+    m_rr.head   = (m_rr.head + rr_count) % CFG_HEART_RATE_RR_QUEUE_SIZE;
+    m_rr.count -= rr_count;
+    m_stats.rr_sent += rr_count;
+  }
+
+  return err_code;
+}
 
-  err_code = (error_t) ble_hrs_heart_rate_measurement_send(&m_hrs, m_cur_heart_rate);
+/**************************************************************************/
+/*!
+    @brief      Sets the broadcast advertising data: flags, the encoded
+                measurement as Service Data (0x180D) and as much of the
+                name as fits, so that listeners can tell sensors apart.
+                This can be done while advertising.
+*/
+/**************************************************************************/
+static error_t heart_rate_broadcast_set(uint16_t heart_rate)
+{
+  uint8_t data[BLE_GAP_ADV_MAX_SIZE];
+  uint8_t len = 0;
+
+  /* Flags */
+  data[len++] = 2;
+  data[len++] = BLE_GAP_AD_TYPE_FLAGS;
+  data[len++] = BLE_GAP_ADV_FLAG_BR_EDR_NOT_SUPPORTED;
+
+  /* Service Data: 16-bit UUID then the measurement */
+  uint8_t encoded[HRM_ENCODED_MAX];
+  uint8_t const encoded_len = heart_rate_meas_encode(heart_rate, encoded);
+
+  data[len++] = 1 + 2 + encoded_len;
+  data[len++] = BLE_GAP_AD_TYPE_SERVICE_DATA;
+  data[len++] = U16_LOW_U8 (BLE_UUID_HEART_RATE_SERVICE);
+  data[len++] = U16_HIGH_U8(BLE_UUID_HEART_RATE_SERVICE);
+  memcpy(&data[len], encoded, encoded_len);
+  len += encoded_len;
+
+  /* Name, shortened if need be (room is kept for a 16-bit value) */
+  uint8_t const name_len = min8_of(strlen(CFG_GAP_LOCAL_NAME), BLE_GAP_ADV_MAX_SIZE - (3 + 4 + HRM_ENCODED_MAX) - 2);
+
+  data[len++] = 1 + name_len;
+  data[len++] = (name_len < strlen(CFG_GAP_LOCAL_NAME)) ? BLE_GAP_AD_TYPE_SHORT_LOCAL_NAME : BLE_GAP_AD_TYPE_COMPLETE_LOCAL_NAME;
+  memcpy(&data[len], CFG_GAP_LOCAL_NAME, name_len);
+  len += name_len;
+
+  ASSERT_STATUS( sd_ble_gap_adv_data_set(data, len, NULL, 0) );
+
+  return ERROR_NONE;
+}
 
-  if ((err_code != NRF_SUCCESS                      ) &&
-      (err_code != NRF_ERROR_INVALID_STATE          ) &&
-      (err_code != BLE_ERROR_NO_TX_BUFFERS          ) &&
-      (err_code != BLE_ERROR_GATTS_SYS_ATTR_MISSING ) )
+/**************************************************************************/
+/*!
+    @brief      Queues a measurement, dropping the oldest one when full.
+                Only a central that is subscribed loses anything, the
+                others are just not listening (yet).
+*/
+/**************************************************************************/
+static void heart_rate_queue_add(uint16_t heart_rate)
+{
+  if ( m_queue.count == CFG_HEART_RATE_QUEUE_SIZE )
   {
+    m_queue.head = (m_queue.head + 1) % CFG_HEART_RATE_QUEUE_SIZE;
+    m_queue.count--;
+
+    if ( m_last_err != NRF_ERROR_INVALID_STATE ) m_stats.lost++;
+  }
+
+  m_queue.value[ (m_queue.head + m_queue.count) % CFG_HEART_RATE_QUEUE_SIZE ] = heart_rate;
+  m_queue.count++;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Collects an RR interval for the next notification. The
+                newest are worth more to HRV analysis than a complete
+                history, so a full buffer drops the oldest.
+*/
+/**************************************************************************/
+static void heart_rate_rr_add(uint16_t rr_interval)
+{
+  if ( m_rr.count == CFG_HEART_RATE_RR_QUEUE_SIZE )
+  {
+    m_rr.head = (m_rr.head + 1) % CFG_HEART_RATE_RR_QUEUE_SIZE;
+    m_rr.count--;
+    m_stats.rr_lost++;
+  }
+
+  m_rr.value[ (m_rr.head + m_rr.count) % CFG_HEART_RATE_RR_QUEUE_SIZE ] = rr_interval;
+  m_rr.count++;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Sends the queued measurements in order until the link
+                refuses one, it stays queued for the next attempt
+*/
+/**************************************************************************/
+static void heart_rate_queue_flush(void)
+{
+  while ( m_queue.count > 0 )
+  {
+    uint32_t const err_code = heart_rate_meas_send(m_queue.value[m_queue.head]);
+
+    if ((err_code == NRF_ERROR_INVALID_STATE          ) ||
+        (err_code == BLE_ERROR_NO_TX_BUFFERS          ) ||
+        (err_code == BLE_ERROR_GATTS_SYS_ATTR_MISSING ) )
+    {
+      m_last_err = err_code;
+      return;
+    }
     ASSERT_STATUS_RET_VOID(err_code);
+
+    btle_timeline_mark(BTLE_TIMELINE_FIRST_NOTIFY);
+
+    m_queue.head = (m_queue.head + 1) % CFG_HEART_RATE_QUEUE_SIZE;
+    m_queue.count--;
+    m_stats.sent++;
   }
+
+  m_last_err = NRF_SUCCESS;
 }
 
-/* Callback from service lib */
-//static void heart_rate_service_cb(ble_hrs_t * p_hrs, ble_hrs_evt_t * p_evt)
-//{
-//
-//}
+/**************************************************************************/
+/*!
+    @brief      Callback from the service lib when the central writes the
+                heart rate measurement CCCD
+*/
+/**************************************************************************/
+static void heart_rate_service_cb(ble_hrs_t * p_hrs, ble_hrs_evt_t * p_evt)
+{
+  (void) p_hrs;
+
+  switch ( p_evt->evt_type )
+  {
+    case BLE_HRS_EVT_NOTIFICATION_ENABLED:
+      btle_timeline_mark(BTLE_TIMELINE_CCCD_ENABLED);
+      heart_rate_subscribed_set(true);
+      heart_rate_queue_flush();
+    break;
+
+    case BLE_HRS_EVT_NOTIFICATION_DISABLED:
+      heart_rate_subscribed_set(false);
+    break;
+
+    default: break;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief      Records whether the central listens to the measurements
+                and starts or stops the sampling to match
+*/
+/**************************************************************************/
+static void heart_rate_subscribed_set(bool subscribed)
+{
+  if ( !subscribed ) m_queue.count = m_rr.count = 0;
+
+  m_subscribed = subscribed;
+  heart_rate_sampling_update();
+}
+
+/**************************************************************************/
+/*!
+    @brief      Reads the Heart Rate Measurement CCCD, which the SoftDevice
+                holds for restored (bonded) centrals without an event
+*/
+/**************************************************************************/
+static bool heart_rate_cccd_notifying(void)
+{
+  uint8_t  cccd[BLE_CCCD_VALUE_LEN];
+  uint16_t len = BLE_CCCD_VALUE_LEN;
+
+  if ( NRF_SUCCESS != sd_ble_gatts_value_get(m_hrs.hrm_handles.cccd_handle, 0, &len, cccd) ) return false;
+
+  return ble_srv_is_notification_enabled(cccd);
+}
+
+/**************************************************************************/
+/*!
+    @brief      Runs the measurement timer, and powers the sensor front
+                end, only while a measurement can reach someone: the
+                broadcaster mode, the advertised live value while not
+                connected, or a subscribed central. Otherwise the CPU
+                would wake every interval for notifications that fail
+                with NRF_ERROR_INVALID_STATE.
+*/
+/**************************************************************************/
+static void heart_rate_sampling_update(void)
+{
+  bool const connected = ( m_hrs.conn_handle != BLE_CONN_HANDLE_INVALID );
+  bool const needed    = CFG_HEART_RATE_BROADCAST || ( connected ? m_subscribed : HEART_RATE_ADV_VALUE );
+
+  if ( needed == m_sampling ) return;
+  m_sampling = needed;
+
+  if ( needed )
+  {
+    if ( CFG_HEART_RATE_FRONTEND_PIN != FRONTEND_PIN_NONE ) nrf_gpio_pin_set(CFG_HEART_RATE_FRONTEND_PIN);
+
+    ASSERT_STATUS_RET_VOID( app_timer_start(m_heart_rate_timer_id, HEART_RATE_MEAS_INTERVAL, NULL) );
+
+#if CFG_HEART_RATE_PPG
+    ASSERT_STATUS_RET_VOID( heart_rate_ppg_start() );
+#endif
+
+    /* a fresh subscriber gets a value now, a front end (or the PPG pipeline) first settles */
+    if ( m_subscribed && CFG_HEART_RATE_FRONTEND_PIN == FRONTEND_PIN_NONE && !CFG_HEART_RATE_PPG ) heart_rate_meas_timeout_handler(NULL);
+  }
+  else
+  {
+    (void) app_timer_stop(m_heart_rate_timer_id);
+
+#if CFG_HEART_RATE_PPG
+    heart_rate_ppg_stop();
+#endif
+
+    if ( CFG_HEART_RATE_FRONTEND_PIN != FRONTEND_PIN_NONE ) nrf_gpio_pin_clear(CFG_HEART_RATE_FRONTEND_PIN);
+  }
+}
@@ -12,8 +12,22 @@ extern "C" {
 
 #include "ble.h"
 
+typedef struct {
+  uint32_t sent;                ///< measurements notified
+  uint32_t deferred_sys_attr;   ///< held back by BLE_ERROR_GATTS_SYS_ATTR_MISSING (used to be dropped)
+  uint32_t deferred_no_buffers; ///< held back by BLE_ERROR_NO_TX_BUFFERS (used to be dropped)
+  uint32_t deferred_no_cccd;    ///< held back while notifications are not (yet) enabled
+  uint32_t lost;                ///< dropped from a full queue while the central was subscribed
+  uint32_t broadcast;           ///< put on air by the broadcaster mode (CFG_HEART_RATE_BROADCAST)
+  uint32_t measured;            ///< measurements taken, sampling only runs while someone can see them
+  uint32_t rr_sent;             ///< RR intervals notified, several per measurement
+  uint32_t rr_lost;             ///< RR intervals dropped from a full buffer (the oldest go first)
+} heart_rate_stats_t;
+
 error_t heart_rate_init    ( void );
 void    heart_rate_handler ( ble_evt_t * p_ble_evt );
+heart_rate_stats_t const * heart_rate_stats ( void );
+error_t heart_rate_broadcast_start ( void );
 
 #ifdef __cplusplus
 }
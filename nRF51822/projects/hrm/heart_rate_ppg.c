@@ -0,0 +1,493 @@
+/**************************************************************************/
+/*!
+    @file     heart_rate_ppg.c
+    @author   hathach (tinyusb.org)
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2014, K. Townsend (microBuilder.eu)
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+
+
+/* ---------------------------------------------------------------------- */
+/* INCLUDE                                                                */
+/* ---------------------------------------------------------------------- */
+#include "common/common.h"
+
+#if CFG_HEART_RATE_PPG
+
+#include "nrf.h"
+#include "nrf_soc.h"
+#include "app_timer.h"
+#include "heart_rate_ppg.h"
+
+/* ---------------------------------------------------------------------- */
+/* MACRO CONSTANT TYPEDEF                                                 */
+/* ---------------------------------------------------------------------- */
+/* One-pole coefficient alpha = w/(1+w), w = 2*pi*fc/fs with pi ~ 355/113,
+ * in Q15. Folded by the compiler, none of it runs on the target */
+#define PPG_OMEGA_Q15(chz)    ( (2ULL * 355 * (chz) * 32768) / (113ULL * 100 * CFG_HEART_RATE_PPG_RATE_HZ) )
+#define PPG_ALPHA_Q15(chz)    ( (int32_t) ((PPG_OMEGA_Q15(chz) * 32768) / (32768 + PPG_OMEGA_Q15(chz))) )
+
+#define PPG_SAMPLE_INTERVAL   ( (APP_TIMER_CLOCK_FREQ + (CFG_TIMER_PRESCALER+1)*CFG_HEART_RATE_PPG_RATE_HZ/2) / \
+                                ((CFG_TIMER_PRESCALER+1)*CFG_HEART_RATE_PPG_RATE_HZ) )
+
+/* Times are counted in 1/16 of a sample (Q4), the peak interpolation
+ * places a beat between two samples */
+enum {
+  ADC_MID           = 512,  /* 10-bit conversion */
+  INPUT_SHIFT       = 5,    /* to Q15 at half scale: input minus baseline can not overflow */
+
+  ALPHA_HPF         = PPG_ALPHA_Q15(CFG_HEART_RATE_PPG_HPF_CHZ),
+  ALPHA_LPF         = PPG_ALPHA_Q15(CFG_HEART_RATE_PPG_LPF_CHZ),
+
+  /* the envelope closes in on the signal with a 1 s time constant, which
+   * follows the baseline wander left by the high-pass. A pulse has to
+   * reach 5/8 of the way up */
+  ENVELOPE_DECAY_Q15 = 32768 / CFG_HEART_RATE_PPG_RATE_HZ,
+  THRESHOLD_Q15      = (5 * 32768) / 8,
+  CONTACT_LEVEL     = CFG_HEART_RATE_PPG_CONTACT_MIN << INPUT_SHIFT,
+
+  SETTLE_SAMPLES    = 2 * CFG_HEART_RATE_PPG_RATE_HZ,                /* filters settling after a start */
+  SAMPLE_Q4         = 16,
+  RR_MIN_Q4         = (SAMPLE_Q4 * 60 * CFG_HEART_RATE_PPG_RATE_HZ) / 220, /* 220 BPM, also the shortest refractory period */
+  RR_MAX_Q4         = (SAMPLE_Q4 * 60 * CFG_HEART_RATE_PPG_RATE_HZ) / 30,  /* 30 BPM */
+  LOCK_TIMEOUT_Q4   = 2 * RR_MAX_Q4,                                 /* no beat for that long: no heart rate */
+
+  RR_AVERAGE        = 4,    /* intervals in the BPM average, power of 2 */
+  RR_OUTLIERS_MAX   = 3,    /* consecutive off-average intervals before re-locking to a new rhythm */
+  RR_FIFO_SIZE      = 8     /* power of 2 */
+};
+
+/* ---------------------------------------------------------------------- */
+/* INTERNAL OBJECT & FUNCTION DECLARATION                                 */
+/* ---------------------------------------------------------------------- */
+static struct {
+  int32_t  baseline;          /* one-pole low-pass under the high-pass corner, Q30 */
+  int32_t  smooth[2];         /* one-pole low-pass stages at the high corner, Q30 */
+  int16_t  high;              /* envelope of the filtered signal */
+  int16_t  low;
+  int16_t  prev;              /* previous filtered sample */
+  uint16_t settle;            /* samples left before beats are looked for */
+  uint32_t now_q4;
+
+  bool     above;             /* over the threshold, following the peak */
+  int16_t  peak;
+  int16_t  peak_left;         /* the samples either side of the peak, for the interpolation */
+  int16_t  peak_right;
+  uint32_t peak_q4;
+
+  bool     has_last;
+  uint32_t last_q4;           /* time of the previous beat */
+  uint32_t refractory_q4;
+
+  uint16_t rr[RR_AVERAGE];    /* accepted intervals in 1/1024 s */
+  uint8_t  rr_count;
+  uint8_t  rr_next;
+  uint8_t  outliers;
+  uint16_t bpm;
+} m_ppg;
+
+/* Intervals for the Heart Rate Measurement, single producer (ADC interrupt)
+ * single consumer (measurement timer), free running indices */
+static struct {
+  uint16_t         value[RR_FIFO_SIZE];
+  volatile uint8_t head;
+  volatile uint8_t tail;
+} m_rr_fifo;
+
+static app_timer_id_t         m_sample_timer_id;
+static heart_rate_ppg_stats_t m_stats;
+
+static void    ppg_sample_handler ( void * p_context );
+static int16_t ppg_one_pole       ( int32_t * p_acc, int32_t in, int32_t alpha );
+static uint32_t ppg_peak_time     ( void );
+static void    ppg_beat           ( uint32_t beat_q4 );
+
+/* ---------------------------------------------------------------------- */
+/* SAMPLING                                                               */
+/* ---------------------------------------------------------------------- */
+/**************************************************************************/
+/*!
+    @brief      Configures the ADC for the front end output (10-bit, 1/3
+                prescaling against the 1.2 V band gap, so 0 - 3.6 V) and
+                creates the sampling timer
+*/
+/**************************************************************************/
+error_t heart_rate_ppg_init(void)
+{
+  NRF_ADC->CONFIG = (ADC_CONFIG_RES_10bit                            << ADC_CONFIG_RES_Pos)    |
+                    (ADC_CONFIG_INPSEL_AnalogInputOneThirdPrescaling << ADC_CONFIG_INPSEL_Pos) |
+                    (ADC_CONFIG_REFSEL_VBG                           << ADC_CONFIG_REFSEL_Pos) |
+                    ((1UL << CFG_HEART_RATE_PPG_AIN)                 << ADC_CONFIG_PSEL_Pos)   |
+                    (ADC_CONFIG_EXTREFSEL_None                       << ADC_CONFIG_EXTREFSEL_Pos);
+  NRF_ADC->INTENSET = ADC_INTENSET_END_Msk;
+
+  /* Same priority as the timer and BLE event handlers that read the
+   * results, so the pipeline never changes under them */
+  ASSERT_STATUS( sd_nvic_ClearPendingIRQ(ADC_IRQn) );
+  ASSERT_STATUS( sd_nvic_SetPriority(ADC_IRQn, NRF_APP_PRIORITY_LOW) );
+  ASSERT_STATUS( sd_nvic_EnableIRQ(ADC_IRQn) );
+
+  ASSERT_STATUS( app_timer_create(&m_sample_timer_id, APP_TIMER_MODE_REPEATED, ppg_sample_handler) );
+
+  return ERROR_NONE;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Starts sampling at CFG_HEART_RATE_PPG_RATE_HZ with a fresh
+                pipeline, the heart rate is 0 until a few beats are in
+*/
+/**************************************************************************/
+error_t heart_rate_ppg_start(void)
+{
+  heart_rate_ppg_reset();
+
+  NRF_ADC->EVENTS_END = 0;
+  NRF_ADC->ENABLE     = ADC_ENABLE_ENABLE_Enabled;
+
+  ASSERT_STATUS( app_timer_start(m_sample_timer_id, PPG_SAMPLE_INTERVAL, NULL) );
+
+  return ERROR_NONE;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Stops sampling and releases the analog input
+*/
+/**************************************************************************/
+void heart_rate_ppg_stop(void)
+{
+  (void) app_timer_stop(m_sample_timer_id);
+
+  NRF_ADC->TASKS_STOP = 1;
+  NRF_ADC->ENABLE     = ADC_ENABLE_ENABLE_Disabled;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Starts a conversion, the result comes in ADC_IRQHandler()
+*/
+/**************************************************************************/
+static void ppg_sample_handler(void * p_context)
+{
+  (void) p_context;
+
+  if ( NRF_ADC->BUSY )
+  {
+    m_stats.overruns++;
+    return;
+  }
+
+  NRF_ADC->TASKS_START = 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief      A conversion is done
+*/
+/**************************************************************************/
+void ADC_IRQHandler(void)
+{
+  NRF_ADC->EVENTS_END = 0;
+  heart_rate_ppg_process( (uint16_t) NRF_ADC->RESULT );
+}
+
+/* ---------------------------------------------------------------------- */
+/* RESULTS                                                                */
+/* ---------------------------------------------------------------------- */
+/**************************************************************************/
+/*!
+    @brief      Heart rate averaged over the last RR intervals, 0 while
+                there is no lock on a pulse
+*/
+/**************************************************************************/
+uint16_t heart_rate_ppg_bpm(void)
+{
+  return m_ppg.bpm;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Whether the pulse is strong enough to be a finger on the
+                sensor (CFG_HEART_RATE_PPG_CONTACT_MIN)
+*/
+/**************************************************************************/
+bool heart_rate_ppg_contact(void)
+{
+  return ( m_ppg.settle == 0 ) && ( m_ppg.high - m_ppg.low >= CONTACT_LEVEL );
+}
+
+/**************************************************************************/
+/*!
+    @brief      Takes the oldest accepted RR interval not read yet
+
+    @param[out] p_rr    RR interval in 1/1024 s, the unit of the Heart
+                        Rate Measurement characteristic
+
+    @returns    false if there is none
+*/
+/**************************************************************************/
+bool heart_rate_ppg_rr_get(uint16_t * p_rr)
+{
+  uint8_t const tail = m_rr_fifo.tail;
+
+  if ( tail == m_rr_fifo.head ) return false;
+
+  *p_rr          = m_rr_fifo.value[tail % RR_FIFO_SIZE];
+  m_rr_fifo.tail = tail + 1;
+
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Gets the pipeline counters since reset
+*/
+/**************************************************************************/
+heart_rate_ppg_stats_t const * heart_rate_ppg_stats(void)
+{
+  return &m_stats;
+}
+
+/* ---------------------------------------------------------------------- */
+/* PIPELINE                                                               */
+/* ---------------------------------------------------------------------- */
+/**************************************************************************/
+/*!
+    @brief      Forgets the signal and the beats, the counters are kept
+*/
+/**************************************************************************/
+void heart_rate_ppg_reset(void)
+{
+  memclr_(&m_ppg, sizeof(m_ppg));
+  m_ppg.settle        = SETTLE_SAMPLES;
+  m_ppg.refractory_q4 = RR_MIN_Q4;
+
+  m_rr_fifo.head = m_rr_fifo.tail = 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Runs one ADC sample through the pipeline, all in Q15
+                integer arithmetic:
+
+                - band-pass: the baseline (a one-pole low-pass at the
+                  CFG_HEART_RATE_PPG_HPF_CHZ corner) is subtracted, then
+                  two one-pole low-pass stages at CFG_HEART_RATE_PPG_LPF_CHZ
+                  take out the noise
+                - an envelope of the highs and lows sets the threshold, a
+                  pulse is found between crossing it and falling back
+                  under it, and no earlier than a refractory period after
+                  the previous beat
+                - the peak is placed between samples by a parabola through
+                  it and its neighbours, then the RR interval is checked
+                  against the running average
+
+                A sample costs a handful of 32-bit multiplies, the few
+                divisions (the Cortex-M0 has no divide instruction) only
+                run once per beat.
+
+    @param[in]  sample  10-bit ADC result
+*/
+/**************************************************************************/
+void heart_rate_ppg_process(uint16_t sample)
+{
+  int32_t x = ((int32_t) sample - ADC_MID) << INPUT_SHIFT;
+  if ( CFG_HEART_RATE_PPG_INVERTED ) x = -x;
+
+  m_stats.samples++;
+  m_ppg.now_q4 += SAMPLE_Q4;
+
+  /* start the baseline at the signal rather than ramping up from 0 */
+  if ( m_ppg.settle == SETTLE_SAMPLES ) m_ppg.baseline = x << 15;
+
+  int16_t const baseline = ppg_one_pole(&m_ppg.baseline, x, ALPHA_HPF);
+  int16_t y = ppg_one_pole(&m_ppg.smooth[0], x - baseline, ALPHA_LPF);
+  y         = ppg_one_pole(&m_ppg.smooth[1], y           , ALPHA_LPF);
+
+  if ( m_ppg.settle > 0 )
+  {
+    m_ppg.settle--;
+    m_ppg.prev = y;
+    return;
+  }
+
+  m_ppg.high = ( y > m_ppg.high ) ? y : (int16_t) (m_ppg.high - (((m_ppg.high - y) * ENVELOPE_DECAY_Q15) >> 15));
+  m_ppg.low  = ( y < m_ppg.low  ) ? y : (int16_t) (m_ppg.low  + (((y - m_ppg.low ) * ENVELOPE_DECAY_Q15) >> 15));
+
+  int32_t const amplitude = m_ppg.high - m_ppg.low;
+  int16_t const threshold = (int16_t) (m_ppg.low + ((amplitude * THRESHOLD_Q15) >> 15));
+
+  if ( m_ppg.above )
+  {
+    if ( y > m_ppg.peak )
+    {
+      m_ppg.peak_left  = m_ppg.prev;
+      m_ppg.peak       = m_ppg.peak_right = y;
+      m_ppg.peak_q4    = m_ppg.now_q4;
+    }
+    else if ( m_ppg.now_q4 - m_ppg.peak_q4 == SAMPLE_Q4 )
+    {
+      m_ppg.peak_right = y;
+    }
+
+    if ( y < threshold )
+    {
+      m_ppg.above = false;
+      ppg_beat( ppg_peak_time() );
+    }
+  }
+  else if ( y > threshold && amplitude >= CONTACT_LEVEL &&
+            ( !m_ppg.has_last || m_ppg.now_q4 - m_ppg.last_q4 >= m_ppg.refractory_q4 ) )
+  {
+    m_ppg.above      = true;
+    m_ppg.peak_left  = m_ppg.prev;
+    m_ppg.peak       = m_ppg.peak_right = y;
+    m_ppg.peak_q4    = m_ppg.now_q4;
+  }
+
+  /* the finger is gone, or the pulse too weak to follow */
+  if ( m_ppg.has_last && m_ppg.now_q4 - m_ppg.last_q4 > LOCK_TIMEOUT_Q4 )
+  {
+    m_ppg.has_last      = false;
+    m_ppg.rr_count      = 0;
+    m_ppg.bpm           = 0;
+    m_ppg.refractory_q4 = RR_MIN_Q4;
+  }
+
+  m_ppg.prev = y;
+}
+
+/**************************************************************************/
+/*!
+    @brief      One-pole low-pass, acc += (in - out) * alpha. The state is
+                kept in Q30 so that small steps are not lost to rounding,
+                alpha below 0.5 (checked in projectconfig.h) keeps it in
+                range.
+
+    @returns    The output in Q15
+*/
+/**************************************************************************/
+static int16_t ppg_one_pole(int32_t * p_acc, int32_t in, int32_t alpha)
+{
+  *p_acc += (in - (*p_acc >> 15)) * alpha;
+  return (int16_t) (*p_acc >> 15);
+}
+
+/**************************************************************************/
+/*!
+    @brief      Time of the vertex of the parabola through the peak and
+                its neighbours, within half a sample of the peak sample
+*/
+/**************************************************************************/
+static uint32_t ppg_peak_time(void)
+{
+  int32_t const left  = m_ppg.peak_left;
+  int32_t const right = m_ppg.peak_right;
+  int32_t const curve = left - 2*m_ppg.peak + right; /* negative at a maximum */
+
+  if ( curve >= 0 ) return m_ppg.peak_q4;
+
+  return m_ppg.peak_q4 + (SAMPLE_Q4/2) * (left - right) / curve;
+}
+
+/**************************************************************************/
+/*!
+    @brief      A beat was found: turns the interval since the previous one
+                into an RR interval and updates the heart rate
+*/
+/**************************************************************************/
+static void ppg_beat(uint32_t beat_q4)
+{
+  m_stats.beats++;
+
+  uint32_t const interval_q4 = beat_q4 - m_ppg.last_q4;
+  bool     const has_last    = m_ppg.has_last;
+
+  m_ppg.has_last = true;
+  m_ppg.last_q4  = beat_q4;
+
+  if ( !has_last ) return;
+
+  /* a missed beat or noise */
+  if ( interval_q4 < RR_MIN_Q4 || interval_q4 > RR_MAX_Q4 )
+  {
+    m_stats.rejected++;
+    return;
+  }
+
+  uint16_t const rr = (uint16_t) ((interval_q4 * (1024/SAMPLE_Q4) + CFG_HEART_RATE_PPG_RATE_HZ/2) / CFG_HEART_RATE_PPG_RATE_HZ);
+
+  /* off the average by more than a quarter: an artefact, unless the
+   * rhythm keeps it up */
+  if ( m_ppg.rr_count == RR_AVERAGE )
+  {
+    uint32_t sum = 0;
+    for(uint8_t i=0; i<RR_AVERAGE; i++) sum += m_ppg.rr[i];
+
+    uint16_t const average = (uint16_t) (sum / RR_AVERAGE);
+
+    if ( rr + average/4 < average || rr > average + average/4 )
+    {
+      m_stats.rejected++;
+      if ( ++m_ppg.outliers < RR_OUTLIERS_MAX ) return;
+
+      m_ppg.rr_count = 0;
+    }
+  }
+  m_ppg.outliers = 0;
+
+  m_ppg.rr[m_ppg.rr_next] = rr;
+  m_ppg.rr_next = (m_ppg.rr_next + 1) % RR_AVERAGE;
+  if ( m_ppg.rr_count < RR_AVERAGE ) m_ppg.rr_count++;
+
+  /* the previous rr_count intervals, all written since the last reset of rr_count */
+  uint32_t sum = 0;
+  for(uint8_t i=0; i<m_ppg.rr_count; i++) sum += m_ppg.rr[(m_ppg.rr_next + RR_AVERAGE - 1 - i) % RR_AVERAGE];
+
+  /* no heart rate from a single interval */
+  if ( m_ppg.rr_count >= 2 )
+  {
+    m_ppg.bpm = (uint16_t) ((60UL * 1024 * m_ppg.rr_count + sum/2) / sum);
+  }
+
+  /* the dicrotic notch of a pulse can cross the threshold again, no beat
+   * within 5/8 of the average interval */
+  m_ppg.refractory_q4 = max32_of(RR_MIN_Q4, (sum * CFG_HEART_RATE_PPG_RATE_HZ * 5) / (m_ppg.rr_count * (1024/SAMPLE_Q4) * 8));
+
+  if ( (uint8_t) (m_rr_fifo.head - m_rr_fifo.tail) < RR_FIFO_SIZE )
+  {
+    m_rr_fifo.value[m_rr_fifo.head % RR_FIFO_SIZE] = rr;
+    m_rr_fifo.head++;
+  }
+}
+
+#endif /* CFG_HEART_RATE_PPG */
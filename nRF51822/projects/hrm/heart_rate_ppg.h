@@ -0,0 +1,80 @@
+/**************************************************************************/
+/*!
+    @file     heart_rate_ppg.h
+    @author   hathach (tinyusb.org)
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2014, K. Townsend (microBuilder.eu)
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+
+
+/** \ingroup TBD
+ *  \defgroup TBD
+ *  \brief TBD
+ *
+ *  @{
+ */
+
+#ifndef _HEART_RATE_PPG_H_
+#define _HEART_RATE_PPG_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include "common/common.h"
+
+typedef struct {
+  uint32_t samples;     ///< ADC conversions processed
+  uint32_t beats;       ///< pulse peaks detected
+  uint32_t rejected;    ///< beats whose interval was out of range or off the running average
+  uint32_t overruns;    ///< sampling ticks that found the ADC still converting
+} heart_rate_ppg_stats_t;
+
+error_t  heart_rate_ppg_init    ( void );
+error_t  heart_rate_ppg_start   ( void );
+void     heart_rate_ppg_stop    ( void );
+
+uint16_t heart_rate_ppg_bpm     ( void );
+bool     heart_rate_ppg_contact ( void );
+bool     heart_rate_ppg_rr_get  ( uint16_t * p_rr );
+heart_rate_ppg_stats_t const * heart_rate_ppg_stats ( void );
+
+/* The signal pipeline alone, no hardware access: feeds one 10-bit sample */
+void     heart_rate_ppg_reset   ( void );
+void     heart_rate_ppg_process ( uint16_t sample );
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _HEART_RATE_PPG_H_ */
+
+/** @} */
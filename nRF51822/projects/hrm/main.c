@@ -6,6 +6,7 @@
 #include "common.h"
 #include "board.h"
 #include "btle.h"
+#include "btle_advertising.h"
 #include "nrf_gpiote.h"
 #include "nrf_gpio.h"
 
@@ -34,6 +35,12 @@ static void blinky_handler(void * p_context)
 /**************************************************************************/
 void boardButtonCallback(uint8_t button_num)
 {
+  /* Restart advertising if it has gone idle */
+  if ( button_num == CFG_GAP_ADV_WAKEUP_BUTTON_NUM ) (void) btle_advertising_wakeup();
+
+  /* Accept any central until the next connection, to pair a new one */
+  if ( button_num == CFG_GAP_ADV_OPEN_PAIRING_BUTTON_NUM ) (void) btle_advertising_open_pairing();
+
   switch (button_num)
   {
     case 0: 
@@ -64,6 +71,9 @@ int main(void)
   ASSERT_STATUS ( app_timer_create(&blinky_timer_id, APP_TIMER_MODE_REPEATED, blinky_handler) );
   ASSERT_STATUS ( app_timer_start (blinky_timer_id, APP_TIMER_TICKS(1000, CFG_TIMER_PRESCALER), NULL) );
 
+  /* Buttons are needed before connecting, to wake up advertising */
+  ASSERT_STATUS( app_button_enable() );
+
   while(true)
   {
   }
@@ -49,9 +49,76 @@
 #endif
 
 #include "common/common.h"
+#include "ble_bondmngr.h"
+
+/** Fields that btle_advertising_init() spreads over the advertising packet
+ *  and the scan response (the flags always go in the advertising packet) */
+typedef enum {
+  BTLE_ADV_FIELD_APPEARANCE = BIT(0),
+  BTLE_ADV_FIELD_TX_POWER   = BIT(1),
+  BTLE_ADV_FIELD_UUID16     = BIT(2),
+  BTLE_ADV_FIELD_UUID128    = BIT(3),
+  BTLE_ADV_FIELD_NAME       = BIT(4)
+} btle_adv_field_t;
+
+/** Where each field ended up, as BTLE_ADV_FIELD_xxx bitmasks */
+typedef struct {
+  uint8_t adv;             ///< fields in the advertising packet
+  uint8_t scan_rsp;        ///< fields in the scan response
+  uint8_t truncated;       ///< fields included only in part (shortened name, incomplete UUID list)
+  uint8_t omitted;         ///< fields that did not fit at all
+  uint8_t uuid_omitted;    ///< number of service UUIDs left out
+  uint8_t adv_length;      ///< bytes used in the advertising packet
+  uint8_t scan_rsp_length; ///< bytes used in the scan response
+} btle_advertising_layout_t;
+
+/** Phases of the advertising schedule, see CFG_GAP_ADV_xxx in projectconfig.h */
+typedef enum {
+  BTLE_ADV_PHASE_DIRECTED = 0, ///< high duty directed advertising to the last bonded central
+  BTLE_ADV_PHASE_FAST,
+  BTLE_ADV_PHASE_SLOW,
+  BTLE_ADV_PHASE_IDLE,
+  BTLE_ADV_PHASE_COUNT
+} btle_adv_phase_t;
+
+/** Latency statistics, in milliseconds */
+typedef struct {
+  uint16_t count;
+  uint32_t total_ms;       ///< divide by 'count' for the average
+  uint32_t min_ms;
+  uint32_t max_ms;
+} btle_adv_latency_t;
+
+/** Statistics of an experiment candidate (CFG_GAP_ADV_EXPERIMENT), latencies
+ *  are counted from the start of each trial */
+typedef struct {
+  uint16_t interval_ms;
+  uint8_t  ch_mask;            ///< bit n set = channel 37+n off
+  uint16_t misses;             ///< trials that timed out without a connection
+  btle_adv_latency_t scan_req; ///< time to the first scan request (CFG_GAP_ADV_EXPERIMENT_SCAN_REQ)
+  btle_adv_latency_t ttc;      ///< time to connect
+} btle_adv_experiment_stats_t;
+
+/** Statistics of an advertising phase. Time-to-connect is counted from
+ *  the start of the schedule, so slow phase times include the fast phase */
+typedef struct {
+  uint16_t started;        ///< number of times the phase was entered
+  uint32_t advertising_ms; ///< total time spent advertising in the phase
+  btle_adv_latency_t ttc;  ///< time-to-connect of connections made during the phase
+} btle_adv_stats_t;
 
 error_t btle_advertising_init( btle_service_driver_t const service_list[], uint16_t const service_count);
 error_t btle_advertising_start(void);
+error_t btle_advertising_wakeup(void);
+error_t btle_advertising_manuf_data_update(uint8_t const * p_data, uint8_t len);
+error_t btle_advertising_open_pairing(void);
+bool    btle_advertising_is_whitelisted(void);
+void    btle_advertising_handler(ble_evt_t * p_ble_evt);
+btle_advertising_layout_t const * btle_advertising_layout(void);
+btle_adv_stats_t const * btle_advertising_stats(btle_adv_phase_t phase);
+btle_adv_latency_t const * btle_advertising_reconnect_latency(bool directed);
+void    btle_advertising_bond_handler(ble_bondmngr_evt_t * p_evt);
+btle_adv_experiment_stats_t const * btle_advertising_experiment_stats(uint8_t candidate);
 
 #ifdef __cplusplus
  }
@@ -0,0 +1,611 @@
+/**************************************************************************/
+/*!
+    @file     btle_ancs.c
+    @author   hathach (tinyusb.org)
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2014, K. Townsend (microBuilder.eu)
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+
+
+/* ---------------------------------------------------------------------- */
+/* INCLUDE				                                                        */
+/* ---------------------------------------------------------------------- */
+#include "common/common.h"
+
+#if CFG_BLE_ANCS
+
+#include "btle.h"
+#include "btle_ancs.h"
+#include "btle_gattc.h"
+#include "custom_helper.h"
+#include "ble_srv_common.h"
+
+/* ---------------------------------------------------------------------- */
+/* MACRO CONSTANT TYPEDEF                                                 */
+/* ---------------------------------------------------------------------- */
+/* Apple Notification Center Service, every UUID has a base of its own */
+#define ANCS_UUID_SERVICE   "\x79\x05\xF4\x31\xB5\xCE\x4E\x99\xA4\x0F\x4B\x1E\x12\x2D\x00\xD0"
+#define ANCS_UUID_NS        "\x9F\xBF\x12\x0D\x63\x01\x42\xD9\x8C\x58\x25\xE6\x99\xA2\x1D\xBD"
+#define ANCS_UUID_CP        "\x69\xD1\xD8\xF3\x45\xE1\x49\xA8\x98\x21\x9B\xBD\xFD\xAA\xD9\xD9"
+#define ANCS_UUID_DS        "\x22\xEA\xC6\xE9\x24\xD6\x4B\xB5\xBE\x44\xB3\x6A\xCE\x7C\x7B\xFB"
+
+enum {
+  ANCS_CHAR_NS = 0,             /* Notification Source */
+  ANCS_CHAR_CP,                 /* Control Point */
+  ANCS_CHAR_DS,                 /* Data Source */
+  ANCS_CHAR_COUNT
+};
+
+enum {
+  ANCS_CMD_GET_NOTIF_ATTR = 0,
+  ANCS_ATTR_APP_ID        = 0,
+  ANCS_ATTR_TITLE         = 1,
+  ANCS_ATTR_MESSAGE       = 3,
+  ANCS_ATTR_COUNT         = 3,  /* attributes requested per notification */
+  ANCS_CMD_LENGTH         = 12,
+  ANCS_NS_LENGTH          = 8
+};
+
+typedef enum {
+  ANCS_STATE_IDLE = 0,
+  ANCS_STATE_SUBSCRIBE_DS,      /* Data Source first, so no answer is missed */
+  ANCS_STATE_SUBSCRIBE_NS,
+  ANCS_STATE_READY
+} ancs_state_t;
+
+/* Data Source responses are parsed a byte at a time, they may be split
+ * over several notifications and several may follow each other */
+typedef enum {
+  ANCS_PARSE_CMD = 0,
+  ANCS_PARSE_UID,
+  ANCS_PARSE_ATTR_ID,
+  ANCS_PARSE_ATTR_LEN,
+  ANCS_PARSE_ATTR_VALUE
+} ancs_parse_state_t;
+
+typedef struct {
+  uint32_t uid;
+  uint8_t  event_id;
+  uint8_t  event_flags;
+  uint8_t  category;
+} ancs_pending_t;
+
+/* ---------------------------------------------------------------------- */
+/* INTERNAL OBJECT & FUNCTION DECLARATION                                 */
+/* ---------------------------------------------------------------------- */
+static ble_uuid128_t const     m_uuid_bases[1+ANCS_CHAR_COUNT] =
+{
+  CUSTOM_UUID128_LE(ANCS_UUID_SERVICE),
+  CUSTOM_UUID128_LE(ANCS_UUID_NS),
+  CUSTOM_UUID128_LE(ANCS_UUID_CP),
+  CUSTOM_UUID128_LE(ANCS_UUID_DS)
+};
+
+static void ancs_gattc_handler(btle_gattc_service_t * p_service, btle_gattc_evt_t evt);
+
+static ble_uuid_t              m_char_uuids[ANCS_CHAR_COUNT];
+static btle_gattc_char_t       m_chars[ANCS_CHAR_COUNT];
+static btle_gattc_service_t    m_service =
+{
+  .char_uuids  = m_char_uuids,
+  .chars       = m_chars,
+  .char_count  = ANCS_CHAR_COUNT,
+  .evt_handler = ancs_gattc_handler
+};
+
+static uint16_t                m_conn_handle = BLE_CONN_HANDLE_INVALID;
+static ancs_state_t            m_state       = ANCS_STATE_IDLE;
+static btle_ancs_evt_handler_t m_evt_handler = NULL;
+static btle_ancs_stats_t       m_stats;
+
+/* Notifications waiting for their attributes, the first m_inflight ones
+ * were requested and are answered in order */
+static ancs_pending_t          m_pending[CFG_BLE_ANCS_QUEUE];
+static uint8_t                 m_pending_head  = 0;
+static uint8_t                 m_pending_count = 0;
+static uint8_t                 m_inflight      = 0;
+static bool                    m_cp_busy       = false;  /* a Control Point write awaits its response */
+static uint8_t                 m_cp_cmd[ANCS_CMD_LENGTH];
+
+static ancs_parse_state_t      m_parse_state = ANCS_PARSE_CMD;
+static uint8_t                 m_parse_count;            /* bytes of the UID or length so far */
+static uint8_t                 m_attr_id;
+static uint16_t                m_attr_len;
+static uint16_t                m_attr_pos;
+static uint8_t                 m_attrs_done;
+static btle_ancs_notif_t       m_rx;
+
+/* Notifications already fetched, iOS announces them all again (as
+ * pre-existing) each time the Notification Source is subscribed */
+static btle_ancs_notif_t       m_cache[CFG_BLE_ANCS_CACHE];
+static bool                    m_cache_valid[CFG_BLE_ANCS_CACHE];
+static uint8_t                 m_cache_next    = 0;
+static int8_t                  m_cache_central = INVALID_CENTRAL_HANDLE;
+
+static void    ancs_subscribe      ( uint8_t index, ancs_state_t state );
+static void    ancs_request_next   ( void );
+static void    ancs_ns_received    ( uint8_t const * p_data, uint16_t len );
+static void    ancs_parse          ( uint8_t byte );
+static void    ancs_attr_done      ( void );
+static void    ancs_reset          ( void );
+
+static ancs_pending_t *    pending_at     ( uint8_t index );
+static void                pending_remove ( uint8_t index );
+static btle_ancs_notif_t * cache_find     ( uint32_t uid );
+static void                cache_clear    ( void );
+
+/* ---------------------------------------------------------------------- */
+/* IMPLEMENTATION											                                    */
+/* ---------------------------------------------------------------------- */
+
+/**************************************************************************/
+/*!
+    @brief      Registers the ANCS UUIDs and the service with the GATT
+                client, after btle_gattc_init()
+*/
+/**************************************************************************/
+error_t btle_ancs_init(void)
+{
+  for(uint8_t i=0; i<1+ANCS_CHAR_COUNT; i++)
+  {
+    uint8_t const uuid_type = custom_add_uuid128(&m_uuid_bases[i]);
+    ASSERT( uuid_type >= BLE_UUID_TYPE_VENDOR_BEGIN, ERROR_INVALIDPARAMETER );
+
+    /* bytes 12-13 of the 128-bit UUID */
+    ble_uuid_t const uuid =
+    {
+      .uuid = (uint16_t) (m_uuid_bases[i].uuid128[12] | (m_uuid_bases[i].uuid128[13] << 8)),
+      .type = uuid_type
+    };
+
+    if ( i == 0 ) m_service.uuid = uuid;
+    else          m_char_uuids[i-1] = uuid;
+  }
+
+  ASSERT_STATUS( btle_gattc_service_register(&m_service) );
+
+  return ERROR_NONE;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Sets the application's notification callback
+*/
+/**************************************************************************/
+void btle_ancs_evt_handler_set(btle_ancs_evt_handler_t evt_handler)
+{
+  m_evt_handler = evt_handler;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Gets the fetch, cache and queue counters
+*/
+/**************************************************************************/
+btle_ancs_stats_t const * btle_ancs_stats(void)
+{
+  return &m_stats;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Callback handler for the bond manager events, the cache
+                only holds the notifications of one central
+*/
+/**************************************************************************/
+void btle_ancs_bond_handler(ble_bondmngr_evt_t * p_evt)
+{
+  switch ( p_evt->evt_type )
+  {
+    case BLE_BONDMNGR_EVT_NEW_BOND:
+      cache_clear();
+      m_cache_central = p_evt->central_handle;
+    break;
+
+    case BLE_BONDMNGR_EVT_CONN_TO_BONDED_CENTRAL:
+    case BLE_BONDMNGR_EVT_ENCRYPTED:
+      if ( p_evt->central_handle != m_cache_central ) cache_clear();
+      m_cache_central = p_evt->central_handle;
+    break;
+
+    default: break;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief      Callback handler for events from the SoftDevice
+*/
+/**************************************************************************/
+void btle_ancs_handler(ble_evt_t * p_ble_evt)
+{
+  ble_gattc_evt_t const * p_gattc_evt = &p_ble_evt->evt.gattc_evt;
+
+  switch ( p_ble_evt->header.evt_id )
+  {
+    case BLE_GAP_EVT_CONNECTED:
+    {
+      m_conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+
+      /* iOS only lets bonded, encrypted links use ANCS: ask the central
+       * to encrypt (or pair), the GATT client starts once it has */
+      ble_gap_sec_params_t const sec_params =
+      {
+          .timeout      = 30                   ,
+          .bond         = 1                    ,
+          .mitm         = 0                    ,
+          .io_caps      = BLE_GAP_IO_CAPS_NONE ,
+          .oob          = 0                    ,
+          .min_key_size = 7                    ,
+          .max_key_size = 16
+      };
+      ASSERT_STATUS_RET_VOID( sd_ble_gap_authenticate(m_conn_handle, &sec_params) );
+    }
+    break;
+
+    case BLE_GAP_EVT_DISCONNECTED:
+      m_conn_handle = BLE_CONN_HANDLE_INVALID;
+      ancs_reset();
+    break;
+
+    case BLE_GATTC_EVT_WRITE_RSP:
+    {
+      uint16_t const handle = p_gattc_evt->params.write_rsp.handle;
+
+      if ( m_state == ANCS_STATE_SUBSCRIBE_DS && handle == m_chars[ANCS_CHAR_DS].cccd_handle )
+      {
+        ancs_subscribe(ANCS_CHAR_NS, ANCS_STATE_SUBSCRIBE_NS);
+      }
+      else if ( m_state == ANCS_STATE_SUBSCRIBE_NS && handle == m_chars[ANCS_CHAR_NS].cccd_handle )
+      {
+        m_state = ANCS_STATE_READY;
+      }
+      else if ( m_cp_busy && handle == m_chars[ANCS_CHAR_CP].value_handle )
+      {
+        m_cp_busy = false;
+
+        /* e.g. the notification is already gone, no answer will follow */
+        if ( p_gattc_evt->gatt_status != BLE_GATT_STATUS_SUCCESS && m_inflight > 0 )
+        {
+          pending_remove(--m_inflight);
+        }
+      }
+
+      ancs_request_next();
+    }
+    break;
+
+    case BLE_GATTC_EVT_HVX:
+      if ( m_state != ANCS_STATE_READY ) break;
+
+      if ( p_gattc_evt->params.hvx.handle == m_chars[ANCS_CHAR_NS].value_handle )
+      {
+        ancs_ns_received(p_gattc_evt->params.hvx.data, p_gattc_evt->params.hvx.len);
+      }
+      else if ( p_gattc_evt->params.hvx.handle == m_chars[ANCS_CHAR_DS].value_handle )
+      {
+        for(uint16_t i=0; i<p_gattc_evt->params.hvx.len; i++) ancs_parse(p_gattc_evt->params.hvx.data[i]);
+      }
+
+      ancs_request_next();
+    break;
+
+    default: break;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief      GATT client events of the ANCS service: subscribes once
+                the handles are known (discovered or cached)
+*/
+/**************************************************************************/
+static void ancs_gattc_handler(btle_gattc_service_t * p_service, btle_gattc_evt_t evt)
+{
+  (void) p_service;
+
+  ancs_reset();
+
+  if ( evt == BTLE_GATTC_EVT_DISCOVERED &&
+       m_chars[ANCS_CHAR_CP].value_handle != BLE_GATT_HANDLE_INVALID &&
+       m_chars[ANCS_CHAR_NS].cccd_handle  != BLE_GATT_HANDLE_INVALID &&
+       m_chars[ANCS_CHAR_DS].cccd_handle  != BLE_GATT_HANDLE_INVALID )
+  {
+    ancs_subscribe(ANCS_CHAR_DS, ANCS_STATE_SUBSCRIBE_DS);
+  }
+}
+
+static void ancs_subscribe(uint8_t index, ancs_state_t state)
+{
+  m_state = ( ERROR_NONE == btle_gattc_cccd_write(m_conn_handle, m_chars[index].cccd_handle, BLE_GATT_HVX_NOTIFICATION) ) ?
+              state : ANCS_STATE_IDLE;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Writes the next Get Notification Attributes command. The
+                commands are pipelined: the next one goes out as soon as
+                the Control Point write is acknowledged, without waiting
+                for the Data Source answer to the previous one.
+*/
+/**************************************************************************/
+static void ancs_request_next(void)
+{
+  if ( m_state != ANCS_STATE_READY || m_cp_busy ||
+       m_inflight >= CFG_BLE_ANCS_PIPELINE || m_inflight >= m_pending_count )
+  {
+    return;
+  }
+
+  m_cp_cmd[0] = ANCS_CMD_GET_NOTIF_ATTR;
+  (void) uint32_encode(pending_at(m_inflight)->uid, &m_cp_cmd[1]);
+  m_cp_cmd[5] = ANCS_ATTR_APP_ID;
+  m_cp_cmd[6] = ANCS_ATTR_TITLE;
+  (void) uint16_encode(CFG_BLE_ANCS_TITLE_LEN, &m_cp_cmd[7]);
+  m_cp_cmd[9] = ANCS_ATTR_MESSAGE;
+  (void) uint16_encode(CFG_BLE_ANCS_MESSAGE_LEN, &m_cp_cmd[10]);
+
+  ble_gattc_write_params_t const write_params =
+  {
+    .write_op = BLE_GATT_OP_WRITE_REQ,
+    .handle   = m_chars[ANCS_CHAR_CP].value_handle,
+    .offset   = 0,
+    .len      = ANCS_CMD_LENGTH,
+    .p_value  = m_cp_cmd
+  };
+
+  /* busy: tried again with the next event */
+  if ( NRF_SUCCESS == sd_ble_gattc_write(m_conn_handle, &write_params) )
+  {
+    m_inflight++;
+    m_cp_busy = true;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief      A Notification Source notification: answers announcements
+                of cached notifications, queues the others for a fetch
+*/
+/**************************************************************************/
+static void ancs_ns_received(uint8_t const * p_data, uint16_t len)
+{
+  if ( len < ANCS_NS_LENGTH ) return;
+
+  ancs_pending_t const notif =
+  {
+    .event_id    = p_data[0],
+    .event_flags = p_data[1],
+    .category    = p_data[2],
+    .uid         = uint32_decode(&p_data[4])
+  };
+
+  btle_ancs_notif_t * p_cached = cache_find(notif.uid);
+  if ( p_cached != NULL && p_cached->category != notif.category ) p_cached = NULL;
+
+  if ( notif.event_id == BTLE_ANCS_EVT_REMOVED )
+  {
+    btle_ancs_notif_t removed = { .uid = notif.uid, .category = notif.category };
+
+    if ( p_cached != NULL ) m_cache_valid[p_cached - m_cache] = false;
+
+    for(uint8_t i=m_inflight; i<m_pending_count; i++)
+    {
+      if ( pending_at(i)->uid == notif.uid ) { pending_remove(i); break; }
+    }
+
+    if ( m_evt_handler != NULL ) m_evt_handler(BTLE_ANCS_EVT_REMOVED, &removed);
+    return;
+  }
+
+  if ( notif.event_id == BTLE_ANCS_EVT_ADDED && p_cached != NULL )
+  {
+    m_stats.cache_hits++;
+    p_cached->event_flags = notif.event_flags;
+    if ( m_evt_handler != NULL ) m_evt_handler(BTLE_ANCS_EVT_ADDED, p_cached);
+    return;
+  }
+
+  /* modified: the cached attributes are stale */
+  if ( p_cached != NULL ) m_cache_valid[p_cached - m_cache] = false;
+
+  for(uint8_t i=m_inflight; i<m_pending_count; i++)
+  {
+    if ( pending_at(i)->uid == notif.uid ) { *pending_at(i) = notif; return; }
+  }
+
+  if ( m_pending_count >= CFG_BLE_ANCS_QUEUE )
+  {
+    m_stats.dropped++;
+    return;
+  }
+
+  *pending_at(m_pending_count++) = notif;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Feeds a byte of the Data Source stream to the parser
+*/
+/**************************************************************************/
+static void ancs_parse(uint8_t byte)
+{
+  switch ( m_parse_state )
+  {
+    case ANCS_PARSE_CMD:
+      if ( byte != ANCS_CMD_GET_NOTIF_ATTR ) break; /* not a start, resynchronise */
+
+      memclr_(&m_rx, sizeof(btle_ancs_notif_t));
+      m_parse_count = 0;
+      m_parse_state = ANCS_PARSE_UID;
+    break;
+
+    case ANCS_PARSE_UID:
+      m_rx.uid |= ((uint32_t) byte) << (8*m_parse_count);
+      if ( ++m_parse_count < 4 ) break;
+
+      /* requests that got no answer (the notification went away) */
+      while ( m_inflight > 0 && pending_at(0)->uid != m_rx.uid )
+      {
+        pending_remove(0);
+        m_inflight--;
+      }
+
+      if ( m_inflight > 0 )
+      {
+        m_rx.category    = pending_at(0)->category;
+        m_rx.event_flags = pending_at(0)->event_flags;
+      }
+
+      m_attrs_done  = 0;
+      m_parse_state = ANCS_PARSE_ATTR_ID;
+    break;
+
+    case ANCS_PARSE_ATTR_ID:
+      m_attr_id     = byte;
+      m_attr_len    = 0;
+      m_parse_count = 0;
+      m_parse_state = ANCS_PARSE_ATTR_LEN;
+    break;
+
+    case ANCS_PARSE_ATTR_LEN:
+      m_attr_len |= ((uint16_t) byte) << (8*m_parse_count);
+      if ( ++m_parse_count < 2 ) break;
+
+      m_attr_pos    = 0;
+      m_parse_state = ANCS_PARSE_ATTR_VALUE;
+      if ( m_attr_len == 0 ) ancs_attr_done();
+    break;
+
+    case ANCS_PARSE_ATTR_VALUE:
+    {
+      char *   p_str = NULL;
+      uint16_t cap   = 0;
+
+      switch ( m_attr_id )
+      {
+        case ANCS_ATTR_APP_ID : p_str = m_rx.app_id ; cap = CFG_BLE_ANCS_APP_ID_LEN ; break;
+        case ANCS_ATTR_TITLE  : p_str = m_rx.title  ; cap = CFG_BLE_ANCS_TITLE_LEN  ; break;
+        case ANCS_ATTR_MESSAGE: p_str = m_rx.message; cap = CFG_BLE_ANCS_MESSAGE_LEN; break;
+        default: break;
+      }
+
+      /* longer values are truncated, the strings stay NUL terminated */
+      if ( m_attr_pos < cap ) p_str[m_attr_pos] = (char) byte;
+
+      if ( ++m_attr_pos == m_attr_len ) ancs_attr_done();
+    }
+    break;
+
+    default: break;
+  }
+}
+
+static void ancs_attr_done(void)
+{
+  if ( ++m_attrs_done < ANCS_ATTR_COUNT )
+  {
+    m_parse_state = ANCS_PARSE_ATTR_ID;
+    return;
+  }
+
+  m_parse_state = ANCS_PARSE_CMD;
+
+  /* an answer we did not wait for, e.g. to a request before a reconnect */
+  if ( m_inflight == 0 ) return;
+
+  btle_ancs_evt_t const evt = (btle_ancs_evt_t) pending_at(0)->event_id;
+  pending_remove(0);
+  m_inflight--;
+  m_stats.fetched++;
+
+  /* the oldest entry makes room */
+  m_cache[m_cache_next]       = m_rx;
+  m_cache_valid[m_cache_next] = true;
+  m_cache_next = (m_cache_next + 1) % CFG_BLE_ANCS_CACHE;
+
+#if CFG_DEBUG
+  printf("ancs: 0x%08X cat %u %s: %s" CFG_PRINTF_NEWLINE, (unsigned) m_rx.uid, m_rx.category, m_rx.title, m_rx.message);
+#endif
+
+  if ( m_evt_handler != NULL ) m_evt_handler(evt, &m_rx);
+}
+
+/**************************************************************************/
+/*!
+    @brief      Forgets the queue and parser state, the cache stays
+*/
+/**************************************************************************/
+static void ancs_reset(void)
+{
+  m_state         = ANCS_STATE_IDLE;
+  m_pending_head  = 0;
+  m_pending_count = 0;
+  m_inflight      = 0;
+  m_cp_busy       = false;
+  m_parse_state   = ANCS_PARSE_CMD;
+}
+
+static ancs_pending_t * pending_at(uint8_t index)
+{
+  return &m_pending[(m_pending_head + index) % CFG_BLE_ANCS_QUEUE];
+}
+
+static void pending_remove(uint8_t index)
+{
+  if ( index == 0 )
+  {
+    m_pending_head = (m_pending_head + 1) % CFG_BLE_ANCS_QUEUE;
+  }
+  else
+  {
+    for(uint8_t i=index; i+1<m_pending_count; i++) *pending_at(i) = *pending_at(i+1);
+  }
+
+  m_pending_count--;
+}
+
+static btle_ancs_notif_t * cache_find(uint32_t uid)
+{
+  for(uint8_t i=0; i<CFG_BLE_ANCS_CACHE; i++)
+  {
+    if ( m_cache_valid[i] && m_cache[i].uid == uid ) return &m_cache[i];
+  }
+
+  return NULL;
+}
+
+static void cache_clear(void)
+{
+  memclr_(m_cache_valid, sizeof(m_cache_valid));
+}
+
+#endif /* CFG_BLE_ANCS */
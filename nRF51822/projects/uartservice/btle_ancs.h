@@ -0,0 +1,116 @@
+/**************************************************************************/
+/*!
+    @file     btle_ancs.h
+    @author   hathach (tinyusb.org)
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2014, K. Townsend (microBuilder.eu)
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+
+
+/** \ingroup TBD
+ *  \defgroup TBD
+ *  \brief TBD
+ *
+ *  @{
+ */
+
+#ifndef _BTLE_ANCS_H_
+#define _BTLE_ANCS_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include "common/common.h"
+#include "ble.h"
+#include "ble_bondmngr.h"
+
+/** EventID of the Notification Source */
+typedef enum
+{
+  BTLE_ANCS_EVT_ADDED    = 0,
+  BTLE_ANCS_EVT_MODIFIED = 1,
+  BTLE_ANCS_EVT_REMOVED  = 2
+} btle_ancs_evt_t;
+
+/** CategoryID of the Notification Source */
+enum
+{
+  BTLE_ANCS_CATEGORY_OTHER = 0,
+  BTLE_ANCS_CATEGORY_INCOMING_CALL,
+  BTLE_ANCS_CATEGORY_MISSED_CALL,
+  BTLE_ANCS_CATEGORY_VOICEMAIL,
+  BTLE_ANCS_CATEGORY_SOCIAL,
+  BTLE_ANCS_CATEGORY_SCHEDULE,
+  BTLE_ANCS_CATEGORY_EMAIL,
+  BTLE_ANCS_CATEGORY_NEWS,
+  BTLE_ANCS_CATEGORY_HEALTH_AND_FITNESS,
+  BTLE_ANCS_CATEGORY_BUSINESS_AND_FINANCE,
+  BTLE_ANCS_CATEGORY_LOCATION,
+  BTLE_ANCS_CATEGORY_ENTERTAINMENT
+};
+
+/** An iOS notification with its attributes, strings are NUL terminated
+ *  and truncated to the configured lengths */
+typedef struct
+{
+  uint32_t uid;
+  uint8_t  event_flags;   ///< EventFlags, bit 2 = pre-existing
+  uint8_t  category;
+  char     app_id[CFG_BLE_ANCS_APP_ID_LEN+1];
+  char     title[CFG_BLE_ANCS_TITLE_LEN+1];
+  char     message[CFG_BLE_ANCS_MESSAGE_LEN+1];
+} btle_ancs_notif_t;
+
+/** Called once the attributes of a notification are known (added,
+ *  modified), or when it is removed (only uid and category are set) */
+typedef void (*btle_ancs_evt_handler_t)(btle_ancs_evt_t evt, btle_ancs_notif_t const * p_notif);
+
+typedef struct
+{
+  uint16_t fetched;       ///< Get Notification Attributes answered
+  uint16_t cache_hits;    ///< notifications answered from the cache instead
+  uint16_t dropped;       ///< notifications the queue had no room for
+} btle_ancs_stats_t;
+
+error_t                   btle_ancs_init              ( void );
+void                      btle_ancs_evt_handler_set   ( btle_ancs_evt_handler_t evt_handler );
+btle_ancs_stats_t const * btle_ancs_stats             ( void );
+void                      btle_ancs_handler           ( ble_evt_t * p_ble_evt );
+void                      btle_ancs_bond_handler      ( ble_bondmngr_evt_t * p_evt );
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _BTLE_ANCS_H_ */
+
+/** @} */
@@ -0,0 +1,272 @@
+/**************************************************************************/
+/*!
+    @file     btle_beacon.c
+    @author   hathach (tinyusb.org)
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2014, K. Townsend (microBuilder.eu)
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+
+/* ---------------------------------------------------------------------- */
+/* INCLUDE				                                                        */
+/* ---------------------------------------------------------------------- */
+#include "common/common.h"
+#include "boards/board.h"
+
+#include "btle.h"
+#include "btle_beacon.h"
+
+/* ---------------------------------------------------------------------- */
+/* MACRO CONSTANT TYPEDEF                                                 */
+/* ---------------------------------------------------------------------- */
+enum {
+  BEACON_FRAME_MAX        = 4,
+  BEACON_APPLE_COMPANY_ID = 0x004C,
+  BEACON_IBEACON_TYPE     = 0x02,
+  BEACON_IBEACON_LENGTH   = 0x15, /* uuid + major + minor + measured power */
+
+  /* non-connectable advertising may not be faster than 100 ms */
+  BEACON_INTERVAL_MIN_MS  = 100,
+  BEACON_INTERVAL_MAX_MS  = 10240
+};
+
+/* ---------------------------------------------------------------------- */
+/* INTERNAL OBJECT & FUNCTION DECLARATION                                 */
+/* ---------------------------------------------------------------------- */
+static btle_beacon_frame_t m_frames[BEACON_FRAME_MAX];
+static uint8_t             m_frame_count;
+static uint8_t             m_frame_idx;
+static uint16_t            m_interval_ms;
+static app_timer_id_t      m_rotate_timer_id;
+
+static uint16_t beacon_interval_compute ( btle_beacon_frame_t const frames[], uint8_t count );
+static error_t  beacon_frame_set        ( btle_beacon_frame_t const * p_frame );
+static void     beacon_rotate_handler   ( void * p_context );
+
+/* ---------------------------------------------------------------------- */
+/* IMPLEMENTATION											                                    */
+/* ---------------------------------------------------------------------- */
+
+/**************************************************************************/
+/*!
+    @brief      Initialises the non-connectable beacon mode
+
+    @param[in]  frames  Frames to rotate through, in order
+    @param[in]  count   Number of frames (at most 4)
+
+    @returns
+*/
+/**************************************************************************/
+error_t btle_beacon_init(btle_beacon_frame_t const frames[], uint8_t count)
+{
+  ASSERT( count > 0 && count <= BEACON_FRAME_MAX, ERROR_INVALIDPARAMETER );
+
+  memcpy(m_frames, frames, count*sizeof(btle_beacon_frame_t));
+  m_frame_count = count;
+  m_frame_idx   = 0;
+  m_interval_ms = beacon_interval_compute(frames, count);
+
+  ASSERT_STATUS( app_timer_create(&m_rotate_timer_id, APP_TIMER_MODE_SINGLE_SHOT, beacon_rotate_handler) );
+
+  return ERROR_NONE;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Starts beaconing from the first frame
+
+    @returns
+*/
+/**************************************************************************/
+error_t btle_beacon_start(void)
+{
+  m_frame_idx = 0;
+  ASSERT_STATUS( beacon_frame_set(&m_frames[0]) );
+
+  ble_gap_adv_params_t adv_para =
+  {
+      .type        = BLE_GAP_ADV_TYPE_ADV_NONCONN_IND ,
+      .p_peer_addr = NULL                             ,
+      .fp          = BLE_GAP_ADV_FP_ANY               ,
+      .p_whitelist = NULL                             ,
+      .interval    = (m_interval_ms*8)/5              , // advertising interval (in units of 0.625 ms)
+      .timeout     = 0                                  // beacon forever
+  };
+
+  ASSERT_STATUS( sd_ble_gap_adv_start(&adv_para) );
+
+  if ( m_frame_count > 1 )
+  {
+    ASSERT_STATUS( app_timer_start(m_rotate_timer_id, APP_TIMER_TICKS(m_frames[0].duration_ms, CFG_TIMER_PRESCALER), NULL) );
+  }
+
+  return ERROR_NONE;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Stops beaconing
+
+    @returns
+*/
+/**************************************************************************/
+error_t btle_beacon_stop(void)
+{
+  (void) app_timer_stop(m_rotate_timer_id);
+  ASSERT_STATUS( sd_ble_gap_adv_stop() );
+
+  return ERROR_NONE;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Gets the advertising interval chosen for the latency target
+
+    @returns    Advertising interval in milliseconds
+*/
+/**************************************************************************/
+uint16_t btle_beacon_interval_ms(void)
+{
+  return m_interval_ms;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Picks the slowest advertising interval that still lets a
+                scanner see every frame within CFG_BLE_IBEACON_LATENCY_MS.
+
+                Worst case a scanner starts listening just after a frame
+                went off air: it waits for the rest of the rotation, then
+                needs CFG_BLE_IBEACON_EVENTS_PER_DISCOVERY advertising
+                events of that frame (the margin for lost packets), all
+                of which must fit in the frame's own time on air.
+*/
+/**************************************************************************/
+static uint16_t beacon_interval_compute(btle_beacon_frame_t const frames[], uint8_t count)
+{
+  uint32_t cycle_ms = 0;
+  for(uint8_t i=0; i<count; i++) cycle_ms += frames[i].duration_ms;
+
+  uint32_t interval_ms = CFG_BLE_IBEACON_LATENCY_MS / CFG_BLE_IBEACON_EVENTS_PER_DISCOVERY;
+
+  /* a single frame is always on air, there is no rotation to wait for */
+  for(uint8_t i=0; (count > 1) && (i < count); i++)
+  {
+    uint32_t const wait_ms   = cycle_ms - frames[i].duration_ms;
+    uint32_t const budget_ms = (CFG_BLE_IBEACON_LATENCY_MS > wait_ms) ? (CFG_BLE_IBEACON_LATENCY_MS - wait_ms) : 0;
+
+    interval_ms = min32_of(interval_ms, min32_of(budget_ms, frames[i].duration_ms) / CFG_BLE_IBEACON_EVENTS_PER_DISCOVERY);
+  }
+
+#if CFG_DEBUG
+  if ( interval_ms < BEACON_INTERVAL_MIN_MS )
+  {
+    printf("beacon: latency target can not be met, frames too short or rotation too long" CFG_PRINTF_NEWLINE);
+  }
+#endif
+
+  return (uint16_t) max32_of(BEACON_INTERVAL_MIN_MS, min32_of(interval_ms, BEACON_INTERVAL_MAX_MS));
+}
+
+/**************************************************************************/
+/*!
+    @brief      Encodes a frame and sets it as advertising data, this can
+                be done while advertising
+*/
+/**************************************************************************/
+static error_t beacon_frame_set(btle_beacon_frame_t const * p_frame)
+{
+  uint8_t data[BLE_GAP_ADV_MAX_SIZE];
+  uint8_t len = 0;
+
+  /* Flags */
+  data[len++] = 2;
+  data[len++] = BLE_GAP_AD_TYPE_FLAGS;
+  data[len++] = BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE;
+
+  switch ( p_frame->type )
+  {
+    case BTLE_BEACON_FRAME_IBEACON:
+      data[len++] = 1 + 2 + 2 + BEACON_IBEACON_LENGTH;
+      data[len++] = BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA;
+      data[len++] = U16_LOW_U8 (BEACON_APPLE_COMPANY_ID);
+      data[len++] = U16_HIGH_U8(BEACON_APPLE_COMPANY_ID);
+      data[len++] = BEACON_IBEACON_TYPE;
+      data[len++] = BEACON_IBEACON_LENGTH;
+
+      memcpy(&data[len], p_frame->uuid, 16);
+      len += 16;
+
+      /* major & minor are big endian */
+      data[len++] = U16_HIGH_U8(p_frame->major);
+      data[len++] = U16_LOW_U8 (p_frame->major);
+      data[len++] = U16_HIGH_U8(p_frame->minor);
+      data[len++] = U16_LOW_U8 (p_frame->minor);
+      data[len++] = (uint8_t) p_frame->measured_power;
+    break;
+
+    case BTLE_BEACON_FRAME_NAME:
+    {
+      uint8_t const name_len = min8_of(strlen(CFG_GAP_LOCAL_NAME), BLE_GAP_ADV_MAX_SIZE - len - 3 - 2);
+
+      data[len++] = 2;
+      data[len++] = BLE_GAP_AD_TYPE_TX_POWER_LEVEL;
+      data[len++] = (uint8_t) CFG_BLE_TX_POWER_LEVEL;
+
+      data[len++] = 1 + name_len;
+      data[len++] = (name_len < strlen(CFG_GAP_LOCAL_NAME)) ? BLE_GAP_AD_TYPE_SHORT_LOCAL_NAME : BLE_GAP_AD_TYPE_COMPLETE_LOCAL_NAME;
+      memcpy(&data[len], CFG_GAP_LOCAL_NAME, name_len);
+      len += name_len;
+    }
+    break;
+
+    default: return ERROR_INVALIDPARAMETER;
+  }
+
+  ASSERT_STATUS( sd_ble_gap_adv_data_set(data, len, NULL, 0) );
+
+  return ERROR_NONE;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Moves on to the next frame of the rotation
+*/
+/**************************************************************************/
+static void beacon_rotate_handler(void * p_context)
+{
+  (void) p_context;
+
+  m_frame_idx = (m_frame_idx + 1) % m_frame_count;
+  btle_beacon_frame_t const * p_frame = &m_frames[m_frame_idx];
+
+  ASSERT_STATUS_RET_VOID( beacon_frame_set(p_frame) );
+  ASSERT_STATUS_RET_VOID( app_timer_start(m_rotate_timer_id, APP_TIMER_TICKS(p_frame->duration_ms, CFG_TIMER_PRESCALER), NULL) );
+}
@@ -0,0 +1,253 @@
+/**************************************************************************/
+/*!
+    @file     btle_conn_policy.c
+    @author   hathach (tinyusb.org)
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2014, K. Townsend (microBuilder.eu)
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+
+/* ---------------------------------------------------------------------- */
+/* INCLUDE				                                                        */
+/* ---------------------------------------------------------------------- */
+#include "common/common.h"
+#include "boards/board.h"
+
+#include "btle.h"
+#include "btle_gap.h"
+#include "btle_conn_policy.h"
+#include "btle_conn_params.h"
+
+/* ---------------------------------------------------------------------- */
+/* MACRO CONSTANT TYPEDEF                                                 */
+/* ---------------------------------------------------------------------- */
+#define MSEC_TO_1_25MSEC(ms)    ( ((ms)*4) / 5 )
+
+/* ---------------------------------------------------------------------- */
+/* INTERNAL OBJECT & FUNCTION DECLARATION                                 */
+/* ---------------------------------------------------------------------- */
+static ble_gap_conn_params_t const policy_params[] =
+{
+  [BTLE_CONN_POLICY_BURST] =
+  {
+      .min_conn_interval = MSEC_TO_1_25MSEC(CFG_GAP_POLICY_BURST_MIN_INTERVAL_MS) , // in 1.25ms unit
+      .max_conn_interval = MSEC_TO_1_25MSEC(CFG_GAP_POLICY_BURST_MAX_INTERVAL_MS) , // in 1.25ms unit
+      .slave_latency     = 0                                                       ,
+      .conn_sup_timeout  = CFG_GAP_CONNECTION_SUPERVISION_TIMEOUT_MS / 10            // in 10ms unit
+  },
+
+  [BTLE_CONN_POLICY_IDLE] =
+  {
+      .min_conn_interval = MSEC_TO_1_25MSEC(CFG_GAP_POLICY_IDLE_MIN_INTERVAL_MS)  , // in 1.25ms unit
+      .max_conn_interval = MSEC_TO_1_25MSEC(CFG_GAP_POLICY_IDLE_MAX_INTERVAL_MS)  , // in 1.25ms unit
+      .slave_latency     = CFG_GAP_POLICY_IDLE_SLAVE_LATENCY                       ,
+      .conn_sup_timeout  = CFG_GAP_CONNECTION_SUPERVISION_TIMEOUT_MS / 10            // in 10ms unit
+  }
+};
+
+static app_timer_id_t           m_window_timer_id;
+static btle_conn_policy_state_t m_state;        /* last state requested from the central   */
+static btle_conn_policy_state_t m_wanted;       /* state the traffic asks for              */
+static uint32_t                 m_window_bytes; /* traffic in the current window           */
+static bool                     m_is_backlogged;
+static uint8_t                  m_quiet_windows;  /* consecutive windows below the idle rate */
+static uint32_t                 m_since_update_ms;
+static btle_conn_policy_stats_t m_stats;
+
+static void policy_window_handler ( void * p_context );
+static void policy_apply          ( void );
+
+/* ---------------------------------------------------------------------- */
+/* IMPLEMENTATION											                                    */
+/* ---------------------------------------------------------------------- */
+
+/**************************************************************************/
+/*!
+    @brief      Initialises the connection parameter policy. It only
+                starts once btle_conn_params has settled, and both
+                parameter sets are kept within
+                CFG_GAP_CONNECTION_MIN/MAX_INTERVAL_MS so the central
+                sees one consistent range.
+
+    @returns
+*/
+/**************************************************************************/
+error_t btle_conn_policy_init(void)
+{
+  ASSERT_STATUS( app_timer_create(&m_window_timer_id, APP_TIMER_MODE_REPEATED, policy_window_handler) );
+
+  return ERROR_NONE;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Reports traffic over the link, called by the services
+
+    @param[in]  bytes          Payload bytes sent or received
+    @param[in]  is_backlogged  More data is waiting than could be sent
+                               (e.g. UART FIFO not drained, no TX buffers)
+*/
+/**************************************************************************/
+void btle_conn_policy_traffic(uint16_t bytes, bool is_backlogged)
+{
+  m_window_bytes  += bytes;
+  m_is_backlogged |= is_backlogged;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Callback handler for GAP events
+*/
+/**************************************************************************/
+void btle_conn_policy_handler(ble_evt_t * p_ble_evt)
+{
+  switch (p_ble_evt->header.evt_id)
+  {
+    case BLE_GAP_EVT_CONNECTED:
+      m_state           = BTLE_CONN_POLICY_DEFAULT;
+      m_wanted          = BTLE_CONN_POLICY_DEFAULT;
+      m_window_bytes    = 0;
+      m_is_backlogged   = false;
+      m_quiet_windows   = 0;
+      m_since_update_ms = 0; /* leave time for the initial PPCP negotiation */
+
+      ASSERT_STATUS_RET_VOID( app_timer_start(m_window_timer_id, APP_TIMER_TICKS(CFG_GAP_POLICY_WINDOW_MS, CFG_TIMER_PRESCALER), NULL) );
+    break;
+
+    case BLE_GAP_EVT_DISCONNECTED:
+      (void) app_timer_stop(m_window_timer_id);
+    break;
+
+    case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+    {
+      ble_gap_conn_params_t const * p_params = &p_ble_evt->evt.gap_evt.params.conn_param_update.conn_params;
+
+      if ( m_state != BTLE_CONN_POLICY_DEFAULT &&
+           p_params->max_conn_interval >= policy_params[m_state].min_conn_interval &&
+           p_params->max_conn_interval <= policy_params[m_state].max_conn_interval )
+      {
+        m_stats.accepted++;
+      }
+    }
+    break;
+
+    default: break;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief      Gets the state last requested from the central
+*/
+/**************************************************************************/
+btle_conn_policy_state_t btle_conn_policy_state(void)
+{
+  return m_state;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Gets the request counters since reset
+*/
+/**************************************************************************/
+btle_conn_policy_stats_t const * btle_conn_policy_stats(void)
+{
+  return &m_stats;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Runs at the end of every traffic window. A burst starts as
+                soon as the rate goes above CFG_GAP_POLICY_BURST_BPS (or
+                data backs up), but idle needs CFG_GAP_POLICY_IDLE_WINDOWS
+                quiet windows in a row below the lower CFG_GAP_POLICY_IDLE_BPS,
+                so the link does not flap on bursty traffic.
+*/
+/**************************************************************************/
+static void policy_window_handler(void * p_context)
+{
+  (void) p_context;
+
+  uint32_t const rate_bps = (m_window_bytes * 1000) / CFG_GAP_POLICY_WINDOW_MS;
+
+  if ( m_is_backlogged || rate_bps >= CFG_GAP_POLICY_BURST_BPS )
+  {
+    m_wanted        = BTLE_CONN_POLICY_BURST;
+    m_quiet_windows = 0;
+  }
+  else if ( rate_bps < CFG_GAP_POLICY_IDLE_BPS )
+  {
+    if ( m_quiet_windows < CFG_GAP_POLICY_IDLE_WINDOWS ) m_quiet_windows++;
+    if ( m_quiet_windows >= CFG_GAP_POLICY_IDLE_WINDOWS ) m_wanted = BTLE_CONN_POLICY_IDLE;
+  }
+  else
+  {
+    /* in between the two rates: keep whatever we have */
+    m_quiet_windows = 0;
+  }
+
+  m_window_bytes    = 0;
+  m_is_backlogged   = false;
+  if ( m_since_update_ms < CFG_GAP_POLICY_UPDATE_MIN_MS ) m_since_update_ms += CFG_GAP_POLICY_WINDOW_MS;
+
+  policy_apply();
+}
+
+/**************************************************************************/
+/*!
+    @brief      Requests the wanted parameters from the central, at most
+                once per CFG_GAP_POLICY_UPDATE_MIN_MS
+*/
+/**************************************************************************/
+static void policy_apply(void)
+{
+  if ( m_wanted == m_state || m_wanted == BTLE_CONN_POLICY_DEFAULT ) return;
+
+  /* the initial negotiation (with its fallbacks) goes first */
+  if ( !btle_conn_params_is_settled() || m_since_update_ms < CFG_GAP_POLICY_UPDATE_MIN_MS )
+  {
+    m_stats.deferred++;
+    return;
+  }
+
+  uint32_t const err = sd_ble_gap_conn_param_update(btle_gap_get_connection(), &policy_params[m_wanted]);
+
+  if ( err == NRF_ERROR_BUSY )
+  {
+    /* a procedure is already running, try again next window */
+    m_stats.deferred++;
+    return;
+  }
+  ASSERT_STATUS_RET_VOID( err );
+
+  m_state           = m_wanted;
+  m_since_update_ms = 0;
+  m_stats.requested++;
+}
@@ -0,0 +1,78 @@
+/**************************************************************************/
+/*!
+    @file     btle_conn_policy.h
+    @author   hathach (tinyusb.org)
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2014, K. Townsend (microBuilder.eu)
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+
+/** \ingroup TBD
+ *  \defgroup TBD
+ *  \brief TBD
+ *
+ *  @{
+ */
+
+#ifndef _BTLE_CONN_POLICY_H_
+#define _BTLE_CONN_POLICY_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include "common/common.h"
+#include "ble.h"
+
+typedef enum {
+  BTLE_CONN_POLICY_DEFAULT = 0, ///< whatever was negotiated on connection (PPCP)
+  BTLE_CONN_POLICY_BURST,       ///< short interval, no slave latency
+  BTLE_CONN_POLICY_IDLE         ///< long interval with slave latency
+} btle_conn_policy_state_t;
+
+typedef struct {
+  uint16_t requested;   ///< connection parameter updates sent to the central
+  uint16_t deferred;    ///< changes held back by the rate cap (or a busy SoftDevice)
+  uint16_t accepted;    ///< updates the central applied
+} btle_conn_policy_stats_t;
+
+error_t  btle_conn_policy_init    ( void );
+void     btle_conn_policy_handler ( ble_evt_t * p_ble_evt );
+void     btle_conn_policy_traffic ( uint16_t bytes, bool is_backlogged );
+btle_conn_policy_state_t         btle_conn_policy_state ( void );
+btle_conn_policy_stats_t const * btle_conn_policy_stats ( void );
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _BTLE_CONN_POLICY_H_ */
+
+/** @} */
@@ -37,12 +37,11 @@
 #include "common/common.h"
 #include "boards/board.h"
 #include "ble_gap.h"
-#include "ble_conn_params.h"
+#include "btle_conn_params.h"
 
 static uint16_t m_conn_handle = BLE_CONN_HANDLE_INVALID;
 
 static inline uint32_t msec_to_1_25msec ( uint32_t interval_ms ) ATTR_ALWAYS_INLINE ATTR_CONST;
-static void            error_callback   ( uint32_t nrf_error );
 
 /**************************************************************************/
 /*!
@@ -72,27 +71,8 @@ error_t btle_gap_init(void)
   ASSERT_STATUS( sd_ble_gap_ppcp_set(&gap_conn_params) );
   ASSERT_STATUS( sd_ble_gap_tx_power_set(CFG_BLE_TX_POWER_LEVEL) );
 
-  enum {
-    FIRST_UPDATE_DELAY = APP_TIMER_TICKS(5000, CFG_TIMER_PRESCALER),
-    NEXT_UPDATE_DELAY  = APP_TIMER_TICKS(5000, CFG_TIMER_PRESCALER),
-    MAX_UPDATE_COUNT   = 3
-  };
-
-  /* Set ble_conn_params_init_t params ... */
-  ble_conn_params_init_t cp_init =
-  {
-      .p_conn_params                  = NULL                    ,
-      .first_conn_params_update_delay = FIRST_UPDATE_DELAY      ,
-      .next_conn_params_update_delay  = NEXT_UPDATE_DELAY       ,
-      .max_conn_params_update_count   = MAX_UPDATE_COUNT        ,
-      .start_on_notify_cccd_handle    = BLE_GATT_HANDLE_INVALID ,
-      .disconnect_on_fail             = true                    ,
-      .evt_handler                    = NULL                    ,
-      .error_handler                  = error_callback
-  };
-
-  /* ... then pass them down to the SD  */
-  ASSERT_STATUS ( ble_conn_params_init(&cp_init) );
+  /* Negotiated after connecting, with fallback sets instead of a disconnect */
+  ASSERT_STATUS( btle_conn_params_init() );
 
   return ERROR_NONE;
 }
@@ -160,13 +140,3 @@ static inline uint32_t msec_to_1_25msec(uint32_t interval_ms)
 {
   return (interval_ms * 4) / 5 ;
 }
-
-/**************************************************************************/
-/*!
-    @brief      Callback handler when an error occurs
-*/
-/**************************************************************************/
-static void error_callback(uint32_t nrf_error)
-{
-  ASSERT_STATUS_RET_VOID( nrf_error );
-}
@@ -0,0 +1,719 @@
+/**************************************************************************/
+/*!
+    @file     btle_gattc.c
+    @author   hathach (tinyusb.org)
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2014, K. Townsend (microBuilder.eu)
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+
+
+/* ---------------------------------------------------------------------- */
+/* INCLUDE				                                                        */
+/* ---------------------------------------------------------------------- */
+#include "common/common.h"
+
+#if CFG_BLE_GATTC
+
+#include "btle.h"
+#include "btle_gattc.h"
+#include "pstorage.h"
+#include "ble_bondmngr_cfg.h"
+
+/* ---------------------------------------------------------------------- */
+/* MACRO CONSTANT TYPEDEF                                                 */
+/* ---------------------------------------------------------------------- */
+#define GATTC_CACHE_VALID   0x47415454UL  /* 'GATT', 0xFFFFFFFF = blank block, 0 = invalidated */
+#define GATTC_CCCD_INDICATE 0x0002
+
+/* One discovery step runs at a time, the SoftDevice allows a single
+ * GATT client procedure per connection */
+typedef enum
+{
+  GATTC_STATE_IDLE = 0,
+  GATTC_STATE_SERVICE,    /* primary service discovery by UUID */
+  GATTC_STATE_CHARS,      /* characteristics of m_service */
+  GATTC_STATE_DESCS,      /* CCCD of m_char */
+  GATTC_STATE_SC_CCCD     /* enabling the Service Changed indication */
+} gattc_state_t;
+
+/* Flash image of the handles of one bonded central, one pstorage block per
+ * bond manager central handle. A block is written once: invalidating it
+ * clears the state word (flash bits only go from 1 to 0), refilling it
+ * means clearing the whole module first. */
+typedef struct
+{
+  uint32_t                 state;
+  uint16_t                 layout;      /* registered UUIDs, catches firmware updates */
+  uint16_t                 char_count;
+  ble_gattc_handle_range_t ranges[CFG_BLE_GATTC_SERVICES+1];
+  btle_gattc_char_t        chars[CFG_BLE_GATTC_CHARS+1];
+} gattc_cache_record_t;
+
+/* ---------------------------------------------------------------------- */
+/* INTERNAL OBJECT & FUNCTION DECLARATION                                 */
+/* ---------------------------------------------------------------------- */
+/* Slot 0 is the central's GATT service, for the Service Changed indication */
+static ble_uuid_t const       m_sc_uuid = { .uuid = BLE_UUID_GATT_CHARACTERISTIC_SERVICE_CHANGED, .type = BLE_UUID_TYPE_BLE };
+static btle_gattc_char_t      m_sc_char;
+static btle_gattc_service_t   m_gatt_service =
+{
+  .uuid       = { .uuid = BLE_UUID_GATT, .type = BLE_UUID_TYPE_BLE },
+  .char_uuids = &m_sc_uuid,
+  .chars      = &m_sc_char,
+  .char_count = 1
+};
+
+static btle_gattc_service_t * m_services[CFG_BLE_GATTC_SERVICES+1] = { &m_gatt_service };
+static uint8_t                m_service_count = 1;
+static uint8_t                m_char_total    = 1;
+
+static uint16_t               m_conn_handle    = BLE_CONN_HANDLE_INVALID;
+static int8_t                 m_central_handle = INVALID_CENTRAL_HANDLE;
+static gattc_state_t          m_state          = GATTC_STATE_IDLE;
+static uint8_t                m_service;       /* index into m_services */
+static uint8_t                m_char;          /* index into the service's chars */
+static uint32_t               m_notifiable;    /* chars of m_service with notify/indicate, bit per index */
+static bool                   m_from_cache;
+
+#if CFG_BLE_GATTC_CACHE
+static pstorage_handle_t      m_cache_handle;
+static gattc_cache_record_t   m_record;        /* pstorage_store() source, left alone until it is written */
+static bool                   m_store_pending = false;
+static uint32_t               m_invalid_state = 0; /* pstorage_store() source */
+#endif
+
+static void    gattc_service_start ( uint8_t service );
+static void    gattc_chars_next    ( uint16_t start_handle );
+static void    gattc_descs_next    ( uint16_t start_handle );
+static void    gattc_char_next     ( void );
+static void    gattc_finish        ( void );
+static void    gattc_reset_handles ( void );
+static void    gattc_report        ( void );
+
+static void    gattc_prim_srvc_disc_rsp ( ble_gattc_evt_t const * p_gattc_evt );
+static void    gattc_char_disc_rsp      ( ble_gattc_evt_t const * p_gattc_evt );
+static void    gattc_desc_disc_rsp      ( ble_gattc_evt_t const * p_gattc_evt );
+
+#if CFG_BLE_GATTC_CACHE
+static bool    gattc_cache_load       ( int8_t central_handle );
+static void    gattc_cache_store      ( int8_t central_handle );
+static void    gattc_cache_invalidate ( int8_t central_handle );
+static void    gattc_cache_cb         ( pstorage_handle_t * p_handle, uint8_t op_code, uint32_t result, uint8_t * p_data, uint32_t data_len );
+#endif
+
+static inline bool uuid_equal(ble_uuid_t const * p_a, ble_uuid_t const * p_b) ATTR_ALWAYS_INLINE ATTR_PURE;
+static inline bool uuid_equal(ble_uuid_t const * p_a, ble_uuid_t const * p_b)
+{
+  return (p_a->uuid == p_b->uuid) && (p_a->type == p_b->type);
+}
+
+/* ---------------------------------------------------------------------- */
+/* IMPLEMENTATION											                                    */
+/* ---------------------------------------------------------------------- */
+
+/**************************************************************************/
+/*!
+    @brief      Initialises the GATT client, after pstorage_init() and
+                before the client modules register their services
+*/
+/**************************************************************************/
+error_t btle_gattc_init(void)
+{
+#if CFG_BLE_GATTC_CACHE
+  pstorage_module_param_t param =
+  {
+    .cb          = gattc_cache_cb,
+    .block_size  = sizeof(gattc_cache_record_t),
+    .block_count = BLE_BONDMNGR_MAX_BONDED_CENTRALS
+  };
+
+  ASSERT_STATUS( pstorage_register(&param, &m_cache_handle) );
+#endif
+
+  return ERROR_NONE;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Registers a service of the central, its handles are looked
+                up on every connection (or loaded from the cache of a
+                bonded central) and reported to its evt_handler
+
+    @note       The order of registration is part of the cache layout,
+                register at init, in the same order every time
+
+    @returns
+    @retval     ERROR_NONE            Everything executed normally
+    @retval     ERROR_NO_MEM          CFG_BLE_GATTC_SERVICES or
+                                      CFG_BLE_GATTC_CHARS is too small
+*/
+/**************************************************************************/
+error_t btle_gattc_service_register(btle_gattc_service_t * p_service)
+{
+  ASSERT( p_service->char_count <= 32, ERROR_INVALIDPARAMETER );
+  ASSERT( m_service_count < CFG_BLE_GATTC_SERVICES+1, ERROR_NO_MEM );
+  ASSERT( m_char_total + p_service->char_count <= CFG_BLE_GATTC_CHARS+1, ERROR_NO_MEM );
+
+  m_services[m_service_count++] = p_service;
+  m_char_total += p_service->char_count;
+
+  return ERROR_NONE;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Runs a full discovery of the registered services, without
+                the cache. Bonded centrals are handled automatically (see
+                btle_gattc_bond_handler), this is for links that are not
+                bonded.
+
+    @returns
+    @retval     ERROR_NONE            The discovery started
+    @retval     ERROR_INVALID_STATE   Not connected, or a discovery runs
+*/
+/**************************************************************************/
+error_t btle_gattc_discover(uint16_t conn_handle)
+{
+  ASSERT( conn_handle != BLE_CONN_HANDLE_INVALID && m_state == GATTC_STATE_IDLE, ERROR_INVALID_STATE );
+
+  m_conn_handle = conn_handle;
+  m_from_cache  = false;
+  gattc_reset_handles();
+  gattc_service_start(0);
+
+  return ERROR_NONE;
+}
+
+/**************************************************************************/
+/*!
+    @brief      true while a discovery runs, other GATT client procedures
+                would get NRF_ERROR_BUSY
+*/
+/**************************************************************************/
+bool btle_gattc_is_busy(void)
+{
+  return m_state != GATTC_STATE_IDLE;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Writes a CCCD of the central (write request, the
+                BLE_GATTC_EVT_WRITE_RSP tells when it is done)
+
+    @param[in]  value   BLE_GATT_HVX_NOTIFICATION, BLE_GATT_HVX_INDICATION
+                        or 0, the CCCD bits have the same values
+*/
+/**************************************************************************/
+error_t btle_gattc_cccd_write(uint16_t conn_handle, uint16_t cccd_handle, uint16_t value)
+{
+  ASSERT( cccd_handle != BLE_GATT_HANDLE_INVALID, ERROR_INVALIDPARAMETER );
+
+  uint8_t cccd[2];
+  (void) uint16_encode(value, cccd);
+
+  ble_gattc_write_params_t const write_params =
+  {
+    .write_op = BLE_GATT_OP_WRITE_REQ,
+    .handle   = cccd_handle,
+    .offset   = 0,
+    .len      = sizeof(cccd),
+    .p_value  = cccd
+  };
+
+  ASSERT_STATUS( sd_ble_gattc_write(conn_handle, &write_params) );
+
+  return ERROR_NONE;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Callback handler for the bond manager events: a bonded
+                central gets its handles from the cache once the link is
+                encrypted, a new bond is discovered (and cached) from
+                scratch
+*/
+/**************************************************************************/
+void btle_gattc_bond_handler(ble_bondmngr_evt_t * p_evt)
+{
+  if ( p_evt->central_handle < 0 || p_evt->central_handle >= BLE_BONDMNGR_MAX_BONDED_CENTRALS ) return;
+
+  switch ( p_evt->evt_type )
+  {
+    case BLE_BONDMNGR_EVT_CONN_TO_BONDED_CENTRAL:
+      m_central_handle = p_evt->central_handle;
+    break;
+
+    case BLE_BONDMNGR_EVT_NEW_BOND:
+      /* the handle may have belonged to a deleted bond */
+      m_central_handle = p_evt->central_handle;
+#if CFG_BLE_GATTC_CACHE
+      gattc_cache_invalidate(m_central_handle);
+#endif
+      (void) btle_gattc_discover(m_conn_handle);
+    break;
+
+    case BLE_BONDMNGR_EVT_ENCRYPTED:
+      m_central_handle = p_evt->central_handle;
+      if ( m_state != GATTC_STATE_IDLE ) break;
+
+#if CFG_BLE_GATTC_CACHE
+      if ( gattc_cache_load(m_central_handle) )
+      {
+        /* the central keeps our Service Changed CCCD with the bond */
+        m_from_cache = true;
+        gattc_report();
+        break;
+      }
+#endif
+      (void) btle_gattc_discover(m_conn_handle);
+    break;
+
+    default: break;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief      Callback handler for events from the SoftDevice, drives
+                the discovery and watches for Service Changed
+*/
+/**************************************************************************/
+void btle_gattc_handler(ble_evt_t * p_ble_evt)
+{
+  ble_gattc_evt_t const * p_gattc_evt = &p_ble_evt->evt.gattc_evt;
+
+  switch ( p_ble_evt->header.evt_id )
+  {
+    case BLE_GAP_EVT_CONNECTED:
+      m_conn_handle    = p_ble_evt->evt.gap_evt.conn_handle;
+      m_central_handle = INVALID_CENTRAL_HANDLE;
+    break;
+
+    case BLE_GAP_EVT_DISCONNECTED:
+      m_conn_handle    = BLE_CONN_HANDLE_INVALID;
+      m_central_handle = INVALID_CENTRAL_HANDLE;
+      m_state          = GATTC_STATE_IDLE;
+      gattc_reset_handles();
+    break;
+
+    case BLE_GATTC_EVT_PRIM_SRVC_DISC_RSP:
+      if ( m_state == GATTC_STATE_SERVICE ) gattc_prim_srvc_disc_rsp(p_gattc_evt);
+    break;
+
+    case BLE_GATTC_EVT_CHAR_DISC_RSP:
+      if ( m_state == GATTC_STATE_CHARS ) gattc_char_disc_rsp(p_gattc_evt);
+    break;
+
+    case BLE_GATTC_EVT_DESC_DISC_RSP:
+      if ( m_state == GATTC_STATE_DESCS ) gattc_desc_disc_rsp(p_gattc_evt);
+    break;
+
+    case BLE_GATTC_EVT_WRITE_RSP:
+      if ( m_state == GATTC_STATE_SC_CCCD ) gattc_finish();
+    break;
+
+    case BLE_GATTC_EVT_HVX:
+      if ( m_sc_char.value_handle != BLE_GATT_HANDLE_INVALID &&
+           p_gattc_evt->params.hvx.handle == m_sc_char.value_handle )
+      {
+        (void) sd_ble_gattc_hv_confirm(p_gattc_evt->conn_handle, p_gattc_evt->params.hvx.handle);
+
+#if CFG_BLE_GATTC_CACHE
+        if ( m_central_handle != INVALID_CENTRAL_HANDLE ) gattc_cache_invalidate(m_central_handle);
+#endif
+        for(uint8_t i=1; i<m_service_count; i++)
+        {
+          if ( m_services[i]->evt_handler != NULL ) m_services[i]->evt_handler(m_services[i], BTLE_GATTC_EVT_INVALIDATED);
+        }
+
+        /* a discovery in progress starts over */
+        m_state = GATTC_STATE_IDLE;
+        (void) btle_gattc_discover(p_gattc_evt->conn_handle);
+      }
+    break;
+
+    case BLE_GATTC_EVT_TIMEOUT:
+      m_state = GATTC_STATE_IDLE;
+    break;
+
+    default: break;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief      Looks up a service by UUID, or finishes once all of them
+                were looked up
+*/
+/**************************************************************************/
+static void gattc_service_start(uint8_t service)
+{
+  if ( service >= m_service_count )
+  {
+    /* ask the central to tell us when its handles change */
+    if ( m_sc_char.cccd_handle != BLE_GATT_HANDLE_INVALID &&
+         ERROR_NONE == btle_gattc_cccd_write(m_conn_handle, m_sc_char.cccd_handle, GATTC_CCCD_INDICATE) )
+    {
+      m_state = GATTC_STATE_SC_CCCD;
+    }
+    else
+    {
+      gattc_finish();
+    }
+    return;
+  }
+
+  m_service = service;
+  m_state   = GATTC_STATE_SERVICE;
+
+  if ( NRF_SUCCESS != sd_ble_gattc_primary_services_discover(m_conn_handle, 1, &m_services[service]->uuid) )
+  {
+    m_state = GATTC_STATE_IDLE;
+  }
+}
+
+static void gattc_prim_srvc_disc_rsp(ble_gattc_evt_t const * p_gattc_evt)
+{
+  btle_gattc_service_t * p_service = m_services[m_service];
+
+  if ( p_gattc_evt->gatt_status != BLE_GATT_STATUS_SUCCESS || p_gattc_evt->params.prim_srvc_disc_rsp.count == 0 )
+  {
+    gattc_service_start(m_service+1);
+    return;
+  }
+
+  p_service->handle_range = p_gattc_evt->params.prim_srvc_disc_rsp.services[0].handle_range;
+  m_notifiable = 0;
+  m_state      = GATTC_STATE_CHARS;
+  gattc_chars_next(p_service->handle_range.start_handle);
+}
+
+/**************************************************************************/
+/*!
+    @brief      Discovers the characteristics of m_service from start_handle
+                on, the SoftDevice returns a few per response
+*/
+/**************************************************************************/
+static void gattc_chars_next(uint16_t start_handle)
+{
+  btle_gattc_service_t * p_service = m_services[m_service];
+
+  if ( start_handle > p_service->handle_range.end_handle || start_handle == 0 )
+  {
+    /* all characteristics seen, now the CCCDs */
+    m_char  = 0;
+    m_state = GATTC_STATE_DESCS;
+    gattc_char_next();
+    return;
+  }
+
+  ble_gattc_handle_range_t const range = { .start_handle = start_handle, .end_handle = p_service->handle_range.end_handle };
+
+  if ( NRF_SUCCESS != sd_ble_gattc_characteristics_discover(m_conn_handle, &range) )
+  {
+    m_state = GATTC_STATE_IDLE;
+  }
+}
+
+static void gattc_char_disc_rsp(ble_gattc_evt_t const * p_gattc_evt)
+{
+  btle_gattc_service_t * p_service = m_services[m_service];
+  ble_gattc_evt_char_disc_rsp_t const * p_rsp = &p_gattc_evt->params.char_disc_rsp;
+
+  if ( p_gattc_evt->gatt_status != BLE_GATT_STATUS_SUCCESS || p_rsp->count == 0 )
+  {
+    gattc_chars_next(0);
+    return;
+  }
+
+  for(uint16_t i=0; i<p_rsp->count; i++)
+  {
+    for(uint8_t j=0; j<p_service->char_count; j++)
+    {
+      if ( uuid_equal(&p_rsp->chars[i].uuid, &p_service->char_uuids[j]) )
+      {
+        p_service->chars[j].value_handle = p_rsp->chars[i].handle_value;
+        if ( p_rsp->chars[i].char_props.notify || p_rsp->chars[i].char_props.indicate ) m_notifiable |= BIT(j);
+      }
+    }
+  }
+
+  gattc_chars_next(p_rsp->chars[p_rsp->count-1].handle_value + 1);
+}
+
+/**************************************************************************/
+/*!
+    @brief      Moves on to the next notifiable characteristic of
+                m_service that needs its CCCD, or to the next service
+*/
+/**************************************************************************/
+static void gattc_char_next(void)
+{
+  btle_gattc_service_t * p_service = m_services[m_service];
+
+  while ( m_char < p_service->char_count && !BIT_TEST(m_notifiable, m_char) ) m_char++;
+
+  if ( m_char >= p_service->char_count )
+  {
+    gattc_service_start(m_service+1);
+    return;
+  }
+
+  gattc_descs_next(p_service->chars[m_char].value_handle + 1);
+}
+
+static void gattc_descs_next(uint16_t start_handle)
+{
+  btle_gattc_service_t * p_service = m_services[m_service];
+
+  if ( start_handle > p_service->handle_range.end_handle )
+  {
+    m_char++;
+    gattc_char_next();
+    return;
+  }
+
+  ble_gattc_handle_range_t const range = { .start_handle = start_handle, .end_handle = p_service->handle_range.end_handle };
+
+  if ( NRF_SUCCESS != sd_ble_gattc_descriptors_discover(m_conn_handle, &range) )
+  {
+    m_state = GATTC_STATE_IDLE;
+  }
+}
+
+static void gattc_desc_disc_rsp(ble_gattc_evt_t const * p_gattc_evt)
+{
+  btle_gattc_service_t * p_service = m_services[m_service];
+  ble_gattc_evt_desc_disc_rsp_t const * p_rsp = &p_gattc_evt->params.desc_disc_rsp;
+
+  if ( p_gattc_evt->gatt_status != BLE_GATT_STATUS_SUCCESS || p_rsp->count == 0 )
+  {
+    m_char++;
+    gattc_char_next();
+    return;
+  }
+
+  for(uint16_t i=0; i<p_rsp->count; i++)
+  {
+    if ( p_rsp->descs[i].uuid.type != BLE_UUID_TYPE_BLE ) continue;
+
+    /* the descriptors end where the next characteristic is declared */
+    if ( p_rsp->descs[i].uuid.uuid == BLE_UUID_DESCRIPTOR_CLIENT_CHAR_CONFIG ||
+         p_rsp->descs[i].uuid.uuid == BLE_UUID_CHARACTERISTIC )
+    {
+      if ( p_rsp->descs[i].uuid.uuid == BLE_UUID_DESCRIPTOR_CLIENT_CHAR_CONFIG )
+      {
+        p_service->chars[m_char].cccd_handle = p_rsp->descs[i].handle;
+      }
+
+      m_char++;
+      gattc_char_next();
+      return;
+    }
+  }
+
+  gattc_descs_next(p_rsp->descs[p_rsp->count-1].handle + 1);
+}
+
+/**************************************************************************/
+/*!
+    @brief      The discovery is complete: caches the handles of a bonded
+                central and tells the client modules
+*/
+/**************************************************************************/
+static void gattc_finish(void)
+{
+  m_state = GATTC_STATE_IDLE;
+
+#if CFG_BLE_GATTC_CACHE
+  if ( m_central_handle != INVALID_CENTRAL_HANDLE ) gattc_cache_store(m_central_handle);
+#endif
+
+  gattc_report();
+}
+
+static void gattc_report(void)
+{
+#if CFG_DEBUG
+  printf("gattc: %u service(s) %s" CFG_PRINTF_NEWLINE, m_service_count-1, m_from_cache ? "from cache" : "discovered");
+#endif
+
+  for(uint8_t i=1; i<m_service_count; i++)
+  {
+    btle_gattc_service_t * p_service = m_services[i];
+    if ( p_service->evt_handler == NULL ) continue;
+
+    p_service->evt_handler(p_service, (p_service->handle_range.start_handle != BLE_GATT_HANDLE_INVALID) ?
+                                        BTLE_GATTC_EVT_DISCOVERED : BTLE_GATTC_EVT_NOT_FOUND);
+  }
+}
+
+static void gattc_reset_handles(void)
+{
+  for(uint8_t i=0; i<m_service_count; i++)
+  {
+    btle_gattc_service_t * p_service = m_services[i];
+
+    memclr_(&p_service->handle_range, sizeof(ble_gattc_handle_range_t));
+    memclr_(p_service->chars, p_service->char_count*sizeof(btle_gattc_char_t));
+  }
+}
+
+#if CFG_BLE_GATTC_CACHE
+/**************************************************************************/
+/*!
+    @brief      Hash of the registered UUIDs, a cache written by a firmware
+                with other services does not match
+*/
+/**************************************************************************/
+static uint16_t gattc_layout(void)
+{
+  uint16_t layout = m_char_total;
+
+  for(uint8_t i=0; i<m_service_count; i++)
+  {
+    layout = (uint16_t) (layout*31 + m_services[i]->uuid.uuid + m_services[i]->uuid.type);
+
+    for(uint8_t j=0; j<m_services[i]->char_count; j++)
+    {
+      layout = (uint16_t) (layout*31 + m_services[i]->char_uuids[j].uuid + m_services[i]->char_uuids[j].type);
+    }
+  }
+
+  return layout;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Fills the registered services with the cached handles of
+                a bonded central
+
+    @returns    false if there is no valid cache for the central
+*/
+/**************************************************************************/
+static bool gattc_cache_load(int8_t central_handle)
+{
+  if ( m_store_pending ) return false;
+
+  pstorage_handle_t block;
+  if ( NRF_SUCCESS != pstorage_block_identifier_get(&m_cache_handle, central_handle, &block) ) return false;
+  if ( NRF_SUCCESS != pstorage_load((uint8_t*) &m_record, &block, sizeof(gattc_cache_record_t), 0) ) return false;
+
+  if ( m_record.state != GATTC_CACHE_VALID || m_record.layout != gattc_layout() || m_record.char_count != m_char_total )
+  {
+    return false;
+  }
+
+  btle_gattc_char_t const * p_char = m_record.chars;
+  for(uint8_t i=0; i<m_service_count; i++)
+  {
+    m_services[i]->handle_range = m_record.ranges[i];
+    memcpy(m_services[i]->chars, p_char, m_services[i]->char_count*sizeof(btle_gattc_char_t));
+    p_char += m_services[i]->char_count;
+  }
+
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Writes the handles just discovered to the central's block,
+                clearing the module first if the block was used before
+*/
+/**************************************************************************/
+static void gattc_cache_store(int8_t central_handle)
+{
+  if ( m_store_pending ) return; /* m_record is still being written, discovered again next time */
+
+  pstorage_handle_t block;
+  if ( NRF_SUCCESS != pstorage_block_identifier_get(&m_cache_handle, central_handle, &block) ) return;
+
+  uint32_t state = 0;
+  if ( NRF_SUCCESS != pstorage_load((uint8_t*) &state, &block, sizeof(state), 0) ) return;
+
+  if ( state != 0xFFFFFFFFUL )
+  {
+    /* flash can not be rewritten in place, the other centrals discover again */
+    if ( NRF_SUCCESS != pstorage_clear(&m_cache_handle, sizeof(gattc_cache_record_t)*BLE_BONDMNGR_MAX_BONDED_CENTRALS) ) return;
+  }
+
+  m_record.state      = GATTC_CACHE_VALID;
+  m_record.layout     = gattc_layout();
+  m_record.char_count = m_char_total;
+
+  btle_gattc_char_t * p_char = m_record.chars;
+  for(uint8_t i=0; i<m_service_count; i++)
+  {
+    m_record.ranges[i] = m_services[i]->handle_range;
+    memcpy(p_char, m_services[i]->chars, m_services[i]->char_count*sizeof(btle_gattc_char_t));
+    p_char += m_services[i]->char_count;
+  }
+
+  if ( NRF_SUCCESS == pstorage_store(&block, (uint8_t*) &m_record, sizeof(gattc_cache_record_t), 0) )
+  {
+    m_store_pending = true;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief      Marks the cache of a central as stale by clearing its
+                state word, which needs no erase
+*/
+/**************************************************************************/
+static void gattc_cache_invalidate(int8_t central_handle)
+{
+  pstorage_handle_t block;
+  uint32_t state = 0;
+
+  if ( NRF_SUCCESS != pstorage_block_identifier_get(&m_cache_handle, central_handle, &block) ) return;
+  if ( NRF_SUCCESS != pstorage_load((uint8_t*) &state, &block, sizeof(state), 0) ) return;
+
+  if ( state == GATTC_CACHE_VALID )
+  {
+    (void) pstorage_store(&block, (uint8_t*) &m_invalid_state, sizeof(m_invalid_state), 0);
+  }
+}
+
+static void gattc_cache_cb(pstorage_handle_t * p_handle, uint8_t op_code, uint32_t result, uint8_t * p_data, uint32_t data_len)
+{
+  (void) p_handle;
+  (void) p_data;
+
+  if ( op_code == PSTORAGE_STORE_OP_CODE && data_len == sizeof(gattc_cache_record_t) )
+  {
+    m_store_pending = false;
+    ASSERT_STATUS_RET_VOID( result );
+  }
+}
+#endif /* CFG_BLE_GATTC_CACHE */
+
+#endif /* CFG_BLE_GATTC */
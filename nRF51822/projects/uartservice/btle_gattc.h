@@ -0,0 +1,98 @@
+/**************************************************************************/
+/*!
+    @file     btle_gattc.h
+    @author   hathach (tinyusb.org)
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2014, K. Townsend (microBuilder.eu)
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+
+
+/** \ingroup TBD
+ *  \defgroup TBD
+ *  \brief TBD
+ *
+ *  @{
+ */
+
+#ifndef _BTLE_GATTC_H_
+#define _BTLE_GATTC_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include "common/common.h"
+#include "ble.h"
+#include "ble_bondmngr.h"
+
+typedef enum
+{
+  BTLE_GATTC_EVT_DISCOVERED  = 0, ///< handles are valid (discovered, or loaded from the cache)
+  BTLE_GATTC_EVT_NOT_FOUND      , ///< the central does not have the service
+  BTLE_GATTC_EVT_INVALIDATED      ///< Service Changed, handles are stale until the next BTLE_GATTC_EVT_DISCOVERED
+} btle_gattc_evt_t;
+
+/** Handles of a discovered characteristic, 0 if not found */
+typedef struct
+{
+  uint16_t value_handle;
+  uint16_t cccd_handle;           ///< only looked up for notify/indicate characteristics
+} btle_gattc_char_t;
+
+struct btle_gattc_service_s;
+typedef void (*btle_gattc_evt_handler_t)(struct btle_gattc_service_s * p_service, btle_gattc_evt_t evt);
+
+/** A service of the central a client module uses, registered once at init */
+typedef struct btle_gattc_service_s
+{
+  ble_uuid_t                 uuid;
+  ble_uuid_t const *         char_uuids;    ///< characteristics to look up, char_count entries
+  btle_gattc_char_t *        chars;         ///< filled in by the discovery, char_count entries
+  uint8_t                    char_count;
+  btle_gattc_evt_handler_t   evt_handler;
+  ble_gattc_handle_range_t   handle_range;  ///< 0-0 if not found
+} btle_gattc_service_t;
+
+error_t btle_gattc_init             ( void );
+error_t btle_gattc_service_register ( btle_gattc_service_t * p_service );
+error_t btle_gattc_discover         ( uint16_t conn_handle );
+bool    btle_gattc_is_busy          ( void );
+error_t btle_gattc_cccd_write       ( uint16_t conn_handle, uint16_t cccd_handle, uint16_t value );
+void    btle_gattc_handler          ( ble_evt_t * p_ble_evt );
+void    btle_gattc_bond_handler     ( ble_bondmngr_evt_t * p_evt );
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _BTLE_GATTC_H_ */
+
+/** @} */
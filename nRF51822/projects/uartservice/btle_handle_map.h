@@ -0,0 +1,72 @@
+/**************************************************************************/
+/*!
+    @file     btle_handle_map.h
+    @author   hathach (tinyusb.org)
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2014, K. Townsend (microBuilder.eu)
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+
+/** \ingroup TBD
+ *  \defgroup TBD
+ *  \brief TBD
+ *
+ *  @{
+ */
+
+#ifndef _BTLE_HANDLE_MAP_H_
+#define _BTLE_HANDLE_MAP_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include "common/common.h"
+#include "ble.h"
+
+/** Callback of a characteristic, for the write, HVC and authorize events
+ *  on any of its handles (value, CCCD, ...)
+ *
+ *  @param[in]  p_ble_evt   The event
+ *  @param[in]  handle      The attribute handle the event is about
+ *  @param[in]  p_context   As given to btle_handle_map_add()
+ */
+typedef void (*btle_handle_map_cb_t)(ble_evt_t * p_ble_evt, uint16_t handle, void * p_context);
+
+error_t btle_handle_map_add      ( ble_gatts_char_handles_t const * p_handles, btle_handle_map_cb_t callback, void * p_context );
+bool    btle_handle_map_dispatch ( ble_evt_t * p_ble_evt );
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _BTLE_HANDLE_MAP_H_ */
+
+/** @} */
@@ -0,0 +1,190 @@
+/**************************************************************************/
+/*!
+    @file     btle_sys_attr.c
+    @author   hathach (tinyusb.org)
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2014, K. Townsend (microBuilder.eu)
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+
+/* ---------------------------------------------------------------------- */
+/* INCLUDE				                                                        */
+/* ---------------------------------------------------------------------- */
+#include "common/common.h"
+#include "boards/board.h"
+
+#include "btle.h"
+#include "btle_sys_attr.h"
+#include "btle_timeline.h"
+
+/* ---------------------------------------------------------------------- */
+/* INTERNAL OBJECT & FUNCTION DECLARATION                                 */
+/* ---------------------------------------------------------------------- */
+static uint16_t              m_conn_handle = BLE_CONN_HANDLE_INVALID;
+static ble_gap_addr_t        m_conn_addr;
+static bool                  m_is_encrypted;
+static bool                  m_is_set;
+
+/* System attributes of the last encrypted (i.e. bonded) central */
+static ble_gap_addr_t        m_cache_addr;
+static uint8_t               m_cache_data[CFG_BLE_SYS_ATTR_CACHE_SIZE];
+static uint16_t              m_cache_len;
+
+static btle_sys_attr_stats_t m_stats;
+
+static void sys_attr_set   ( uint8_t const * p_data, uint16_t len );
+static void sys_attr_cache ( void );
+
+/* ---------------------------------------------------------------------- */
+/* IMPLEMENTATION											                                    */
+/* ---------------------------------------------------------------------- */
+
+/**************************************************************************/
+/*!
+    @brief      Callback handler for GAP & GATTS events, must be called
+                before the bond manager.
+
+                The bond manager only restores the system attributes of a
+                bonded central once the link is encrypted, and leaves an
+                unknown central with none until it accesses a CCCD. Until
+                then every notification fails with
+                BLE_ERROR_GATTS_SYS_ATTR_MISSING. Instead they are set on
+                connect: from the cache when the last bonded central comes
+                back with the same address, empty otherwise. The bond
+                manager overwrites them from flash when encryption starts,
+                as before.
+*/
+/**************************************************************************/
+void btle_sys_attr_handler(ble_evt_t * p_ble_evt)
+{
+  switch (p_ble_evt->header.evt_id)
+  {
+    case BLE_GAP_EVT_CONNECTED:
+    {
+      ble_gap_addr_t const * p_addr = &p_ble_evt->evt.gap_evt.params.connected.peer_addr;
+
+      m_conn_handle  = p_ble_evt->evt.gap_evt.conn_handle;
+      m_conn_addr    = *p_addr;
+      m_is_encrypted = false;
+      m_is_set       = false;
+
+      /* a resolvable private address changes, it can only be matched after encryption */
+      if ( m_cache_len > 0 && p_addr->addr_type != BLE_GAP_ADDR_TYPE_RANDOM_PRIVATE_RESOLVABLE &&
+           0 == memcmp(p_addr, &m_cache_addr, sizeof(ble_gap_addr_t)) )
+      {
+        sys_attr_set(m_cache_data, m_cache_len);
+        m_stats.restored++;
+      }
+      else
+      {
+        sys_attr_set(NULL, 0);
+        m_stats.cleared++;
+      }
+    }
+    break;
+
+    case BLE_GAP_EVT_CONN_SEC_UPDATE:
+      /* bond manager restores its flash copy in this same event */
+      m_is_encrypted = (p_ble_evt->evt.gap_evt.params.conn_sec_update.conn_sec.sec_mode.lv >= 2);
+    break;
+
+    case BLE_GATTS_EVT_SYS_ATTR_MISSING:
+      /* should not happen anymore, the bond manager answers it anyway */
+      m_is_set = true;
+    break;
+
+    case BLE_GAP_EVT_DISCONNECTED:
+      if ( m_is_encrypted ) sys_attr_cache();
+
+      m_conn_handle = BLE_CONN_HANDLE_INVALID;
+      m_is_set      = false;
+    break;
+
+    default: break;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief      Checks if the current connection has its system attributes,
+                i.e. notifications can no longer fail with
+                BLE_ERROR_GATTS_SYS_ATTR_MISSING
+*/
+/**************************************************************************/
+bool btle_sys_attr_is_set(void)
+{
+  return m_is_set;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Gets how connections started since reset
+*/
+/**************************************************************************/
+btle_sys_attr_stats_t const * btle_sys_attr_stats(void)
+{
+  return &m_stats;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Sets the system attributes of the current connection
+*/
+/**************************************************************************/
+static void sys_attr_set(uint8_t const * p_data, uint16_t len)
+{
+  ASSERT_STATUS_RET_VOID( sd_ble_gatts_sys_attr_set(m_conn_handle, p_data, len) );
+
+  m_is_set = true;
+  btle_timeline_mark(BTLE_TIMELINE_SYS_ATTR);
+}
+
+/**************************************************************************/
+/*!
+    @brief      Keeps the system attributes of a bonded central for its
+                next connection. The connection handle is still valid in
+                the disconnected event.
+*/
+/**************************************************************************/
+static void sys_attr_cache(void)
+{
+  uint16_t len = sizeof(m_cache_data);
+
+  if ( NRF_SUCCESS == sd_ble_gatts_sys_attr_get(m_conn_handle, m_cache_data, &len) )
+  {
+    m_cache_addr = m_conn_addr;
+    m_cache_len  = len;
+  }
+  else
+  {
+    /* does not fit (or nothing to keep): the bond manager takes over on encryption */
+    m_cache_len = 0;
+  }
+}
@@ -0,0 +1,255 @@
+/**************************************************************************/
+/*!
+    @file     btle_tx_power.c
+    @author   hathach (tinyusb.org)
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2014, K. Townsend (microBuilder.eu)
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+
+/* ---------------------------------------------------------------------- */
+/* INCLUDE				                                                        */
+/* ---------------------------------------------------------------------- */
+#include "common/common.h"
+#include "boards/board.h"
+
+#include "btle.h"
+#include "btle_clock.h"
+#include "btle_rssi.h"
+#include "btle_tx_power.h"
+
+/* ---------------------------------------------------------------------- */
+/* MACRO CONSTANT TYPEDEF                                                 */
+/* ---------------------------------------------------------------------- */
+#define TX_POWER_BAND_LOW   ( CFG_BLE_TX_POWER_CTRL_TARGET_DBM - CFG_BLE_TX_POWER_CTRL_HYSTERESIS_DB )
+#define TX_POWER_BAND_HIGH  ( CFG_BLE_TX_POWER_CTRL_TARGET_DBM + CFG_BLE_TX_POWER_CTRL_HYSTERESIS_DB )
+
+/* ---------------------------------------------------------------------- */
+/* INTERNAL OBJECT & FUNCTION DECLARATION                                 */
+/* ---------------------------------------------------------------------- */
+static int8_t const tx_power_levels[BTLE_TX_POWER_LEVEL_COUNT] = { -40, -20, -16, -12, -8, -4, 0, 4 };
+
+static app_timer_id_t        m_ctrl_timer_id;
+static uint8_t               m_level;         /* index in tx_power_levels               */
+static uint8_t               m_level_max;     /* index of CFG_BLE_TX_POWER_LEVEL        */
+static uint16_t              m_peer_reports;  /* peer reports already acted upon        */
+static bool                  m_is_connected;
+static uint32_t              m_clock_ms;      /* btle_clock_ms() at the last update     */
+static btle_tx_power_stats_t m_stats;
+
+static void    tx_power_ctrl_handler ( void * p_context );
+static error_t tx_power_level_set    ( uint8_t level );
+static void    tx_power_clock_update ( void );
+
+/* ---------------------------------------------------------------------- */
+/* IMPLEMENTATION											                                    */
+/* ---------------------------------------------------------------------- */
+
+/**************************************************************************/
+/*!
+    @brief      Initialises the TX power controller. CFG_BLE_TX_POWER_LEVEL
+                is the ceiling, used as is for advertising and at the
+                start of every connection.
+
+    @returns
+*/
+/**************************************************************************/
+error_t btle_tx_power_init(void)
+{
+  for(m_level_max = 0; tx_power_levels[m_level_max] != CFG_BLE_TX_POWER_LEVEL; m_level_max++) { }
+  m_level = m_level_max;
+
+  ASSERT_STATUS( app_timer_create(&m_ctrl_timer_id, APP_TIMER_MODE_REPEATED, tx_power_ctrl_handler) );
+
+  return ERROR_NONE;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Callback handler for GAP events, must be called after
+                btle_rssi_handler()
+*/
+/**************************************************************************/
+void btle_tx_power_handler(ble_evt_t * p_ble_evt)
+{
+  switch (p_ble_evt->header.evt_id)
+  {
+    case BLE_GAP_EVT_CONNECTED:
+      m_peer_reports = 0;
+      m_is_connected = true;
+      m_clock_ms     = btle_clock_ms();
+
+      ASSERT_STATUS_RET_VOID( app_timer_start(m_ctrl_timer_id, APP_TIMER_TICKS(CFG_BLE_TX_POWER_CTRL_PERIOD_MS, CFG_TIMER_PRESCALER), NULL) );
+    break;
+
+    case BLE_GAP_EVT_DISCONNECTED:
+      (void) app_timer_stop(m_ctrl_timer_id);
+      tx_power_clock_update();
+      m_is_connected = false;
+
+#if CFG_DEBUG
+      printf("tx power:");
+      for(uint8_t i=0; i<BTLE_TX_POWER_LEVEL_COUNT; i++)
+      {
+        printf(" %d dBm %u ms,", tx_power_levels[i], (unsigned) m_stats.level_ms[i]);
+      }
+      printf(" %u up %u down" CFG_PRINTF_NEWLINE, m_stats.steps_up, m_stats.steps_down);
+#endif
+
+      /* back to full power so advertising keeps its range */
+      ASSERT_STATUS_RET_VOID( tx_power_level_set(m_level_max) );
+    break;
+
+    default: break;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief      Gets the current TX power in dBm
+*/
+/**************************************************************************/
+int8_t btle_tx_power_level(void)
+{
+  return tx_power_levels[m_level];
+}
+
+/**************************************************************************/
+/*!
+    @brief      Gets the TX power in dBm matching an index in
+                btle_tx_power_stats_t.level_ms
+*/
+/**************************************************************************/
+int8_t btle_tx_power_level_of(uint8_t index)
+{
+  return tx_power_levels[ min8_of(index, BTLE_TX_POWER_LEVEL_COUNT-1) ];
+}
+
+/**************************************************************************/
+/*!
+    @brief      Gets the time spent at each level and the step counters
+                since reset (only connections count, advertising always
+                uses CFG_BLE_TX_POWER_LEVEL)
+*/
+/**************************************************************************/
+btle_tx_power_stats_t const * btle_tx_power_stats(void)
+{
+  tx_power_clock_update();
+  return &m_stats;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Runs every CFG_BLE_TX_POWER_CTRL_PERIOD_MS while connected
+                and moves at most one level at a time.
+
+                The link budget is judged by the RSSI at the central:
+                - when the central writes it to the link quality service,
+                  each new report is used once
+                - otherwise it is estimated from our own RSSI, assuming a
+                  symmetric path and CFG_BLE_TX_POWER_CTRL_PEER_TX_DBM
+                  on the other side
+
+                The power goes up below TARGET - HYSTERESIS, and only goes
+                down when the link stays above TARGET + HYSTERESIS after
+                the step, so one step never undoes the previous one.
+*/
+/**************************************************************************/
+static void tx_power_ctrl_handler(void * p_context)
+{
+  (void) p_context;
+
+  if ( !btle_rssi_is_valid() ) return;
+
+  btle_rssi_stats_t const * p_rssi = btle_rssi_stats();
+  int16_t link_dbm;
+
+  if ( p_rssi->peer_reports != m_peer_reports )
+  {
+    m_peer_reports = p_rssi->peer_reports;
+    link_dbm       = p_rssi->peer;
+  }
+  else if ( m_peer_reports > 0 )
+  {
+    /* the central does report, wait for one made at the current level */
+    return;
+  }
+  else
+  {
+    link_dbm = tx_power_levels[m_level] + p_rssi->average - CFG_BLE_TX_POWER_CTRL_PEER_TX_DBM;
+  }
+
+  if ( link_dbm < TX_POWER_BAND_LOW && m_level < m_level_max )
+  {
+    ASSERT_STATUS_RET_VOID( tx_power_level_set(m_level+1) );
+    m_stats.steps_up++;
+  }
+  else if ( m_level > 0 && link_dbm - (tx_power_levels[m_level] - tx_power_levels[m_level-1]) >= TX_POWER_BAND_HIGH )
+  {
+    ASSERT_STATUS_RET_VOID( tx_power_level_set(m_level-1) );
+    m_stats.steps_down++;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief      Applies a level, the SoftDevice uses it from the next
+                connection (or advertising) event
+*/
+/**************************************************************************/
+static error_t tx_power_level_set(uint8_t level)
+{
+  if ( level == m_level ) return ERROR_NONE;
+
+  ASSERT_STATUS( sd_ble_gap_tx_power_set(tx_power_levels[level]) );
+
+  tx_power_clock_update();
+  m_level = level;
+
+  btle_rssi_tx_power_changed();
+
+  return ERROR_NONE;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Adds the time since the last update to the current level
+                (while connected only)
+*/
+/**************************************************************************/
+static void tx_power_clock_update(void)
+{
+  if ( !m_is_connected ) return;
+
+  uint32_t const now_ms = btle_clock_ms();
+
+  m_stats.level_ms[m_level] += now_ms - m_clock_ms;
+  m_clock_ms = now_ms;
+}
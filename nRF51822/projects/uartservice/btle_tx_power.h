@@ -0,0 +1,76 @@
+/**************************************************************************/
+/*!
+    @file     btle_tx_power.h
+    @author   hathach (tinyusb.org)
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2014, K. Townsend (microBuilder.eu)
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+
+/** \ingroup TBD
+ *  \defgroup TBD
+ *  \brief TBD
+ *
+ *  @{
+ */
+
+#ifndef _BTLE_TX_POWER_H_
+#define _BTLE_TX_POWER_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include "common/common.h"
+#include "ble.h"
+
+enum {
+  BTLE_TX_POWER_LEVEL_COUNT = 8 ///< -40, -20, -16, -12, -8, -4, 0, +4 dBm
+};
+
+typedef struct {
+  uint32_t level_ms[BTLE_TX_POWER_LEVEL_COUNT]; ///< time connected at each level, lowest level first
+  uint16_t steps_up;
+  uint16_t steps_down;
+} btle_tx_power_stats_t;
+
+error_t  btle_tx_power_init    ( void );
+void     btle_tx_power_handler ( ble_evt_t * p_ble_evt );
+int8_t   btle_tx_power_level   ( void );
+int8_t   btle_tx_power_level_of( uint8_t index );
+btle_tx_power_stats_t const * btle_tx_power_stats ( void );
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _BTLE_TX_POWER_H_ */
+
+/** @} */
@@ -41,6 +41,10 @@
 #include "custom_helper.h"
 #include "ble_srv_common.h"
 #include "btle_gap.h"
+#include "btle_conn_policy.h"
+#include "btle_timeline.h"
+#include "btle_handle_map.h"
+#include "btle_uart_stats.h"
 
 typedef struct
 {
@@ -53,6 +57,9 @@ typedef struct
 
 static uart_srvc_t m_uart_srvc;
 
+static void uart_in_char_handler  ( ble_evt_t * p_ble_evt, uint16_t handle, void * p_context );
+static void uart_out_char_handler ( ble_evt_t * p_ble_evt, uint16_t handle, void * p_context );
+
 /**************************************************************************/
 /*!
     @brief      Initialises the UART service, adding it to the SoftDevice
@@ -89,12 +96,18 @@ error_t uart_service_init(uint8_t uuid_base_type)
                                              &ble_uuid, send_properties,
                                              NULL, 1, BLE_UART_MAX_LENGTH,
                                              &m_uart_srvc.in_handle) );
+  ASSERT_STATUS( btle_handle_map_add(&m_uart_srvc.in_handle, uart_in_char_handler, NULL) );
 
   ble_uuid.uuid = BLE_UART_UUID_OUT;
   ASSERT_STATUS(custom_add_in_characteristic(m_uart_srvc.service_handle,
                                              &ble_uuid, (ble_gatt_char_props_t) {.write = 1},
                                              NULL, 1, BLE_UART_MAX_LENGTH,
                                              &m_uart_srvc.out_handle) );
+  ASSERT_STATUS( btle_handle_map_add(&m_uart_srvc.out_handle, uart_out_char_handler, NULL) );
+
+#if CFG_BLE_UART_STATS
+  ASSERT_STATUS( uart_stats_init(m_uart_srvc.service_handle, m_uart_srvc.uuid_type) );
+#endif
 
   return ERROR_NONE;
 }
@@ -104,7 +117,9 @@ error_t uart_service_init(uint8_t uuid_base_type)
     @brief      The service handler, which will be called every time
                 a BLE event arrives.  Anything particular to this service
                 should be handled here instead of in the higher level
-                generic BLE event handler.
+                generic BLE event handler. Events on the service's own
+                handles arrive through btle_handle_map_dispatch() instead,
+                see uart_in_char_handler() & uart_out_char_handler().
 
     @param[in]  p_ble_evt   A pointer to the BLE event data
 */
@@ -115,16 +130,6 @@ void uart_service_handler(ble_evt_t * p_ble_evt)
   {
 
 #if BLE_UART_SEND_INDICATION
-    /* Capture the 'indicate' confirmation from the central here */
-    case BLE_GATTS_EVT_HVC:
-      if( m_uart_srvc.in_handle.value_handle == p_ble_evt->evt.gatts_evt.params.hvc.handle )
-      {
-        /* Clear the flag and fire the indicate callback with success */
-        m_uart_srvc.is_indication_waiting = false;
-        uart_service_indicate_callback(true);
-      }
-    break;
-
     /* The is no attribute handle in timeout events, so we need to use   */
     /* is_indication_waiting to know if the timeout is from this service */
     case BLE_GATTS_EVT_TIMEOUT:
@@ -137,25 +142,82 @@ void uart_service_handler(ble_evt_t * p_ble_evt)
     break;
 #endif
 
-    /* Handle incoming data on the RXD characteristic */
+    default:
+    break;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief      Events on the 'IN' characteristic (TXD): the CCCD being
+                written, and the 'indicate' confirmation from the central
+
+    @param[in]  p_ble_evt   A pointer to the BLE event data
+    @param[in]  handle      The value or CCCD handle
+    @param[in]  p_context   Unused
+*/
+/**************************************************************************/
+static void uart_in_char_handler(ble_evt_t * p_ble_evt, uint16_t handle, void * p_context)
+{
+  (void) p_context;
+
+  switch (p_ble_evt->header.evt_id)
+  {
     case BLE_GATTS_EVT_WRITE:
     {
       ble_gatts_evt_write_t * p_evt_write = &p_ble_evt->evt.gatts_evt.params.write;
-      if ( p_evt_write->handle == m_uart_srvc.out_handle.value_handle )
+      if ( handle == m_uart_srvc.in_handle.cccd_handle && p_evt_write->len == 2 &&
+           ( ble_srv_is_notification_enabled(p_evt_write->data) || ble_srv_is_indication_enabled(p_evt_write->data) ) )
       {
-        if (uart_service_received_callback)
-        {
-          uart_service_received_callback(p_evt_write->data, p_evt_write->len);
-        }
+        btle_timeline_mark(BTLE_TIMELINE_CCCD_ENABLED);
       }
     }
     break;
 
+#if BLE_UART_SEND_INDICATION
+    /* Capture the 'indicate' confirmation from the central here */
+    case BLE_GATTS_EVT_HVC:
+      /* Clear the flag and fire the indicate callback with success */
+      m_uart_srvc.is_indication_waiting = false;
+      uart_service_indicate_callback(true);
+    break;
+#endif
+
     default:
     break;
   }
 }
 
+/**************************************************************************/
+/*!
+    @brief      Handles incoming data on the 'OUT' characteristic (RXD)
+
+    @param[in]  p_ble_evt   A pointer to the BLE event data
+    @param[in]  handle      The value handle
+    @param[in]  p_context   Unused
+*/
+/**************************************************************************/
+static void uart_out_char_handler(ble_evt_t * p_ble_evt, uint16_t handle, void * p_context)
+{
+  (void) p_context;
+  (void) handle;
+
+  if ( p_ble_evt->header.evt_id != BLE_GATTS_EVT_WRITE ) return;
+
+  ble_gatts_evt_write_t * p_evt_write = &p_ble_evt->evt.gatts_evt.params.write;
+
+  btle_conn_policy_traffic(p_evt_write->len, false);
+
+#if CFG_BLE_UART_STATS
+  uart_stats_received(p_evt_write->len);
+#endif
+
+  if (uart_service_received_callback)
+  {
+    uart_service_received_callback(p_evt_write->data, p_evt_write->len);
+  }
+}
+
 /**************************************************************************/
 /*!
     @brief      Helper function to send data out via the UART service,
@@ -186,7 +248,19 @@ error_t uart_service_send(uint8_t p_data[], uint16_t length)
   };
 
   m_uart_srvc.is_indication_waiting = true;
-  ASSERT_STATUS( sd_ble_gatts_hvx(conn_handle, &hvx_params) );
+
+  uint32_t const err = sd_ble_gatts_hvx(conn_handle, &hvx_params);
+
+  /* the link can not keep up, ask for a shorter connection interval */
+  btle_conn_policy_traffic(length, err == BLE_ERROR_NO_TX_BUFFERS);
+
+#if CFG_BLE_UART_STATS
+  uart_stats_sent(length, err);
+#endif
+
+  ASSERT_STATUS( err );
+
+  btle_timeline_mark(BTLE_TIMELINE_FIRST_NOTIFY);
 
   return ERROR_NONE;
 }
@@ -250,4 +324,7 @@ void uart_service_bridge_task(void* p_context)
   {
     (void) uart_service_send(buffer, i);
   }
+
+  /* a full buffer means there is more waiting in the UART FIFO */
+  if ( i == BLE_UART_MAX_LENGTH ) btle_conn_policy_traffic(0, true);
 }
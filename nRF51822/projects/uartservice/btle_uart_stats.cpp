@@ -0,0 +1,162 @@
+/**************************************************************************/
+/*!
+    @file     btle_uart_stats.cpp
+    @author   hathach (tinyusb.org)
+
+    @brief    Traffic counters of the UART service, a characteristic of
+              the service built with custom_characteristic.hpp
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2014, K. Townsend (microBuilder.eu)
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+
+
+/* ---------------------------------------------------------------------- */
+/* INCLUDE				                                                        */
+/* ---------------------------------------------------------------------- */
+#include "common/common.h"
+
+#if CFG_BLE_UART_STATS
+
+#include "btle_uart_stats.h"
+#include "btle_handle_map.h"
+#include "custom_characteristic.hpp"
+
+/* ---------------------------------------------------------------------- */
+/* MACRO CONSTANT TYPEDEF                                                 */
+/* ---------------------------------------------------------------------- */
+/* bytes sent, bytes received, sends refused with BLE_ERROR_NO_TX_BUFFERS */
+typedef custom::record<uint32_t, uint32_t, uint16_t> uart_stats_t;
+
+enum {
+  STATS_SENT = 0,
+  STATS_RECEIVED,
+  STATS_REFUSED
+};
+
+/* ---------------------------------------------------------------------- */
+/* INTERNAL OBJECT & FUNCTION DECLARATION                                 */
+/* ---------------------------------------------------------------------- */
+static custom::characteristic<uart_stats_t, custom::PROP_READ | custom::PROP_WRITE> m_stats_char;
+static uart_stats_t m_stats;
+
+static void uart_stats_write ( ble_evt_t * p_ble_evt, uint16_t handle, void * p_context );
+
+/* ---------------------------------------------------------------------- */
+/* IMPLEMENTATION											                                    */
+/* ---------------------------------------------------------------------- */
+
+/**************************************************************************/
+/*!
+    @brief      Adds the counters characteristic to the UART service,
+                called from uart_service_init()
+
+    @param[in]  service_handle  The UART service
+    @param[in]  uuid_type       The UUID type of the UART service base
+
+    @returns
+    @retval     ERROR_NONE        Everything executed normally.
+*/
+/**************************************************************************/
+error_t uart_stats_init(uint16_t service_handle, uint8_t uuid_type)
+{
+  memclr_(&m_stats, sizeof(uart_stats_t));
+
+  ble_uuid_t ble_uuid;
+  ble_uuid.uuid = BLE_UART_UUID_STATS;
+  ble_uuid.type = uuid_type;
+
+  ASSERT_STATUS( m_stats_char.add(service_handle, &ble_uuid, m_stats) );
+  ASSERT_STATUS( btle_handle_map_add(&m_stats_char.handles, uart_stats_write, NULL) );
+
+  return ERROR_NONE;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Counts a send of uart_service_send()
+
+    @param[in]  length    Bytes in the notification (or indication)
+    @param[in]  err       What sd_ble_gatts_hvx() returned
+*/
+/**************************************************************************/
+void uart_stats_sent(uint16_t length, uint32_t err)
+{
+  if ( err == NRF_SUCCESS )
+  {
+    custom::get<STATS_SENT>(m_stats) += length;
+  }
+  else if ( err == BLE_ERROR_NO_TX_BUFFERS )
+  {
+    custom::get<STATS_REFUSED>(m_stats)++;
+  }
+  else
+  {
+    return;
+  }
+
+  (void) m_stats_char.set(m_stats);
+}
+
+/**************************************************************************/
+/*!
+    @brief      Counts a write of the central to the 'OUT' characteristic
+
+    @param[in]  length    Bytes written
+*/
+/**************************************************************************/
+void uart_stats_received(uint16_t length)
+{
+  custom::get<STATS_RECEIVED>(m_stats) += length;
+  (void) m_stats_char.set(m_stats);
+}
+
+/**************************************************************************/
+/*!
+    @brief      A central writing the counters. The SoftDevice has already
+                stored the value: a full write is taken over into the RAM
+                copy, anything else (a partial write, a wrong length) is
+                overwritten again so that the attribute keeps matching it.
+*/
+/**************************************************************************/
+static void uart_stats_write(ble_evt_t * p_ble_evt, uint16_t handle, void * p_context)
+{
+  (void) handle;
+  (void) p_context;
+
+  if ( p_ble_evt->header.evt_id != BLE_GATTS_EVT_WRITE ) return;
+
+  if ( !m_stats_char.decode(&p_ble_evt->evt.gatts_evt.params.write, m_stats) )
+  {
+    (void) m_stats_char.set(m_stats);
+  }
+}
+
+#endif
@@ -0,0 +1,80 @@
+/**************************************************************************/
+/*!
+    @file     btle_uart_stats.h
+    @author   hathach (tinyusb.org)
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2014, K. Townsend (microBuilder.eu)
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+
+/** \ingroup TBD
+ *  \defgroup TBD
+ *  \brief TBD
+ *
+ *
+ *  @{
+ */
+
+#ifndef _BTLE_UART_STATS_H_
+#define _BTLE_UART_STATS_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include "common/common.h"
+#include "ble.h"
+
+/*=========================================================================
+    UART TRAFFIC COUNTERS
+    -----------------------------------------------------------------------
+    BLE_UART_UUID_STATS           The UUID fragment (UART service base)
+                                  for the counters char, read & write,
+                                  10 bytes little endian: bytes sent
+                                  (uint32), bytes received (uint32),
+                                  sends refused because the TX buffers
+                                  were full (uint16). A write sets the
+                                  counters, write zeros to restart them.
+                                  Writes of another length are undone.
+    -----------------------------------------------------------------------*/
+    #define BLE_UART_UUID_STATS             (4)
+/*=========================================================================*/
+
+error_t uart_stats_init     ( uint16_t service_handle, uint8_t uuid_type );
+void    uart_stats_sent     ( uint16_t length, uint32_t err );
+void    uart_stats_received ( uint16_t length );
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _BTLE_UART_STATS_H_ */
+
+/** @} */
@@ -5,6 +5,31 @@
 /**************************************************************************/
 
 #include "custom_helper.h"
+#include "btle_handle_map.h"
+#include "btle_clock.h"
+
+/* Characteristics whose value is computed when read (rd_auth) */
+typedef struct {
+  uint16_t              value_handle;
+  uint16_t              max_length;
+  custom_read_handler_t read_handler;
+  uint32_t              ttl_ms;
+  uint32_t              updated_ms;    ///< btle_clock_ms() of the last computation
+  bool                  valid;         ///< the attribute table holds a computed value
+} custom_lazy_char_t;
+
+static custom_lazy_char_t m_lazy_chars[CUSTOM_LAZY_CHAR_MAX];
+static uint8_t            m_lazy_char_count = 0;
+
+/* 128-bit bases already given to the SoftDevice, and the UUID type it returned */
+static ble_uuid128_t m_uuid_bases[CUSTOM_UUID_BASE_MAX];
+static uint8_t       m_uuid_types[CUSTOM_UUID_BASE_MAX];
+static uint8_t       m_uuid_base_count = 0;
+
+static error_t characteristic_add(uint16_t service_handle, ble_uuid_t* p_uuid, ble_gatt_char_props_t char_props,
+                                  uint8_t *p_data, uint16_t min_length, uint16_t max_length, uint8_t vloc,
+                                  bool rd_auth, ble_gatts_char_handles_t* p_char_handle);
+static void    lazy_char_handler(ble_evt_t * p_ble_evt, uint16_t handle, void * p_context);
 
 /**************************************************************************/
 /*!
@@ -15,6 +40,12 @@
                 adding the service's primary service via
                 'sd_ble_gatts_service_add'
 
+    @note       Services sharing a base share its UUID type (and the
+                SoftDevice slot), see custom_add_uuid128(). With a
+                literal, prefer custom_add_uuid128() and
+                CUSTOM_UUID128_LE(), which reverse the bytes at compile
+                time.
+
     @param[in]  p_uuid_base   A pointer to the 128-bit UUID array (8*16)
     
     @returns    The UUID type.
@@ -43,7 +74,6 @@
 uint8_t custom_add_uuid_base(uint8_t const * const p_uuid_base)
 {
   ble_uuid128_t base_uuid;
-  uint8_t uuid_type = 0;
 
   /* Reverse the bytes since ble_uuid128_t is LSB */
   for(uint8_t i=0; i<16; i++)
@@ -51,11 +81,60 @@ uint8_t custom_add_uuid_base(uint8_t const * const p_uuid_base)
     base_uuid.uuid128[i] = p_uuid_base[15-i];
   }
 
-  ASSERT_INT( ERROR_NONE, sd_ble_uuid_vs_add( &base_uuid, &uuid_type ), 0);
+  return custom_add_uuid128(&base_uuid);
+}
+
+/**************************************************************************/
+/*!
+    @brief      Adds a (little endian) base UUID to the SoftDevice, unless
+                it is already there: the SoftDevice only has a few vendor
+                specific UUID slots, services that share a base get the
+                same UUID type back.
+
+    @param[in]  p_base    The 128-bit base, bytes 12-13 are ignored (they
+                          hold the 16-bit UUID of each attribute)
+
+    @returns    The UUID type, 0 (BLE_UUID_TYPE_UNKNOWN) if the base
+                could not be added (registry or SoftDevice slots full)
+*/
+/**************************************************************************/
+uint8_t custom_add_uuid128(ble_uuid128_t const * p_base)
+{
+  ble_uuid128_t base = *p_base;
+  base.uuid128[12] = base.uuid128[13] = 0;
+
+  for(uint8_t i=0; i<m_uuid_base_count; i++)
+  {
+    if ( 0 == memcmp(&m_uuid_bases[i], &base, sizeof(ble_uuid128_t)) ) return m_uuid_types[i];
+  }
+
+  ASSERT( m_uuid_base_count < CUSTOM_UUID_BASE_MAX, 0 );
+
+  uint8_t uuid_type = 0;
+  ASSERT_INT( ERROR_NONE, sd_ble_uuid_vs_add( &base, &uuid_type ), 0);
+
+  m_uuid_bases[m_uuid_base_count] = base;
+  m_uuid_types[m_uuid_base_count] = uuid_type;
+  m_uuid_base_count++;
+
+#if CFG_DEBUG
+  printf("uuid: %u vendor base(s) registered" CFG_PRINTF_NEWLINE, m_uuid_base_count);
+#endif
 
   return uuid_type;
 }
 
+/**************************************************************************/
+/*!
+    @brief      Gets the number of distinct bases added so far, i.e. the
+                SoftDevice's vendor specific UUID slots in use
+*/
+/**************************************************************************/
+uint8_t custom_uuid_base_count(void)
+{
+  return m_uuid_base_count;
+}
+
 /**************************************************************************/
 /*!
 
@@ -98,6 +177,178 @@ error_t custom_decode_uuid_base(uint8_t const * const p_uuid_base, ble_uuid_t *
 error_t custom_add_in_characteristic(uint16_t service_handle, ble_uuid_t* p_uuid, ble_gatt_char_props_t char_props,
                                      uint8_t *p_data, uint16_t min_length, uint16_t max_length,
                                      ble_gatts_char_handles_t* p_char_handle)
+{
+  return characteristic_add(service_handle, p_uuid, char_props, p_data, min_length, max_length,
+                            BLE_GATTS_VLOC_STACK, false, p_char_handle);
+}
+
+/**************************************************************************/
+/*!
+    @brief      Adds a new characteristic whose value lives in application
+                RAM (BLE_GATTS_VLOC_USER) instead of the SoftDevice's
+                attribute table.
+
+                The SoftDevice reads and writes p_buffer directly, so an
+                update is a plain write to the buffer, without
+                sd_ble_gatts_value_set(), and sd_ble_gatts_hvx() with a
+                NULL p_data notifies whatever the buffer holds. Large
+                values (logs, calibration data) no longer take attribute
+                table space either.
+
+    @note       The buffer must stay valid for as long as the SoftDevice
+                runs (static or global), and the SoftDevice may read it
+                between two writes of a multi-byte update: update values
+                that must stay consistent from the same interrupt
+                priority as the BLE events, or atomically.
+
+    @param[in]  service_handle
+    @param[in]  p_uuid
+    @param[in]  char_props        The characteristic properties, as
+                                  defined by ble_gatt_char_props_t
+    @param[in]  p_buffer          Holds the value, max_length bytes,
+                                  starting with the initial value
+    @param[in]  min_length        Initial length
+    @param[in]  max_length        The maximum length of this characeristic
+    @param[in]  p_char_handle
+
+    @returns
+    @retval     ERROR_NONE        Everything executed normally
+*/
+/**************************************************************************/
+error_t custom_add_user_characteristic(uint16_t service_handle, ble_uuid_t* p_uuid, ble_gatt_char_props_t char_props,
+                                       uint8_t *p_buffer, uint16_t min_length, uint16_t max_length,
+                                       ble_gatts_char_handles_t* p_char_handle)
+{
+  ASSERT( p_buffer != NULL, ERROR_INVALIDPARAMETER );
+
+  return characteristic_add(service_handle, p_uuid, char_props, p_buffer, min_length, max_length,
+                            BLE_GATTS_VLOC_USER, false, p_char_handle);
+}
+
+/**************************************************************************/
+/*!
+    @brief      Adds a characteristic whose value is only computed when a
+                central reads it, for values that are expensive to keep
+                up to date (an ADC conversion, aggregated statistics) but
+                rarely read.
+
+                The value is read authorized (rd_auth): a read raises
+                BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST, read_handler computes
+                the value and sd_ble_gatts_rw_authorize_reply() stores and
+                returns it. Reads within ttl_ms of the last computation
+                are answered from the attribute table without calling
+                read_handler, as are the follow-up requests of a long read
+                (offset > 0), so all parts come from the same value.
+
+    @note       The read authorize requests arrive through
+                btle_handle_map_dispatch().
+
+    @param[in]  service_handle
+    @param[in]  p_uuid
+    @param[in]  char_props        The characteristic properties, as
+                                  defined by ble_gatt_char_props_t
+    @param[in]  max_length        The maximum length of the value, up to
+                                  CUSTOM_LAZY_VALUE_MAX
+    @param[in]  read_handler      Computes the value
+    @param[in]  ttl_ms            How long a computed value is served, 0
+                                  computes it on every read
+    @param[in]  p_char_handle
+
+    @returns
+    @retval     ERROR_NONE            Everything executed normally
+    @retval     ERROR_NO_MEM          CUSTOM_LAZY_CHAR_MAX reached
+*/
+/**************************************************************************/
+error_t custom_add_lazy_characteristic(uint16_t service_handle, ble_uuid_t* p_uuid, ble_gatt_char_props_t char_props,
+                                       uint16_t max_length, custom_read_handler_t read_handler, uint32_t ttl_ms,
+                                       ble_gatts_char_handles_t* p_char_handle)
+{
+  ASSERT( read_handler != NULL && max_length <= CUSTOM_LAZY_VALUE_MAX, ERROR_INVALIDPARAMETER );
+  ASSERT( m_lazy_char_count < CUSTOM_LAZY_CHAR_MAX, ERROR_NO_MEM );
+
+  /* variable length, empty until the first read */
+  ASSERT_STATUS( characteristic_add(service_handle, p_uuid, char_props, NULL, 0, max_length,
+                                    BLE_GATTS_VLOC_STACK, true, p_char_handle) );
+
+  custom_lazy_char_t * p_lazy = &m_lazy_chars[m_lazy_char_count];
+  p_lazy->value_handle = p_char_handle->value_handle;
+  p_lazy->max_length   = max_length;
+  p_lazy->read_handler = read_handler;
+  p_lazy->ttl_ms       = ttl_ms;
+  p_lazy->valid        = false;
+
+  ASSERT_STATUS( btle_handle_map_add(p_char_handle, lazy_char_handler, p_lazy) );
+  m_lazy_char_count++;
+
+  return ERROR_NONE;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Drops the cached value of a lazy characteristic, e.g.
+                when its source changed, the next read computes it again
+*/
+/**************************************************************************/
+void custom_lazy_invalidate(ble_gatts_char_handles_t const * p_char_handle)
+{
+  for(uint8_t i=0; i<m_lazy_char_count; i++)
+  {
+    if ( m_lazy_chars[i].value_handle == p_char_handle->value_handle ) m_lazy_chars[i].valid = false;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief      Answers a read of a lazy characteristic, computing the
+                value if the cached one is missing or too old
+*/
+/**************************************************************************/
+static void lazy_char_handler(ble_evt_t * p_ble_evt, uint16_t handle, void * p_context)
+{
+  custom_lazy_char_t * p_lazy = (custom_lazy_char_t *) p_context;
+
+  if ( p_ble_evt->header.evt_id != BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST ||
+       p_ble_evt->evt.gatts_evt.params.authorize_request.type != BLE_GATTS_AUTHORIZE_TYPE_READ ||
+       handle != p_lazy->value_handle )
+  {
+    return;
+  }
+
+  uint8_t value[CUSTOM_LAZY_VALUE_MAX];
+  ble_gatts_rw_authorize_reply_params_t reply =
+  {
+    .type = BLE_GATTS_AUTHORIZE_TYPE_READ,
+    .params.read.gatt_status = BLE_GATT_STATUS_SUCCESS,
+    .params.read.update      = 0 /* serve the attribute table */
+  };
+
+  uint32_t const now_ms = btle_clock_ms();
+  bool const     fresh  = p_lazy->valid && ( now_ms - p_lazy->updated_ms < p_lazy->ttl_ms );
+
+  if ( p_ble_evt->evt.gatts_evt.params.authorize_request.request.read.offset == 0 && !fresh )
+  {
+    reply.params.read.update = 1;
+    reply.params.read.offset = 0;
+    reply.params.read.len    = min16_of(p_lazy->read_handler(value, p_lazy->max_length), p_lazy->max_length);
+    reply.params.read.p_data = value;
+
+    p_lazy->updated_ms   = now_ms;
+    p_lazy->valid        = true;
+  }
+
+  ASSERT_STATUS_RET_VOID( sd_ble_gatts_rw_authorize_reply(p_ble_evt->evt.gatts_evt.conn_handle, &reply) );
+}
+
+/**************************************************************************/
+/*!
+    @brief      Adds a characteristic with its value in the given location
+                (BLE_GATTS_VLOC_STACK or BLE_GATTS_VLOC_USER), optionally
+                read authorized, the CCCD always lives in the stack
+*/
+/**************************************************************************/
+static error_t characteristic_add(uint16_t service_handle, ble_uuid_t* p_uuid, ble_gatt_char_props_t char_props,
+                                  uint8_t *p_data, uint16_t min_length, uint16_t max_length, uint8_t vloc,
+                                  bool rd_auth, ble_gatts_char_handles_t* p_char_handle)
 {
   /* Characteristic metadata */
   ble_gatts_attr_md_t cccd_md;
@@ -120,8 +371,9 @@ error_t custom_add_in_characteristic(uint16_t service_handle, ble_uuid_t* p_uuid
   /* Attribute declaration */
   ble_gatts_attr_md_t attr_md =
   {
-    .vloc = BLE_GATTS_VLOC_STACK,
-    .vlen = (min_length == max_length) ? 0 : 1
+    .vloc    = vloc,
+    .vlen    = (min_length == max_length) ? 0 : 1,
+    .rd_auth = rd_auth ? 1 : 0
   };
 
   if ( char_props.read || char_props.notify || char_props.indicate )
@@ -129,7 +381,7 @@ error_t custom_add_in_characteristic(uint16_t service_handle, ble_uuid_t* p_uuid
     BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
   }
 
-  if ( char_props.write )
+  if ( char_props.write || char_props.write_wo_resp )
   {
     BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.write_perm);
   }
@@ -150,3 +402,79 @@ error_t custom_add_in_characteristic(uint16_t service_handle, ble_uuid_t* p_uuid
 
   return ERROR_NONE;
 }
+
+/**************************************************************************/
+/*!
+    @brief      Adds a whole GATT table, as generated by
+                tools/gatt_compile.py: registers the UUID bases, then adds
+                the services and their characteristics in order.
+
+    @note       The SoftDevice hands out handles in the order attributes
+                are added, which is what the generated handle offsets rely
+                on. Each characteristic's value handle is checked against
+                its offset, so a mismatch (e.g. a stack that adds extra
+                descriptors) is caught here rather than at lookup time.
+
+    @param[in]  p_table         The generated table
+    @param[out] uuid_types      UUID type of each base, uuid_base_count
+                                entries
+    @param[out] p_first_handle  Handle of the first service declaration,
+                                add the generated offsets to it
+
+    @returns
+    @retval     ERROR_NONE            Everything executed normally
+    @retval     ERROR_INVALID_STATE   The handles differ from the offsets
+*/
+/**************************************************************************/
+error_t custom_add_gatt_table(custom_gatt_table_t const * p_table, uint8_t uuid_types[], uint16_t * p_first_handle)
+{
+  for(uint8_t i=0; i<p_table->uuid_base_count; i++)
+  {
+    uuid_types[i] = custom_add_uuid128(&p_table->uuid_bases[i]);
+    ASSERT( uuid_types[i] >= BLE_UUID_TYPE_VENDOR_BEGIN, ERROR_INVALIDPARAMETER );
+  }
+
+  custom_gatt_char_t const * p_char = p_table->chars;
+
+  for(uint8_t i=0; i<p_table->service_count; i++)
+  {
+    custom_gatt_service_t const * p_service = &p_table->services[i];
+    ble_uuid_t service_uuid =
+    {
+      .uuid = p_service->uuid16,
+      .type = p_service->uuid_base ? uuid_types[p_service->uuid_base-1] : BLE_UUID_TYPE_BLE
+    };
+
+    uint16_t service_handle;
+    ASSERT_STATUS( sd_ble_gatts_service_add(BLE_GATTS_SRVC_TYPE_PRIMARY, &service_uuid, &service_handle) );
+
+    if ( i == 0 ) *p_first_handle = service_handle;
+
+    for(uint8_t j=0; j<p_service->char_count; j++, p_char++)
+    {
+      ble_uuid_t char_uuid =
+      {
+        .uuid = p_char->uuid16,
+        .type = p_char->uuid_base ? uuid_types[p_char->uuid_base-1] : BLE_UUID_TYPE_BLE
+      };
+
+      ble_gatts_char_handles_t handles;
+      if ( p_char->p_user_value != NULL )
+      {
+        ASSERT_STATUS( custom_add_user_characteristic(service_handle, &char_uuid, p_char->props,
+                                                      p_char->p_user_value, p_char->init_len, p_char->max_len,
+                                                      &handles) );
+      }
+      else
+      {
+        ASSERT_STATUS( custom_add_in_characteristic(service_handle, &char_uuid, p_char->props,
+                                                    (uint8_t*) p_char->p_value, p_char->init_len, p_char->max_len,
+                                                    &handles) );
+      }
+
+      ASSERT( handles.value_handle == *p_first_handle + p_char->value_offset, ERROR_INVALID_STATE );
+    }
+  }
+
+  return ERROR_NONE;
+}
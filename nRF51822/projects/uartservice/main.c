@@ -7,6 +7,7 @@
 #include "common/common.h"
 #include "boards/board.h"
 #include "btle.h"
+#include "btle_advertising.h"
 #include "nrf_gpiote.h"
 #include "nrf_gpio.h"
 
@@ -35,6 +36,12 @@ static void blinky_handler(void * p_context)
 /**************************************************************************/
 void boardButtonCallback(uint8_t button_num)
 {
+  /* Restart advertising if it has gone idle */
+  if ( button_num == CFG_GAP_ADV_WAKEUP_BUTTON_NUM ) (void) btle_advertising_wakeup();
+
+  /* Accept any central until the next connection, to pair a new one */
+  if ( button_num == CFG_GAP_ADV_OPEN_PAIRING_BUTTON_NUM ) (void) btle_advertising_open_pairing();
+
   switch (button_num)
   {
     case 0: break;
@@ -116,7 +116,7 @@
 
     /*-------------------------------- TIMER ------------------------------*/
     #define CFG_TIMER_PRESCALER                        0                        /**< Value of the RTC1 PRESCALER register. freq = (32768/(PRESCALER+1)) */
-    #define CFG_TIMER_MAX_INSTANCE                     8                        /**< Maximum number of simultaneously created timers. */
+    #define CFG_TIMER_MAX_INSTANCE                     10                       /**< Maximum number of simultaneously created timers. */
     #define CFG_TIMER_OPERATION_QUEUE_SIZE             5                        /**< Size of timer operation queues. */
 /*=========================================================================*/
 
@@ -132,17 +132,114 @@
     #define CFG_BLE_BOND_FLASH_PAGE_SYS_ATTR           (BLE_FLASH_PAGE_END-3)   /**< Flash page used for bond manager system attribute information. TODO check if we can use BLE_FLASH_PAGE_END-2*/
     #define CFG_BLE_BOND_DELETE_BUTTON_NUM             0
 
+    /* Set the CCCDs on connect instead of waiting for encryption (bonded) or a CCCD access (others) */
+    #define CFG_BLE_SYS_ATTR_FAST                      1                        /**< Notifications no longer fail with SYS_ATTR_MISSING right after connecting */
+    #define CFG_BLE_SYS_ATTR_CACHE_SIZE                64                       /**< RAM copy of the last bonded central's system attributes in bytes */
+
     /*--------------------------------- GAP -------------------------------*/
     #define CFG_GAP_APPEARANCE                         BLE_APPEARANCE_GENERIC_TAG
     #define CFG_GAP_LOCAL_NAME                         "UART"
 
-    #define CFG_GAP_CONNECTION_MIN_INTERVAL_MS         10                      /**< Minimum acceptable connection interval */
+    #define CFG_GAP_CONNECTION_MIN_INTERVAL_MS         8                       /**< Minimum acceptable connection interval, rounded down to 1.25 ms units (8 -> 7.5 ms) */
     #define CFG_GAP_CONNECTION_MAX_INTERVAL_MS         100                     /**< Maximum acceptable connection interval */
     #define CFG_GAP_CONNECTION_SUPERVISION_TIMEOUT_MS  4000                     /**< Connection supervisory timeout */
     #define CFG_GAP_CONNECTION_SLAVE_LATENCY           0                        /**< Slave Latency in number of connection events. */
 
-    #define CFG_GAP_ADV_INTERVAL_MS                    25                       /**< The advertising interval in milliseconds, should be multiply of 0.625 */
-    #define CFG_GAP_ADV_TIMEOUT_S                      180                      /**< The advertising timeout in units of seconds. */
+    /* Offered in turn when the central does not accept the parameters above, the connection is never dropped for it */
+    #define CFG_GAP_CONNECTION_FALLBACK1_MIN_INTERVAL_MS   20                   /**< Within the usual central guidelines (min >= 20 ms, max >= min + 20 ms) */
+    #define CFG_GAP_CONNECTION_FALLBACK1_MAX_INTERVAL_MS   100
+    #define CFG_GAP_CONNECTION_FALLBACK1_SLAVE_LATENCY     0
+    #define CFG_GAP_CONNECTION_FALLBACK2_MIN_INTERVAL_MS   8                    /**< Last resort: almost anything the central picks */
+    #define CFG_GAP_CONNECTION_FALLBACK2_MAX_INTERVAL_MS   1000
+    #define CFG_GAP_CONNECTION_FALLBACK2_SLAVE_LATENCY     0
+    #define CFG_GAP_CONNECTION_UPDATE_FIRST_DELAY_MS       5000                 /**< Time after connecting before the first update request */
+    #define CFG_GAP_CONNECTION_UPDATE_NEXT_DELAY_MS        5000                 /**< Time the central gets to apply a request */
+    #define CFG_GAP_CONNECTION_UPDATE_ATTEMPTS             2                    /**< Requests per set before falling back to the next one */
+
+    /* Connection parameters follow the traffic (btle_conn_policy.c), both sets must be within the MIN/MAX interval above */
+    #define CFG_GAP_POLICY_BURST_MIN_INTERVAL_MS       8                        /**< Interval while streaming, rounded down to 1.25 ms units (8 -> 7.5 ms) */
+    #define CFG_GAP_POLICY_BURST_MAX_INTERVAL_MS       15
+    #define CFG_GAP_POLICY_IDLE_MIN_INTERVAL_MS        75                       /**< Interval while idle */
+    #define CFG_GAP_POLICY_IDLE_MAX_INTERVAL_MS        100
+    #define CFG_GAP_POLICY_IDLE_SLAVE_LATENCY          4                        /**< Connection events the peripheral may skip while idle */
+    #define CFG_GAP_POLICY_WINDOW_MS                   1000                     /**< Traffic is measured over windows of this length */
+    #define CFG_GAP_POLICY_BURST_BPS                   40                       /**< Rate (bytes/s) at or above which a burst starts */
+    #define CFG_GAP_POLICY_IDLE_BPS                    5                        /**< Rate (bytes/s) below which a window counts as quiet */
+    #define CFG_GAP_POLICY_IDLE_WINDOWS                5                        /**< Quiet windows in a row before going idle */
+    #define CFG_GAP_POLICY_UPDATE_MIN_MS               5000                     /**< Minimum time between two parameter update requests */
+
+    /* Advertising runs fast for a short while, then slow, then stops until woken up by a button press.
+       After a disconnect from a bonded central it first tries directed advertising to that central (1.28 s) */
+    #define CFG_GAP_ADV_DIRECTED                       1                        /**< Reconnect to the last bonded central with directed advertising */
+    #define CFG_GAP_ADV_FAST_INTERVAL_MS               20                       /**< Fast advertising interval in milliseconds, should be multiply of 0.625 */
+    #define CFG_GAP_ADV_FAST_TIMEOUT_S                 30                       /**< Duration of the fast advertising phase in seconds */
+    #define CFG_GAP_ADV_SLOW_INTERVAL_MS               1000                     /**< Slow advertising interval in milliseconds, should be multiply of 0.625 */
+    #define CFG_GAP_ADV_SLOW_TIMEOUT_S                 600                      /**< Duration of the slow advertising phase in seconds, 0 = never go idle */
+    #define CFG_GAP_ADV_WAKEUP_BUTTON_NUM              1                        /**< Button that restarts advertising once idle */
+    #define CFG_GAP_ADV_WHITELIST                      1                        /**< Only accept scan & connection requests from bonded centrals (when there are any) */
+    #define CFG_GAP_ADV_OPEN_PAIRING_BUTTON_NUM        0                        /**< Button that lifts the whitelist until the next connection, to pair a new central */
+
+    /* Live values for broadcast-only consumers, see btle_advertising_manuf_data_update() */
+    #define CFG_GAP_ADV_MANUF_DATA_LEN                 0                        /**< Manufacturer specific data payload in bytes (max 24), 0 = disabled */
+    #define CFG_GAP_ADV_MANUF_COMPANY_ID               0xFFFF                   /**< Bluetooth SIG company identifier, 0xFFFF is reserved for testing */
+    #define CFG_GAP_ADV_MANUF_UPDATE_MIN_MS            1000                     /**< Minimum time between two advertising data updates */
+
+    /* Experiment mode: the fast phase cycles through candidate intervals (and channel masks) and logs the
+       discovery latency of each trial, feed the log to tools/adv_experiment.py for a recommendation */
+    #define CFG_GAP_ADV_EXPERIMENT                     0                        /**< Replace the schedule by back to back fast phase trials, needs a UART for the log */
+    #define CFG_GAP_ADV_EXPERIMENT_INTERVALS_MS        20, 100, 152, 318, 546, 1022, 2000 /**< Candidate intervals (20 to 10240 ms) */
+    #define CFG_GAP_ADV_EXPERIMENT_TRIALS              10                       /**< Trials per candidate, each lasts up to CFG_GAP_ADV_FAST_TIMEOUT_S */
+    #define CFG_GAP_ADV_EXPERIMENT_CH_MASK             0                        /**< Also cycle channel masks, needs S110 v7.0 or later */
+    #define CFG_GAP_ADV_EXPERIMENT_CH_MASKS            0x0, 0x6, 0x5, 0x3       /**< Bit n set = channel 37+n off, 0x6 = channel 37 only */
+    #define CFG_GAP_ADV_EXPERIMENT_SCAN_REQ            0                        /**< Log the time to the first scan request, needs S110 v7.0 or later */
+
+    /*------------------------ ATTRIBUTE HANDLE MAP -----------------------*/
+    #define CFG_BLE_HANDLE_MAP_SIZE                    32                       /**< Handles covered by the direct-index table, from the first registered characteristic */
+    #define CFG_BLE_HANDLE_MAP_CHARS                   8                        /**< Characteristics that can register a callback, see btle_handle_map_add() */
+
+    /*----------------------------- GATT CLIENT ---------------------------*/
+    #define CFG_BLE_GATTC                              0                        /**< Look up services of the central, see btle_gattc_service_register() */
+    #define CFG_BLE_GATTC_SERVICES                     2                        /**< Services the client modules can register */
+    #define CFG_BLE_GATTC_CHARS                        8                        /**< Characteristics of all registered services together */
+    #define CFG_BLE_GATTC_CACHE                        1                        /**< Keep the handles of bonded centrals in flash until Service Changed */
+
+    /*----------------------------- ANCS CLIENT ---------------------------*/
+    #define CFG_BLE_ANCS                               0                        /**< Fetch iOS notifications (Apple Notification Center Service), needs CFG_BLE_GATTC */
+    #define CFG_BLE_ANCS_PIPELINE                      3                        /**< Get Notification Attributes commands awaiting their Data Source answer */
+    #define CFG_BLE_ANCS_QUEUE                         8                        /**< Notifications waiting for their attributes, later ones are dropped */
+    #define CFG_BLE_ANCS_CACHE                         4                        /**< Fetched notifications kept, iOS announces them again on every subscription */
+    #define CFG_BLE_ANCS_APP_ID_LEN                    24                       /**< Characters kept of each attribute, longer values are truncated */
+    #define CFG_BLE_ANCS_TITLE_LEN                     24
+    #define CFG_BLE_ANCS_MESSAGE_LEN                   48
+
+    /*------------------------ RECONNECTION TIMELINE ----------------------*/
+    #define CFG_BLE_TIMELINE                           1                        /**< Time each step from advertising to the first notification, see btle_timeline_phase() */
+
+    /*------------------------ UART TRAFFIC COUNTERS ----------------------*/
+    #define CFG_BLE_UART_STATS                         1                        /**< Byte counters characteristic in the UART service, see btle_uart_stats.cpp (C++) */
+
+    /*------------------------- LINK QUALITY (RSSI) -----------------------*/
+    #define CFG_BLE_RSSI                               1                        /**< Monitor the RSSI of the connection, see btle_rssi_stats() */
+    #define CFG_BLE_RSSI_SERVICE                       1                        /**< Expose the statistics in the (custom) link quality service */
+    #define CFG_BLE_RSSI_EWMA_SHIFT                    3                        /**< Filter weight of a new sample is 1/2^shift (3 = 1/8) */
+    #define CFG_BLE_RSSI_NOTIFY_MIN_MS                 1000                     /**< Minimum time between two statistics notifications */
+
+    /* Adaptive TX power while connected, CFG_BLE_TX_POWER_LEVEL is the ceiling (and the advertising power) */
+    #define CFG_BLE_TX_POWER_CTRL                      1                        /**< Step the TX power to keep the link near the target below */
+    #define CFG_BLE_TX_POWER_CTRL_TARGET_DBM           (-70)                    /**< Wanted RSSI at the central */
+    #define CFG_BLE_TX_POWER_CTRL_HYSTERESIS_DB        6                        /**< Dead band either side of the target */
+    #define CFG_BLE_TX_POWER_CTRL_PEER_TX_DBM          0                        /**< Assumed central TX power, when it does not report its RSSI */
+    #define CFG_BLE_TX_POWER_CTRL_PERIOD_MS            2000                     /**< Time between two steps */
+
+    /*------------------------------ iBEACON ------------------------------*/
+    #define CFG_BLE_IBEACON                            0                        /**< Non-connectable beacon instead of the connectable advertising schedule */
+    #define CFG_BLE_IBEACON_UUID                       "\xE2\xC5\x6D\xB5\xDF\xFB\x48\xD2\xB0\x60\xD0\xF5\xA7\x10\x96\xE0"
+    #define CFG_BLE_IBEACON_MAJOR                      3
+    #define CFG_BLE_IBEACON_MINOR                      2
+    #define CFG_BLE_IBEACON_MEASURED_POWER             (-58)                    /**< RSSI at 1 metre in dBm, calibrate per board & CFG_BLE_TX_POWER_LEVEL */
+    #define CFG_BLE_IBEACON_FRAME_MS                   1000                     /**< Time on air of each frame before rotating to the next */
+    #define CFG_BLE_IBEACON_LATENCY_MS                 3000                     /**< Discovery latency target, the advertising interval is made as slow as this allows */
+    #define CFG_BLE_IBEACON_EVENTS_PER_DISCOVERY       3                        /**< Advertising events a scanner gets within the target (margin for lost packets) */
 /*=========================================================================*/
 
 
@@ -151,7 +248,68 @@
     -----------------------------------------------------------------------*/
     #if CFG_BLE_TX_POWER_LEVEL != -40 && CFG_BLE_TX_POWER_LEVEL != -20 && CFG_BLE_TX_POWER_LEVEL != -16 && CFG_BLE_TX_POWER_LEVEL != -12 && CFG_BLE_TX_POWER_LEVEL != -8  && CFG_BLE_TX_POWER_LEVEL != -4  && CFG_BLE_TX_POWER_LEVEL != 0   && CFG_BLE_TX_POWER_LEVEL != 4
         #error "CFG_BLE_TX_POWER_LEVEL must be -40, -20, -16, -12, -8, -4, 0 or 4"
+    #endif
+
+    #if CFG_GAP_ADV_FAST_INTERVAL_MS < 20 || CFG_GAP_ADV_SLOW_INTERVAL_MS > 10240
+        #error "CFG_GAP_ADV_xxx_INTERVAL_MS must be between 20 and 10240 ms"
+    #endif
+
+    #if CFG_GAP_ADV_FAST_TIMEOUT_S == 0 || CFG_GAP_ADV_FAST_TIMEOUT_S > 0x3FFF || CFG_GAP_ADV_SLOW_TIMEOUT_S > 0x3FFF
+        #error "CFG_GAP_ADV_FAST_TIMEOUT_S must be between 1 and 16383 s, CFG_GAP_ADV_SLOW_TIMEOUT_S at most 16383 s"
+    #endif
+
+    #if CFG_GAP_POLICY_BURST_MIN_INTERVAL_MS < CFG_GAP_CONNECTION_MIN_INTERVAL_MS || CFG_GAP_POLICY_IDLE_MAX_INTERVAL_MS > CFG_GAP_CONNECTION_MAX_INTERVAL_MS
+        #error "CFG_GAP_POLICY_xxx intervals must be within CFG_GAP_CONNECTION_MIN/MAX_INTERVAL_MS"
+    #endif
+
+    #if CFG_GAP_CONNECTION_SUPERVISION_TIMEOUT_MS <= 2 * (1 + CFG_GAP_POLICY_IDLE_SLAVE_LATENCY) * CFG_GAP_POLICY_IDLE_MAX_INTERVAL_MS
+        #error "CFG_GAP_CONNECTION_SUPERVISION_TIMEOUT_MS is too short for CFG_GAP_POLICY_IDLE_SLAVE_LATENCY"
+    #endif
+
+    #if CFG_GAP_CONNECTION_SUPERVISION_TIMEOUT_MS <= 2 * (1 + CFG_GAP_CONNECTION_FALLBACK2_SLAVE_LATENCY) * CFG_GAP_CONNECTION_FALLBACK2_MAX_INTERVAL_MS || \
+        CFG_GAP_CONNECTION_SUPERVISION_TIMEOUT_MS <= 2 * (1 + CFG_GAP_CONNECTION_FALLBACK1_SLAVE_LATENCY) * CFG_GAP_CONNECTION_FALLBACK1_MAX_INTERVAL_MS
+        #error "CFG_GAP_CONNECTION_SUPERVISION_TIMEOUT_MS is too short for the CFG_GAP_CONNECTION_FALLBACKn_xxx sets"
+    #endif
+
+    #if CFG_GAP_ADV_MANUF_DATA_LEN > 24
+        #error "CFG_GAP_ADV_MANUF_DATA_LEN must be at most 24 bytes (31 minus flags and field headers)"
+    #endif
+
+    #if (CFG_GAP_ADV_EXPERIMENT_CH_MASK || CFG_GAP_ADV_EXPERIMENT_SCAN_REQ) && !CFG_GAP_ADV_EXPERIMENT
+        #error "CFG_GAP_ADV_EXPERIMENT_CH_MASK and CFG_GAP_ADV_EXPERIMENT_SCAN_REQ require CFG_GAP_ADV_EXPERIMENT"
+    #endif
+
+    #if CFG_GAP_ADV_EXPERIMENT && CFG_BLE_IBEACON
+        #error "CFG_GAP_ADV_EXPERIMENT times the connectable schedule, which CFG_BLE_IBEACON replaces"
     #endif    
+
+    #if CFG_BLE_HANDLE_MAP_CHARS > 254
+        #error "CFG_BLE_HANDLE_MAP_CHARS must be at most 254"
+    #endif
+
+    #if CFG_BLE_GATTC && (CFG_BLE_GATTC_SERVICES < 1 || CFG_BLE_GATTC_CHARS < 1)
+        #error "CFG_BLE_GATTC needs at least one service and characteristic"
+    #endif
+
+    #if CFG_BLE_ANCS && !CFG_BLE_GATTC
+        #error "CFG_BLE_ANCS needs CFG_BLE_GATTC"
+    #endif
+
+    #if CFG_BLE_ANCS && (CFG_BLE_ANCS_PIPELINE < 1 || CFG_BLE_ANCS_PIPELINE > CFG_BLE_ANCS_QUEUE || CFG_BLE_ANCS_CACHE < 1)
+        #error "CFG_BLE_ANCS_PIPELINE must be between 1 and CFG_BLE_ANCS_QUEUE, CFG_BLE_ANCS_CACHE at least 1"
+    #endif
+
+    #if CFG_BLE_RSSI_EWMA_SHIFT < 2 || CFG_BLE_RSSI_EWMA_SHIFT > 8
+        #error "CFG_BLE_RSSI_EWMA_SHIFT must be between 2 and 8"
+    #endif
+
+    #if CFG_BLE_RSSI_SERVICE && !CFG_BLE_RSSI
+        #error "CFG_BLE_RSSI_SERVICE requires CFG_BLE_RSSI"
+    #endif
+
+    #if CFG_BLE_TX_POWER_CTRL && !CFG_BLE_RSSI
+        #error "CFG_BLE_TX_POWER_CTRL requires CFG_BLE_RSSI"
+    #endif
 /*=========================================================================*/
 
 #endif /* _PROJECTCONFIG_H_ */
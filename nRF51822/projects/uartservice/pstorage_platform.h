@@ -20,6 +20,7 @@
 #define PSTORAGE_PL_H__
 
 #include <stdint.h>
+#include "projectconfig.h"
 
 #define PSTORAGE_FLASH_PAGE_SIZE    ((uint16_t)NRF_FICR->CODEPAGESIZE)   /**< Size of one flash page. */
 #define PSTORAGE_FLASH_EMPTY_MASK    0xFFFFFFFF                          /**< Bit mask that defines an empty address in flash. */
@@ -30,7 +31,7 @@
         : NRF_FICR->CODESIZE)
 
 
-#define PSTORAGE_MAX_APPLICATIONS   2                                                           /**< Maximum number of applications that can be registered with the module, configurable based on system requirements. */
+#define PSTORAGE_MAX_APPLICATIONS   (2 + (CFG_BLE_GATTC && CFG_BLE_GATTC_CACHE))               /**< Maximum number of applications that can be registered with the module, configurable based on system requirements. Bond manager (2) + GATT client cache, which moves the bonds down a page. */
 #define PSTORAGE_MIN_BLOCK_SIZE     0x0010                                                      /**< Minimum size of block that can be registered with the module. Should be configured based on system requirements, recommendation is not have this value to be at least size of word. */
 
 #define PSTORAGE_DATA_START_ADDR    ((PSTORAGE_FLASH_PAGE_END - PSTORAGE_MAX_APPLICATIONS - 1) \
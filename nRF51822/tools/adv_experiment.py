@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+"""
+Analyses the log of the advertising experiment mode (CFG_GAP_ADV_EXPERIMENT)
+and recommends the candidate that meets a discovery latency SLA at the
+lowest radio duty cycle.
+
+The firmware prints one line per trial:
+
+  advx: candidate 3 interval 318 ms ch_mask 0x0 scan_req -1 ms connect 1234 ms
+
+where -1 means the event did not happen (a miss) or was not reported by the
+stack. Lines that do not match are ignored, so a raw UART capture is fine.
+
+Usage:
+
+  python3 adv_experiment.py --sla-ms 2000 uart.log
+  python3 adv_experiment.py --sla-ms 2000 --percentile 95 --metric connect < uart.log
+"""
+
+import argparse
+import math
+import re
+import sys
+
+LINE = re.compile(r"advx: candidate (\d+) interval (\d+) ms ch_mask 0x([0-9A-Fa-f]+) "
+                  r"scan_req (-?\d+) ms connect (-?\d+) ms")
+
+# advDelay is a random 0-10 ms added to every advertising interval
+ADV_DELAY_MEAN_MS = 5.0
+
+
+class Candidate(object):
+    def __init__(self, index, interval_ms, ch_mask):
+        self.index = index
+        self.interval_ms = interval_ms
+        self.ch_mask = ch_mask
+        self.scan_req = []
+        self.connect = []
+
+    @property
+    def channels(self):
+        return 3 - bin(self.ch_mask & 0x7).count("1")
+
+    def duty_cycle(self, channel_ms):
+        """Fraction of the time the radio is on, one TX + RX window per channel and event"""
+        return (self.channels * channel_ms) / (self.interval_ms + ADV_DELAY_MEAN_MS)
+
+    def samples(self, metric):
+        return self.scan_req if metric == "scan_req" else self.connect
+
+
+def percentile(samples, pct):
+    """Nearest rank percentile, misses are infinite so too many of them fail the SLA"""
+    ordered = sorted(samples)
+    rank = max(1, int(math.ceil(pct / 100.0 * len(ordered))))
+    return ordered[rank - 1]
+
+
+def parse(stream, candidates):
+    for line in stream:
+        m = LINE.search(line)
+        if not m:
+            continue
+        index, interval_ms, ch_mask = int(m.group(1)), int(m.group(2)), int(m.group(3), 16)
+        scan_req, connect = int(m.group(4)), int(m.group(5))
+
+        cand = candidates.setdefault(index, Candidate(index, interval_ms, ch_mask))
+        cand.scan_req.append(scan_req if scan_req >= 0 else math.inf)
+        cand.connect.append(connect if connect >= 0 else math.inf)
+
+
+def fmt_ms(value):
+    return "miss" if math.isinf(value) else "%d" % value
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("logs", nargs="*", help="UART captures (default: stdin)")
+    parser.add_argument("--sla-ms", type=float, required=True, help="discovery latency target")
+    parser.add_argument("--percentile", type=float, default=90.0, help="share of trials that must meet the SLA (default: 90)")
+    parser.add_argument("--metric", choices=("auto", "scan_req", "connect"), default="auto",
+                        help="latency to judge, 'auto' uses scan_req when the log has any (default: auto)")
+    parser.add_argument("--min-trials", type=int, default=5, help="ignore candidates with fewer trials (default: 5)")
+    parser.add_argument("--channel-ms", type=float, default=0.6,
+                        help="radio on-time per channel and advertising event (default: 0.6)")
+    args = parser.parse_args()
+
+    candidates = {}
+    if args.logs:
+        for path in args.logs:
+            with open(path, "r", errors="replace") as f:
+                parse(f, candidates)
+    else:
+        parse(sys.stdin, candidates)
+
+    if not candidates:
+        sys.exit("no 'advx:' lines found, is CFG_GAP_ADV_EXPERIMENT enabled?")
+
+    metric = args.metric
+    if metric == "auto":
+        has_scan_req = any(not math.isinf(v) for c in candidates.values() for v in c.scan_req)
+        metric = "scan_req" if has_scan_req else "connect"
+
+    print("metric: %s, SLA: p%g <= %g ms" % (metric, args.percentile, args.sla_ms))
+    print("%4s %9s %7s %6s %6s %8s %8s %7s  %s" %
+          ("cand", "interval", "ch_mask", "trials", "misses", "p50 ms", "p%g ms" % args.percentile, "duty %", "SLA"))
+
+    best = None
+    for cand in sorted(candidates.values(), key=lambda c: c.index):
+        samples = cand.samples(metric)
+        misses = sum(1 for v in samples if math.isinf(v))
+        p50 = percentile(samples, 50)
+        pxx = percentile(samples, args.percentile)
+        duty = cand.duty_cycle(args.channel_ms)
+
+        if len(samples) < args.min_trials:
+            verdict = "too few trials"
+        elif pxx <= args.sla_ms:
+            verdict = "ok"
+            if best is None or duty < best[1]:
+                best = (cand, duty, pxx)
+        else:
+            verdict = "fail"
+
+        print("%4d %6d ms %7s %6d %6d %8s %8s %7.3f  %s" %
+              (cand.index, cand.interval_ms, "0x%X" % cand.ch_mask, len(samples), misses,
+               fmt_ms(p50), fmt_ms(pxx), duty * 100, verdict))
+
+    if best is None:
+        print("no candidate meets the SLA, try shorter intervals or more trials")
+        sys.exit(1)
+
+    cand, duty, pxx = best
+    print("recommended: candidate %d, interval %d ms, ch_mask 0x%X (p%g %d ms, duty cycle %.3f %%)" %
+          (cand.index, cand.interval_ms, cand.ch_mask, args.percentile, pxx, duty * 100))
+
+
+if __name__ == "__main__":
+    main()
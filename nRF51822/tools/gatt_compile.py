@@ -0,0 +1,352 @@
+#!/usr/bin/env python3
+"""
+Compiles a Bluegiga style gatt.xml into const C tables for the nRF51822
+projects, registered in one go by custom_add_gatt_table() (custom_helper.c).
+
+  python3 gatt_compile.py gatt.xml --name gatt_db --out-dir ../projects/uartservice
+
+writes gatt_db.h and gatt_db.c with:
+
+  - the UUID bases, services and characteristics as const tables
+  - gatt_db_init(), which adds them to the SoftDevice
+  - enums of the service & characteristic indexes and of the handle of
+    every attribute relative to the first one, so that a handle can be
+    found (or mapped back to its characteristic) without a search
+  - GATT_DB_ATTR_COUNT & GATT_DB_VALUE_BYTES to size the attribute table
+
+Supported: <service uuid>, <characteristic uuid id>, <properties read write
+write_no_response notify indicate const>, <value type="hex|utf-8" length
+variable_length>, <description> (becomes a comment). A value of type="user"
+lives in application RAM (BLE_GATTS_VLOC_USER): <name>_user_<id>[] is
+written in place by the application and read directly by the SoftDevice. The Generic Access
+(0x1800) and Generic Attribute (0x1801) services belong to the SoftDevice
+and are skipped, set the name & appearance with CFG_GAP_xxx instead.
+"""
+
+import argparse
+import os
+import re
+import sys
+import xml.etree.ElementTree as ET
+
+SOFTDEVICE_SERVICES = {0x1800: "Generic Access", 0x1801: "Generic Attribute"}
+
+
+class Uuid(object):
+    def __init__(self, text):
+        digits = text.replace("-", "").lower()
+        if not re.match(r"^([0-9a-f]{4}|[0-9a-f]{32})$", digits):
+            raise ValueError("bad UUID '%s'" % text)
+
+        if len(digits) == 4:
+            self.uuid16 = int(digits, 16)
+            self.base = None
+        else:
+            raw = bytearray.fromhex(digits)
+            self.uuid16 = (raw[2] << 8) | raw[3]
+            raw[2] = raw[3] = 0
+            self.base = bytes(raw)
+
+        self.text = text
+
+
+class Characteristic(object):
+    def __init__(self, node, index):
+        self.uuid = Uuid(node.get("uuid"))
+
+        props = node.find("properties")
+        props = props.attrib if props is not None else {}
+        flag = lambda name: props.get(name, "false").lower() == "true"
+
+        self.read = flag("read") or flag("const")
+        self.write = flag("write") and not flag("const")
+        self.write_wo_resp = flag("write_no_response") and not flag("const")
+        self.notify = flag("notify")
+        self.indicate = flag("indicate")
+
+        value = node.find("value")
+        attrs = value.attrib if value is not None else {}
+        text = (value.text or "").strip() if value is not None else ""
+
+        self.user = attrs.get("type") == "user"
+
+        if attrs.get("type", "utf-8") == "hex":
+            self.value = bytes(bytearray.fromhex(text))
+        elif self.user:
+            self.value = b""
+        else:
+            self.value = text.encode("utf-8")
+
+        length = int(attrs.get("length", 0))
+        self.max_len = max(length, len(self.value), 1)
+
+        if attrs.get("variable_length", "false").lower() == "true":
+            self.init_len = len(self.value)
+        else:
+            self.init_len = self.max_len
+            self.value = self.value.ljust(self.max_len, b"\0")
+
+        desc = node.find("description")
+        self.description = desc.text.strip() if desc is not None and desc.text else None
+        fallback = ("uuid_%04x" % self.uuid.uuid16) if self.uuid.base is None else ("char_%d" % index)
+        self.name = c_name(node.get("id") or self.description or fallback)
+
+        self.value_offset = 0
+
+    @property
+    def has_cccd(self):
+        return self.notify or self.indicate
+
+
+class Service(object):
+    def __init__(self, node, index):
+        self.uuid = Uuid(node.get("uuid"))
+
+        desc = node.find("description")
+        self.description = desc.text.strip() if desc is not None and desc.text else None
+        self.name = c_name(node.get("id") or self.description or "service_%d" % index)
+
+        self.chars = []
+        self.offset = 0
+
+
+def c_name(text):
+    name = re.sub(r"[^0-9A-Za-z]+", "_", text).strip("_").upper()
+    return name if not name[:1].isdigit() else "_" + name
+
+
+def parse(path):
+    services = []
+    char_index = 0
+
+    for node in ET.parse(path).getroot().iter("service"):
+        uuid = Uuid(node.get("uuid"))
+        if uuid.base is None and uuid.uuid16 in SOFTDEVICE_SERVICES:
+            sys.stderr.write("note: %s service skipped, it belongs to the SoftDevice\n" % SOFTDEVICE_SERVICES[uuid.uuid16])
+            continue
+
+        service = Service(node, len(services))
+        for char_node in node.iter("characteristic"):
+            service.chars.append(Characteristic(char_node, char_index))
+            char_index += 1
+        services.append(service)
+
+    return services
+
+
+def assign_handles(services):
+    """Mirrors the order the SoftDevice hands out handles in: service
+    declaration, then per characteristic its declaration, value & CCCD"""
+    offset = 0
+    for service in services:
+        service.offset = offset
+        offset += 1
+        for char in service.chars:
+            char.value_offset = offset + 1
+            offset += 3 if char.has_cccd else 2
+    return offset
+
+
+def check_names(services):
+    seen = set()
+    for name in [s.name for s in services] + [c.name for s in services for c in s.chars]:
+        if name in seen:
+            sys.exit("error: '%s' is used twice, give the services/characteristics unique ids" % name)
+        seen.add(name)
+
+
+def c_bytes(data):
+    return ", ".join("0x%02X" % b for b in bytearray(data))
+
+
+def generate(services, bases, attr_count, name, source):
+    prefix = name.upper()
+    chars = [c for s in services for c in s.chars]
+    guard = "_%s_H_" % prefix
+    banner = ("/**************************************************************************/\n"
+              "/*!\n"
+              "    @file     %%s\n"
+              "\n"
+              "    Generated by tools/gatt_compile.py from %s, do not edit.\n"
+              "*/\n"
+              "/**************************************************************************/\n" % os.path.basename(source))
+
+    def uuid_base_idx(uuid):
+        return 0 if uuid.base is None else bases.index(uuid.base) + 1
+
+    # ---------------- header ----------------
+    h = [banner % (name + ".h"),
+         "#ifndef %s" % guard, "#define %s" % guard, "",
+         "#ifdef __cplusplus", " extern \"C\" {", "#endif", "",
+         "#include \"custom_helper.h\"", ""]
+
+    h.append("enum {")
+    for i, s in enumerate(services):
+        h.append("  %s_SVC_%s = %d,%s" % (prefix, s.name, i, "" if not s.description else " ///< " + s.description))
+    h.append("  %s_SVC_COUNT" % prefix)
+    h.append("};")
+    h.append("")
+
+    h.append("enum {")
+    for i, c in enumerate(chars):
+        h.append("  %s_CHAR_%s = %d,%s" % (prefix, c.name, i, "" if not c.description else " ///< " + c.description))
+    h.append("  %s_CHAR_COUNT" % prefix)
+    h.append("};")
+    h.append("")
+
+    h.append("/** Handle of each attribute minus %s_first_handle, see %s_HANDLE() */" % (name, prefix))
+    h.append("enum {")
+    for s in services:
+        h.append("  %s_HANDLE_%s = %d," % (prefix, s.name, s.offset))
+        for c in s.chars:
+            h.append("  %s_HANDLE_%s_VALUE = %d," % (prefix, c.name, c.value_offset))
+            if c.has_cccd:
+                h.append("  %s_HANDLE_%s_CCCD = %d," % (prefix, c.name, c.value_offset + 1))
+    h.append("")
+    h.append("  %s_ATTR_COUNT = %d, ///< attributes added to the SoftDevice's table" % (prefix, attr_count))
+    h.append("  %s_VALUE_BYTES = %d ///< space taken by the values (max length), excluding CCCDs" %
+             (prefix, sum(c.max_len for c in chars)))
+    h.append("};")
+    h.append("")
+    h.append("#define %s_HANDLE(offset)   ( %s_first_handle + (offset) )" % (prefix, name))
+    h.append("")
+    h.append("extern custom_gatt_table_t const %s_table;" % name)
+    h.append("extern uint8_t  const %s_handle_to_char[%s_ATTR_COUNT]; ///< characteristic of each handle offset, 0xFF for service declarations" % (name, prefix))
+    for c in chars:
+        if c.user:
+            h.append("extern uint8_t  %s_user_%s[%d]; ///< value of %s_CHAR_%s, in place" % (name, c.name.lower(), c.max_len, prefix, c.name))
+    h.append("extern uint16_t %s_first_handle;" % name)
+    h.append("extern uint8_t  %s_uuid_types[%d];" % (name, max(len(bases), 1)))
+    h.append("")
+    h.append("error_t %s_init(void);" % name)
+    h.append("")
+    h += ["#ifdef __cplusplus", "}", "#endif", "", "#endif /* %s */" % guard, ""]
+
+    # ---------------- source ----------------
+    c_src = [banner % (name + ".c"), "#include \"%s.h\"" % name, ""]
+
+    # little endian like ble_uuid128_t, reversed here rather than at run time
+    c_src.append("static ble_uuid128_t const %s_uuid_bases[%d] =" % (name, max(len(bases), 1)))
+    c_src.append("{")
+    for b in bases:
+        c_src.append("  { { %s } }," % c_bytes(bytes(reversed(bytearray(b)))))
+    if not bases:
+        c_src.append("  { { 0 } } /* SIG UUIDs only */")
+    c_src.append("};")
+    c_src.append("")
+
+    for ch in chars:
+        if ch.user:
+            c_src.append("uint8_t %s_user_%s[%d];" % (name, ch.name.lower(), ch.max_len))
+        else:
+            c_src.append("static uint8_t const %s_value_%s[] = { %s };" % (name, ch.name.lower(), c_bytes(ch.value) or "0"))
+    c_src.append("")
+
+    c_src.append("static custom_gatt_service_t const %s_services[%s_SVC_COUNT] =" % (name, prefix))
+    c_src.append("{")
+    for s in services:
+        c_src.append("  [%s_SVC_%s] = { .uuid16 = 0x%04X, .uuid_base = %d, .char_count = %d }, /* %s */" %
+                     (prefix, s.name, s.uuid.uuid16, uuid_base_idx(s.uuid), len(s.chars), s.uuid.text))
+    c_src.append("};")
+    c_src.append("")
+
+    c_src.append("static custom_gatt_char_t const %s_chars[%s_CHAR_COUNT] =" % (name, prefix))
+    c_src.append("{")
+    for ch in chars:
+        props = [p for p in ("read", "write", "write_wo_resp", "notify", "indicate") if getattr(ch, p)]
+        c_src.append("  [%s_CHAR_%s] = /* %s */" % (prefix, ch.name, ch.uuid.text))
+        c_src.append("  {")
+        c_src.append("    .uuid16       = 0x%04X," % ch.uuid.uuid16)
+        c_src.append("    .uuid_base    = %d," % uuid_base_idx(ch.uuid))
+        c_src.append("    .props        = { %s }," % ", ".join(".%s = 1" % p for p in props))
+        if ch.user:
+            c_src.append("    .p_user_value = %s_user_%s," % (name, ch.name.lower()))
+        else:
+            c_src.append("    .p_value      = %s_value_%s," % (name, ch.name.lower()))
+        c_src.append("    .init_len     = %d," % ch.init_len)
+        c_src.append("    .max_len      = %d," % ch.max_len)
+        c_src.append("    .value_offset = %s_HANDLE_%s_VALUE" % (prefix, ch.name))
+        c_src.append("  },")
+    c_src.append("};")
+    c_src.append("")
+
+    c_src.append("custom_gatt_table_t const %s_table =" % name)
+    c_src.append("{")
+    c_src.append("  .uuid_bases      = %s_uuid_bases," % name)
+    c_src.append("  .uuid_base_count = %d," % len(bases))
+    c_src.append("  .services        = %s_services," % name)
+    c_src.append("  .service_count   = %s_SVC_COUNT," % prefix)
+    c_src.append("  .chars           = %s_chars," % name)
+    c_src.append("  .char_count      = %s_CHAR_COUNT" % prefix)
+    c_src.append("};")
+    c_src.append("")
+
+    lookup = []
+    for s in services:
+        lookup.append("0xFF")
+        for ch in s.chars:
+            idx = "%s_CHAR_%s" % (prefix, ch.name)
+            lookup += [idx, idx] + ([idx] if ch.has_cccd else [])
+    c_src.append("uint8_t const %s_handle_to_char[%s_ATTR_COUNT] =" % (name, prefix))
+    c_src.append("{")
+    c_src += ["  %s," % v for v in lookup]
+    c_src.append("};")
+    c_src.append("")
+
+    c_src.append("uint16_t %s_first_handle;" % name)
+    c_src.append("uint8_t  %s_uuid_types[%d];" % (name, max(len(bases), 1)))
+    c_src.append("")
+    c_src.append("/**************************************************************************/")
+    c_src.append("/*!")
+    c_src.append("    @brief      Adds the services & characteristics of %s to the" % os.path.basename(source))
+    c_src.append("                SoftDevice, call once from btle_init()")
+    c_src.append("*/")
+    c_src.append("/**************************************************************************/")
+    c_src.append("error_t %s_init(void)" % name)
+    c_src.append("{")
+    c_src.append("  return custom_add_gatt_table(&%s_table, %s_uuid_types, &%s_first_handle);" % (name, name, name))
+    c_src.append("}")
+    c_src.append("")
+
+    return "\n".join(h), "\n".join(c_src)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("xml", help="gatt.xml to compile")
+    parser.add_argument("--name", default="gatt_db", help="file & symbol prefix (default: gatt_db)")
+    parser.add_argument("--out-dir", default=".", help="where to write <name>.h and <name>.c (default: .)")
+    args = parser.parse_args()
+
+    if not re.match(r"^[A-Za-z_][A-Za-z0-9_]*$", args.name):
+        sys.exit("error: --name must be a C identifier")
+
+    services = parse(args.xml)
+    if not services:
+        sys.exit("error: no services left to compile")
+    check_names(services)
+
+    chars = [c for s in services for c in s.chars]
+    if len(services) > 255 or len(chars) > 254:
+        sys.exit("error: at most 255 services and 254 characteristics")
+
+    bases = []
+    for uuid in [s.uuid for s in services] + [c.uuid for c in chars]:
+        if uuid.base is not None and uuid.base not in bases:
+            bases.append(uuid.base)
+
+    attr_count = assign_handles(services)
+    header, source = generate(services, bases, attr_count, args.name, args.xml)
+
+    for ext, text in (("h", header), ("c", source)):
+        path = os.path.join(args.out_dir, "%s.%s" % (args.name, ext))
+        with open(path, "w") as f:
+            f.write(text)
+        print("wrote %s" % path)
+
+    print("%d service(s), %d characteristic(s), %d attribute(s), %d UUID base(s)" %
+          (len(services), len(chars), attr_count, len(bases)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+"""
+Generates synthetic PPG traces with beat annotations for ppg_harness.
+
+Every trace is two files in --out-dir:
+
+  name.csv    "# rate_hz N", then one 10-bit ADC sample per line
+  name.beats  the time of every pulse peak in seconds, one per line
+
+The heart rate follows a set rate with respiratory sinus arrhythmia and a
+slow drift, every interval gets a little jitter. Each pulse is a fast
+systolic upstroke, a rounded peak and a slower decay with a dicrotic
+notch. On top of that come sensor noise, baseline wander (breathing,
+perfusion) and, for some traces, motion artefacts or ectopic beats.
+
+Real recordings can be used the same way: any annotated trace in this
+format can be passed to ppg_harness.
+
+  python3 make_traces.py --rate 50 --out-dir build
+"""
+
+import argparse
+import math
+import os
+import random
+
+# name: (bpm, seconds, noise, wander, motion, ectopic, seed)
+TRACES = {
+    'rest_60':      (60,  120, 2.0,  10, 0.0,  0.00, 1),
+    'exercise_150': (150, 120, 3.0,  15, 0.0,  0.00, 2),
+    'brady_45':     (45,  120, 2.0,  10, 0.0,  0.00, 3),
+    'noisy_72':     (72,  120, 8.0,  10, 0.0,  0.00, 4),
+    'wander_72':    (72,  120, 2.0,  60, 0.0,  0.00, 5),
+    'motion_80':    (80,  120, 3.0,  15, 0.05, 0.00, 6),
+    'ectopic_70':   (70,  120, 2.0,  10, 0.0,  0.03, 7),
+}
+
+AMPLITUDE = 60        # pulse height in ADC counts
+BASELINE  = 512
+
+
+def beat_times(bpm, seconds, ectopic, rng):
+    """Pulse peak times: RSA at 0.25 Hz, a slow drift, jitter and optional
+    premature beats followed by a compensatory pause"""
+    beats, premature = [], set()
+    t = 0.6 + rng.random() * 0.4
+    while t < seconds:
+        beats.append(t)
+        rate = bpm * (1 + 0.04 * math.sin(2 * math.pi * 0.25 * t)
+                        + 0.05 * math.sin(2 * math.pi * t / 45.0))
+        rr = 60.0 / rate * (1 + rng.gauss(0, 0.01))
+        if ectopic and rng.random() < ectopic:
+            premature.add(len(beats))
+            beats.append(t + rr * 0.65)
+            rr *= 2                 # full compensatory pause
+        t += rr
+    return [b for b in beats if b < seconds], premature
+
+
+def pulse(dt, rr):
+    """Shape of one pulse, dt relative to its peak, scaled to the interval"""
+    rise = 0.12 * min(1.0, rr)
+    if dt < -rise or dt > rr:
+        return 0.0
+    if dt < 0:
+        return 0.5 * (1 + math.cos(math.pi * dt / rise))
+    decay = math.exp(-dt / (0.28 * rr))
+    notch = 0.12 * math.exp(-((dt - 0.38 * rr) / (0.05 * rr)) ** 2)
+    return decay + notch
+
+
+def trace(bpm, seconds, noise, wander, motion, ectopic, seed, rate):
+    rng = random.Random(seed)
+    beats, premature = beat_times(bpm, seconds, ectopic, rng)
+
+    n = int(seconds * rate)
+    signal = [0.0] * n
+
+    for i, b in enumerate(beats):
+        rr = (beats[i + 1] - b) if i + 1 < len(beats) else (b - beats[i - 1])
+        height = AMPLITUDE * (0.6 if i in premature else 1.0)   # less filling, weaker pulse
+        first = max(0, int((b - 0.2) * rate))
+        last = min(n, int((b + rr) * rate) + 1)
+        for k in range(first, last):
+            signal[k] += height * pulse(k / rate - b, rr)
+
+    phase = rng.random() * 2 * math.pi
+    artefact = 0.0
+    for k in range(n):
+        t = k / rate
+        s = signal[k]
+        s += wander * math.sin(2 * math.pi * 0.25 * t + phase)
+        s += wander * 0.6 * math.sin(2 * math.pi * 0.05 * t)
+        s += rng.gauss(0, noise)
+        if motion:
+            # occasional steps, decaying like a sensor being pressed
+            if rng.random() < motion / rate:
+                artefact += rng.choice((-1, 1)) * rng.uniform(40, 120)
+            artefact *= math.exp(-1.0 / (0.8 * rate))
+            s += artefact
+        signal[k] = min(1023, max(0, int(round(BASELINE + s))))
+
+    return signal, beats
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0])
+    parser.add_argument('--rate', type=int, default=50, help='sample rate in Hz (CFG_HEART_RATE_PPG_RATE_HZ)')
+    parser.add_argument('--out-dir', default='build')
+    parser.add_argument('names', nargs='*', help='traces to generate, default all')
+    args = parser.parse_args()
+
+    os.makedirs(args.out_dir, exist_ok=True)
+
+    for name in args.names or TRACES:
+        signal, beats = trace(*TRACES[name], rate=args.rate)
+        path = os.path.join(args.out_dir, name)
+        with open(path + '.csv', 'w') as f:
+            f.write('# rate_hz %d\n' % args.rate)
+            f.write('# %s, synthetic, see make_traces.py\n' % name)
+            f.write('\n'.join(str(v) for v in signal) + '\n')
+        with open(path + '.beats', 'w') as f:
+            f.write('\n'.join('%.4f' % b for b in beats) + '\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,432 @@
+/**************************************************************************/
+/*!
+    @file     ppg_harness.c
+
+    @brief    Runs PPG traces through the firmware's heart_rate_ppg.c on
+              the host and scores the heart rate and RR intervals it
+              reports against beat annotations
+
+    A trace is a text file with one 10-bit ADC sample per line, recorded
+    (or generated by make_traces.py) at CFG_HEART_RATE_PPG_RATE_HZ. Lines
+    starting with '#' are comments, "# rate_hz 50" is checked against the
+    build. The annotation file next to it (.beats instead of .csv) holds
+    the time of every pulse peak in seconds, one per line.
+
+    Beats are only visible through what the firmware reports: an RR
+    interval appears a little after its pulse peak, once the signal has
+    fallen back under the threshold. The harness finds that latency (the
+    median gap to the preceding annotated beat) and pairs every reported
+    interval with the annotated interval ending closest to it.
+
+      ppg_harness [options] trace.csv [trace.csv ...]
+
+      --max-bpm-mae <bpm>     fail if a trace's mean BPM error is larger
+      --min-sensitivity <%>   fail if fewer annotated intervals are found
+      --dump                  print every RR interval and the BPM once a
+                              second instead of the scores, to diff two
+                              builds of the pipeline
+
+    @section LICENSE
+
+    Software License Agreement (BSD License)
+
+    Copyright (c) 2014, K. Townsend (microBuilder.eu)
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holders nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**************************************************************************/
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "heart_rate_ppg.h"
+
+enum {
+  RATE_HZ           = CFG_HEART_RATE_PPG_RATE_HZ,
+  WARMUP_S          = 5,    /* settling and the first few beats are not scored */
+  BPM_AVERAGE       = 4,    /* the firmware averages 4 intervals */
+  BPM_TOLERANCE     = 5,    /* "within" for the BPM score */
+  RR_TOLERANCE_MS   = 20    /* "within" for the RR score */
+};
+
+typedef struct {
+  uint16_t * samples;
+  uint32_t   sample_count;
+  double   * beats;           /* annotated pulse peaks in s */
+  uint32_t   beat_count;
+} trace_t;
+
+typedef struct {
+  uint32_t sample;            /* the sample after which it was reported */
+  uint16_t rr;                /* 1/1024 s */
+} rr_event_t;
+
+typedef struct {
+  uint32_t ref_intervals;     /* annotated intervals after the warm up */
+  uint32_t reported;          /* RR intervals the firmware reported after the warm up */
+  uint32_t matched;
+  double   rr_abs_sum_ms;
+  double   rr_abs_max_ms;
+  uint32_t rr_within;
+
+  uint32_t bpm_seconds;
+  uint32_t bpm_locked;
+  double   bpm_abs_sum;
+  uint32_t bpm_within;
+
+  double   ns_per_sample;
+  uint32_t rejected;
+} score_t;
+
+/**************************************************************************/
+/*!
+    @brief      Reads the numbers of a text file, '#' lines are comments.
+                Returns the "# rate_hz" header through p_rate, 0 if none.
+*/
+/**************************************************************************/
+static double * read_numbers(char const * path, uint32_t * p_count, uint32_t * p_rate)
+{
+  FILE * f = fopen(path, "r");
+  if ( !f ) return NULL;
+
+  uint32_t size   = 1024;
+  double * values = malloc(size * sizeof(double));
+  char     line[128];
+
+  *p_count = 0;
+  if ( p_rate ) *p_rate = 0;
+
+  while ( fgets(line, sizeof(line), f) )
+  {
+    if ( line[0] == '#' )
+    {
+      if ( p_rate ) (void) sscanf(line, "# rate_hz %u", p_rate);
+      continue;
+    }
+
+    double value;
+    if ( sscanf(line, "%lf", &value) != 1 ) continue;
+
+    if ( *p_count == size )
+    {
+      size  *= 2;
+      values = realloc(values, size * sizeof(double));
+    }
+    values[(*p_count)++] = value;
+  }
+
+  fclose(f);
+  return values;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Loads trace.csv and trace.beats
+*/
+/**************************************************************************/
+static int trace_load(char const * path, trace_t * p_trace)
+{
+  uint32_t rate;
+  double * values = read_numbers(path, &p_trace->sample_count, &rate);
+
+  if ( !values )
+  {
+    fprintf(stderr, "%s: can not read\n", path);
+    return -1;
+  }
+
+  if ( rate && rate != RATE_HZ )
+  {
+    fprintf(stderr, "%s: recorded at %u Hz, the harness is built for %u Hz (make RATE=%u)\n", path, rate, RATE_HZ, rate);
+    free(values);
+    return -1;
+  }
+
+  p_trace->samples = malloc(p_trace->sample_count * sizeof(uint16_t));
+  for(uint32_t i=0; i<p_trace->sample_count; i++)
+  {
+    double const v = values[i];
+    p_trace->samples[i] = (uint16_t) (v < 0 ? 0 : v > 1023 ? 1023 : v);
+  }
+  free(values);
+
+  char beats_path[1024];
+  snprintf(beats_path, sizeof(beats_path), "%s", path);
+  char * ext = strrchr(beats_path, '.');
+  if ( ext ) *ext = 0;
+  strncat(beats_path, ".beats", sizeof(beats_path) - strlen(beats_path) - 1);
+
+  p_trace->beats = read_numbers(beats_path, &p_trace->beat_count, NULL);
+  if ( !p_trace->beats )
+  {
+    fprintf(stderr, "%s: no annotations\n", beats_path);
+    free(p_trace->samples);
+    return -1;
+  }
+
+  return 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Index of the last annotated beat at or before t, -1 if none
+*/
+/**************************************************************************/
+static int32_t beat_before(trace_t const * p_trace, double t)
+{
+  int32_t lo = -1, hi = (int32_t) p_trace->beat_count;
+
+  while ( hi - lo > 1 )
+  {
+    int32_t const mid = (lo + hi) / 2;
+    if ( p_trace->beats[mid] <= t ) lo = mid; else hi = mid;
+  }
+
+  return lo;
+}
+
+static int compare_double(void const * a, void const * b)
+{
+  double const x = *(double const *) a, y = *(double const *) b;
+  return (x > y) - (x < y);
+}
+
+/**************************************************************************/
+/*!
+    @brief      Feeds the trace to the pipeline, collecting the RR
+                intervals and the BPM as the heart rate timer would see
+                them (once a second)
+*/
+/**************************************************************************/
+static void trace_run(trace_t const * p_trace, rr_event_t * events, uint32_t * p_event_count,
+                      uint16_t * bpm, double * p_ns_per_sample)
+{
+  struct timespec start, stop;
+  double          ns = 0;
+
+  heart_rate_ppg_reset();
+  *p_event_count = 0;
+
+  for(uint32_t n=0; n<p_trace->sample_count; n++)
+  {
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    heart_rate_ppg_process(p_trace->samples[n]);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    ns += (stop.tv_sec - start.tv_sec) * 1e9 + (stop.tv_nsec - start.tv_nsec);
+
+    uint16_t rr;
+    while ( heart_rate_ppg_rr_get(&rr) )
+    {
+      events[*p_event_count].sample = n;
+      events[*p_event_count].rr     = rr;
+      (*p_event_count)++;
+    }
+
+    if ( (n+1) % RATE_HZ == 0 ) bpm[(n+1) / RATE_HZ - 1] = heart_rate_ppg_bpm();
+  }
+
+  *p_ns_per_sample = ns / p_trace->sample_count;
+}
+
+/**************************************************************************/
+/*!
+    @brief      Scores one trace, see the file comment for the matching
+*/
+/**************************************************************************/
+static void trace_score(trace_t const * p_trace, score_t * p_score, bool dump)
+{
+  uint32_t const seconds = p_trace->sample_count / RATE_HZ;
+  rr_event_t *   events  = malloc((p_trace->sample_count / 4 + 1) * sizeof(rr_event_t));
+  uint16_t *     bpm     = calloc(seconds + 1, sizeof(uint16_t));
+  uint32_t       event_count;
+
+  memset(p_score, 0, sizeof(score_t));
+  trace_run(p_trace, events, &event_count, bpm, &p_score->ns_per_sample);
+  p_score->rejected = heart_rate_ppg_stats()->rejected;
+
+  if ( dump )
+  {
+    for(uint32_t i=0; i<event_count; i++) printf("rr %u %u\n", events[i].sample, events[i].rr);
+    for(uint32_t s=0; s<seconds; s++) printf("bpm %u %u\n", s+1, bpm[s]);
+    free(events);
+    free(bpm);
+    return;
+  }
+
+  /* reporting latency: median gap from the preceding annotated beat */
+  double * gaps      = malloc((event_count + 1) * sizeof(double));
+  uint32_t gap_count = 0;
+
+  for(uint32_t i=0; i<event_count; i++)
+  {
+    double const  t    = (events[i].sample + 1) / (double) RATE_HZ;
+    int32_t const beat = beat_before(p_trace, t);
+    if ( beat >= 0 ) gaps[gap_count++] = t - p_trace->beats[beat];
+  }
+
+  double latency = 0;
+  if ( gap_count )
+  {
+    qsort(gaps, gap_count, sizeof(double), compare_double);
+    latency = gaps[gap_count / 2];
+  }
+  free(gaps);
+
+  /* each annotated interval counts once */
+  uint8_t * used = calloc(p_trace->beat_count + 1, 1);
+
+  for(uint32_t b=1; b<p_trace->beat_count; b++)
+  {
+    if ( p_trace->beats[b] >= WARMUP_S && p_trace->beats[b] + latency < seconds ) p_score->ref_intervals++;
+  }
+
+  for(uint32_t i=0; i<event_count; i++)
+  {
+    double const t = (events[i].sample + 1) / (double) RATE_HZ;
+    if ( t - latency < WARMUP_S ) continue;
+
+    p_score->reported++;
+
+    /* the annotated beat nearest to where this one should have been */
+    double const  peak = t - latency;
+    int32_t       beat = beat_before(p_trace, peak);
+    if ( beat + 1 < (int32_t) p_trace->beat_count &&
+         ( beat < 0 || p_trace->beats[beat+1] - peak < peak - p_trace->beats[beat] ) ) beat++;
+    if ( beat < 1 || used[beat] ) continue;
+
+    double const ref_rr = p_trace->beats[beat] - p_trace->beats[beat-1];
+    if ( fabs(p_trace->beats[beat] - peak) > ref_rr / 3 ) continue;
+
+    double const err_ms = fabs(events[i].rr * 1000.0 / 1024 - ref_rr * 1000);
+
+    used[beat] = 1;
+    p_score->matched++;
+    p_score->rr_abs_sum_ms += err_ms;
+    if ( err_ms > p_score->rr_abs_max_ms ) p_score->rr_abs_max_ms = err_ms;
+    if ( err_ms <= RR_TOLERANCE_MS ) p_score->rr_within++;
+  }
+  free(used);
+
+  /* BPM against the average of the annotated intervals the firmware could have seen */
+  for(uint32_t s=WARMUP_S; s<seconds; s++)
+  {
+    int32_t const last = beat_before(p_trace, s + 1 - latency);
+    if ( last < BPM_AVERAGE ) continue;
+
+    double const ref_bpm = 60.0 * BPM_AVERAGE / (p_trace->beats[last] - p_trace->beats[last - BPM_AVERAGE]);
+
+    p_score->bpm_seconds++;
+    if ( bpm[s] == 0 ) continue;
+
+    double const err = fabs(bpm[s] - ref_bpm);
+
+    p_score->bpm_locked++;
+    p_score->bpm_abs_sum += err;
+    if ( err <= BPM_TOLERANCE ) p_score->bpm_within++;
+  }
+
+  free(events);
+  free(bpm);
+}
+
+static double percent(uint32_t part, uint32_t whole)
+{
+  return whole ? 100.0 * part / whole : 0;
+}
+
+int main(int argc, char ** argv)
+{
+  double max_bpm_mae     = -1;
+  double min_sensitivity = -1;
+  bool   dump            = false;
+  int    failed          = 0;
+  int    first           = 1;
+
+  for( ; first < argc && argv[first][0] == '-'; first++)
+  {
+    if      ( !strcmp(argv[first], "--dump") )                                dump            = true;
+    else if ( !strcmp(argv[first], "--max-bpm-mae")     && first+1 < argc )  max_bpm_mae     = atof(argv[++first]);
+    else if ( !strcmp(argv[first], "--min-sensitivity") && first+1 < argc )  min_sensitivity = atof(argv[++first]);
+    else break;
+  }
+
+  if ( first >= argc )
+  {
+    fprintf(stderr, "usage: %s [--dump] [--max-bpm-mae bpm] [--min-sensitivity %%] trace.csv [...]\n", argv[0]);
+    return 2;
+  }
+
+  if ( !dump )
+  {
+    printf("heart_rate_ppg.c at %u Hz, band-pass %u-%u cHz\n", RATE_HZ, CFG_HEART_RATE_PPG_HPF_CHZ, CFG_HEART_RATE_PPG_LPF_CHZ);
+    printf("%-24s %6s %6s %7s %7s %7s %7s %6s %7s %7s %7s %8s\n", "trace", "beats", "RRs", "sens %", "RR mae", "RR max", "<20ms%",
+           "rej", "lock %", "BPM mae", "<5bpm%", "ns/smpl");
+  }
+
+  for(int i=first; i<argc; i++)
+  {
+    trace_t trace;
+    score_t score;
+
+    if ( trace_load(argv[i], &trace) )
+    {
+      failed = 1;
+      continue;
+    }
+
+    trace_score(&trace, &score, dump);
+
+    if ( !dump )
+    {
+      char const * name = strrchr(argv[i], '/');
+      name = name ? name+1 : argv[i];
+
+      double const sensitivity = percent(score.matched, score.ref_intervals);
+      double const bpm_mae     = score.bpm_locked ? score.bpm_abs_sum / score.bpm_locked : 999;
+
+      printf("%-24s %6u %6u %7.1f %7.1f %7.1f %7.1f %6u %7.1f %7.2f %7.1f %8.1f",
+             name, score.ref_intervals, score.reported, sensitivity,
+             score.matched ? score.rr_abs_sum_ms / score.matched : 0, score.rr_abs_max_ms,
+             percent(score.rr_within, score.matched), score.rejected,
+             percent(score.bpm_locked, score.bpm_seconds), bpm_mae,
+             percent(score.bpm_within, score.bpm_seconds), score.ns_per_sample);
+
+      if ( ( max_bpm_mae >= 0 && bpm_mae > max_bpm_mae ) || ( min_sensitivity >= 0 && sensitivity < min_sensitivity ) )
+      {
+        printf("  FAIL");
+        failed = 1;
+      }
+      printf("\n");
+    }
+
+    free(trace.samples);
+    free(trace.beats);
+  }
+
+  return failed;
+}
@@ -0,0 +1,22 @@
+/* Host stand-in for the SDK app_timer */
+#ifndef APP_TIMER_H__
+#define APP_TIMER_H__
+
+#include <stdint.h>
+
+#define APP_TIMER_CLOCK_FREQ  32768
+
+typedef uint32_t app_timer_id_t;
+typedef void (*app_timer_timeout_handler_t)(void * p_context);
+
+typedef enum
+{
+  APP_TIMER_MODE_SINGLE_SHOT,
+  APP_TIMER_MODE_REPEATED
+} app_timer_mode_t;
+
+uint32_t app_timer_create ( app_timer_id_t * p_timer_id, app_timer_mode_t mode, app_timer_timeout_handler_t timeout_handler );
+uint32_t app_timer_start  ( app_timer_id_t timer_id, uint32_t timeout_ticks, void * p_context );
+uint32_t app_timer_stop   ( app_timer_id_t timer_id );
+
+#endif
@@ -0,0 +1,26 @@
+/* Host stand-in for projects/common/common.h: just what heart_rate_ppg.c
+ * uses, so that the harness builds the firmware source unchanged */
+#ifndef _COMMON_H_
+#define _COMMON_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "projectconfig.h"
+
+typedef enum
+{
+  ERROR_NONE = 0
+} error_t;
+
+#define ASSERT_STATUS(sts)  do { uint32_t _status = (uint32_t) (sts); if ( _status != 0 ) return (error_t) _status; } while(0)
+
+#define memclr_(buffer, size)  memset(buffer, 0, size)
+
+static inline uint32_t max32_of(uint32_t x, uint32_t y)
+{
+  return (x > y) ? x : y;
+}
+
+#endif
@@ -0,0 +1,37 @@
+/* Host stand-in for the nRF51 register definitions, the ADC is never
+ * touched by the pipeline itself */
+#ifndef NRF_H
+#define NRF_H
+
+#include <stdint.h>
+
+typedef struct
+{
+  volatile uint32_t TASKS_START;
+  volatile uint32_t TASKS_STOP;
+  volatile uint32_t EVENTS_END;
+  volatile uint32_t INTENSET;
+  volatile uint32_t BUSY;
+  volatile uint32_t ENABLE;
+  volatile uint32_t CONFIG;
+  volatile uint32_t RESULT;
+} NRF_ADC_Type;
+
+extern NRF_ADC_Type * const NRF_ADC;
+
+typedef enum { ADC_IRQn = 7 } IRQn_Type;
+
+#define ADC_CONFIG_RES_Pos                               0
+#define ADC_CONFIG_RES_10bit                             2
+#define ADC_CONFIG_INPSEL_Pos                            2
+#define ADC_CONFIG_INPSEL_AnalogInputOneThirdPrescaling  2
+#define ADC_CONFIG_REFSEL_Pos                            5
+#define ADC_CONFIG_REFSEL_VBG                            0
+#define ADC_CONFIG_PSEL_Pos                              8
+#define ADC_CONFIG_EXTREFSEL_Pos                         16
+#define ADC_CONFIG_EXTREFSEL_None                        0
+#define ADC_ENABLE_ENABLE_Enabled                        1
+#define ADC_ENABLE_ENABLE_Disabled                       0
+#define ADC_INTENSET_END_Msk                             1
+
+#endif
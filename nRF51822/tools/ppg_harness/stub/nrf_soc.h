@@ -0,0 +1,13 @@
+/* Host stand-in for the SoftDevice SoC API */
+#ifndef NRF_SOC_H__
+#define NRF_SOC_H__
+
+#include <stdint.h>
+
+#define NRF_APP_PRIORITY_LOW  3
+
+uint32_t sd_nvic_ClearPendingIRQ ( uint32_t irq );
+uint32_t sd_nvic_SetPriority     ( uint32_t irq, uint32_t priority );
+uint32_t sd_nvic_EnableIRQ       ( uint32_t irq );
+
+#endif
@@ -0,0 +1,31 @@
+/* Host stand-in for the hrm projectconfig.h, the PPG settings can be
+ * overridden from the command line (see the Makefile) */
+#ifndef _PROJECTCONFIG_H_
+#define _PROJECTCONFIG_H_
+
+#define CFG_TIMER_PRESCALER                        0
+
+#define CFG_HEART_RATE_PPG                         1
+#define CFG_HEART_RATE_PPG_AIN                     2
+
+#ifndef CFG_HEART_RATE_PPG_RATE_HZ
+  #define CFG_HEART_RATE_PPG_RATE_HZ               50
+#endif
+
+#ifndef CFG_HEART_RATE_PPG_HPF_CHZ
+  #define CFG_HEART_RATE_PPG_HPF_CHZ               50
+#endif
+
+#ifndef CFG_HEART_RATE_PPG_LPF_CHZ
+  #define CFG_HEART_RATE_PPG_LPF_CHZ               400
+#endif
+
+#ifndef CFG_HEART_RATE_PPG_INVERTED
+  #define CFG_HEART_RATE_PPG_INVERTED              0
+#endif
+
+#ifndef CFG_HEART_RATE_PPG_CONTACT_MIN
+  #define CFG_HEART_RATE_PPG_CONTACT_MIN           8
+#endif
+
+#endif